@@ -0,0 +1,782 @@
+#include "../common/Frame.hpp"
+#include "../common/LineReader.hpp"
+#include "../common/Logger.hpp"
+#include "../common/NetUtils.hpp"
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+ *  ChatBench.cpp
+ *  -------------
+ *  Load generator for the chat server. Opens N keep-alive connections,
+ *  spread over worker threads that each drive their connections with
+ *  epoll, and issues a configurable mix of VIEW and POST commands:
+ *
+ *    closed loop  every connection keeps --pipeline commands in flight
+ *                 and sends the next one as soon as a reply arrives
+ *    open loop    (--rate R) commands are sent on a fixed schedule of R
+ *                 per second in total, whether or not replies keep up
+ *
+ *  Latency is measured from the moment a command was due, not from when
+ *  it could actually be written, so a stalled server shows up in the
+ *  percentiles instead of silently lowering the send rate (coordinated
+ *  omission). Results after the warm-up go to stdout (or --json FILE) as
+ *  one JSON document; a one-line summary goes to stderr.
+ *
+ *  --check-allocs N replaces the timed run with a pass/fail check: after
+ *  a warm-up, N POSTs and N VIEWs on the default room must not make a
+ *  single heap allocation on the server's request path.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+// Open loop: commands beyond this many in flight on one connection are
+// counted as missed instead of queued without bound.
+constexpr size_t kMaxInFlight = 4096;
+
+// epoll data tag of a worker's send timer (connections use their index).
+constexpr uint64_t kTimerEvent = UINT64_MAX;
+
+// Server counters of heap allocations (server/AllocCounter.hpp).
+constexpr std::string_view kAllocMetric = "chat_heap_allocations_total";
+constexpr std::string_view kExemptAllocMetric = "chat_heap_allocations_exempt_total";
+
+struct Options
+{
+    std::string server{ "127.0.0.1:7000" };
+    int connections{ 16 };
+    int threads{ 0 }; // 0: one per core, at most one per connection
+    double durationS{ 10 };
+    double warmupS{ 1 };
+    int viewPercent{ 10 };
+    std::string view{ "last:20" }; // last:N | since | all
+    size_t msgSize{ 100 };
+    double rate{ 0 }; // commands per second in total; 0 = closed loop
+    int pipeline{ 1 };
+    bool binary{ false };
+    std::string room;
+    std::string jsonPath; // empty: stdout
+    uint64_t checkAllocs{ 0 }; // --check-allocs N; 0 = timed run
+};
+
+enum class Op
+{
+    View,
+    Post
+};
+
+struct Pending
+{
+    Op op;
+    Clock::time_point due;
+};
+
+struct BenchConn
+{
+    int fd{ -1 };
+    int index{ 0 };
+    LineReader in;
+    std::string out;   // bytes not yet accepted by the socket
+    size_t outSent{ 0 };
+    bool wantWrite{ false };
+    std::deque<Pending> pending;
+    Clock::time_point nextDue;
+    uint64_t rng{ 0 };
+    uint64_t posted{ 0 };
+    uint64_t lastSeen{ 0 }; // newest sequence number seen (VIEW since)
+    uint32_t nextRequestId{ 1 };
+    size_t skip{ 0 }; // reply body bytes still to discard
+    bool skipOk{ true }; // ...and whether that reply was a success
+};
+
+struct Stats
+{
+    LatencyHistogram all, post, view;
+    uint64_t errors{ 0 };
+    uint64_t missed{ 0 };
+};
+
+uint64_t NextRandom(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+bool ParseArgs(int argc, char **argv, Options &o)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto next = [&]() -> const char * { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char *arg = argv[i];
+        const char *value = nullptr;
+        if (!strcmp(arg, "--binary"))
+        {
+            o.binary = true;
+            continue;
+        }
+        if (!(value = next()))
+            return false;
+        if (!strcmp(arg, "--server"))
+            o.server = value;
+        else if (!strcmp(arg, "--connections"))
+            o.connections = std::atoi(value);
+        else if (!strcmp(arg, "--threads"))
+            o.threads = std::atoi(value);
+        else if (!strcmp(arg, "--duration"))
+            o.durationS = std::atof(value);
+        else if (!strcmp(arg, "--warmup"))
+            o.warmupS = std::atof(value);
+        else if (!strcmp(arg, "--view-percent"))
+            o.viewPercent = std::atoi(value);
+        else if (!strcmp(arg, "--view"))
+            o.view = value;
+        else if (!strcmp(arg, "--msg-size"))
+            o.msgSize = std::strtoul(value, nullptr, 10);
+        else if (!strcmp(arg, "--rate"))
+            o.rate = std::atof(value);
+        else if (!strcmp(arg, "--pipeline"))
+            o.pipeline = std::atoi(value);
+        else if (!strcmp(arg, "--room"))
+            o.room = value;
+        else if (!strcmp(arg, "--json"))
+            o.jsonPath = value;
+        else if (!strcmp(arg, "--check-allocs"))
+            o.checkAllocs = std::strtoull(value, nullptr, 10);
+        else
+            return false;
+    }
+    bool viewOk = o.view == "all" || o.view == "since" || (o.view.rfind("last:", 0) == 0 && o.view.size() > 5);
+    return viewOk && o.connections > 0 && o.durationS > 0 && o.warmupS >= 0 && o.viewPercent >= 0 &&
+           o.viewPercent <= 100 && o.pipeline > 0 && o.rate >= 0 && o.room.size() <= 64 &&
+           (o.checkAllocs == 0 || o.room.empty());
+}
+
+/**
+ * @brief One connection's command encoder and reply parser.
+ */
+class Driver
+{
+  public:
+    Driver(const Options &options, Stats &stats, Clock::time_point measureFrom)
+        : m_o(options), m_stats(stats), m_measureFrom(measureFrom), m_filler(options.msgSize, 'x')
+    {
+        if (m_o.view.rfind("last:", 0) == 0)
+            m_viewLast = std::strtoull(m_o.view.c_str() + 5, nullptr, 10);
+    }
+
+    // Queues one command, of the configured mix, that was due at `due`.
+    void issue(BenchConn &c, Clock::time_point due)
+    {
+        issue(c, due, static_cast<int>(NextRandom(c.rng) % 100) < m_o.viewPercent ? Op::View : Op::Post);
+    }
+
+    void issue(BenchConn &c, Clock::time_point due, Op op)
+    {
+        if (c.pending.size() >= kMaxInFlight)
+        {
+            if (due >= m_measureFrom)
+                ++m_stats.missed;
+            return;
+        }
+        if (m_o.binary)
+            encodeFrame(c, op);
+        else
+            encodeText(c, op);
+        c.pending.push_back(Pending{ op, due });
+    }
+
+    /**
+     * @brief Consumes every complete reply buffered on c. Returns false if
+     * the stream is malformed.
+     */
+    bool parse(BenchConn &c)
+    {
+        while (true)
+        {
+            if (c.skip > 0)
+            {
+                size_t n = std::min(c.skip, c.in.buffered());
+                c.in.consume(n);
+                c.skip -= n;
+                if (c.skip > 0)
+                    return true;
+                complete(c, c.skipOk);
+            }
+            if (c.pending.empty())
+                return c.in.buffered() == 0;
+            int r = m_o.binary ? parseFrame(c) : parseText(c);
+            if (r <= 0)
+                return r == 0;
+        }
+    }
+
+  private:
+    // Returns 1 if a reply (header) was taken, 0 if more data is needed, -1 on error.
+    int parseText(BenchConn &c)
+    {
+        std::string_view line;
+        if (!c.in.popLine(line))
+            return c.in.overflow() ? -1 : 0;
+        if (line.substr(0, 3) != "OK ")
+        {
+            complete(c, false);
+            return 1;
+        }
+        if (c.pending.front().op == Op::Post)
+        {
+            complete(c, true);
+            return 1;
+        }
+        // "OK <bytes> <first> <last>", then the records and ".\n".
+        unsigned long long bytes = 0, first = 0, last = 0;
+        std::string header(line);
+        if (std::sscanf(header.c_str(), "OK %llu %llu %llu", &bytes, &first, &last) != 3)
+            return -1;
+        c.lastSeen = std::max<uint64_t>(c.lastSeen, last);
+        c.skip = static_cast<size_t>(bytes) + 2;
+        c.skipOk = true;
+        return 1;
+    }
+
+    int parseFrame(BenchConn &c)
+    {
+        std::string_view raw;
+        if (!c.in.peek(kFrameHeaderSize, raw))
+            return 0;
+        FrameHeader h;
+        if (!DecodeFrameHeader(raw.data(), h))
+            return -1;
+        bool ok = h.op == FrameOp::Ok;
+        if (ok && h.length >= 16)
+        {
+            // Both reply kinds start with u64 first-seq, u64 last-seq.
+            if (!c.in.peek(kFrameHeaderSize + 16, raw))
+                return 0;
+            c.lastSeen = std::max(c.lastSeen, GetU64(raw.data() + kFrameHeaderSize + 8));
+        }
+        c.in.consume(kFrameHeaderSize);
+        c.skip = h.length;
+        c.skipOk = ok;
+        if (c.skip == 0)
+            complete(c, ok);
+        return 1;
+    }
+
+    void complete(BenchConn &c, bool ok)
+    {
+        Pending p = c.pending.front();
+        c.pending.pop_front();
+        if (p.due < m_measureFrom)
+            return;
+        if (!ok)
+        {
+            ++m_stats.errors;
+            return;
+        }
+        uint64_t ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - p.due).count());
+        m_stats.all.record(ns);
+        (p.op == Op::Post ? m_stats.post : m_stats.view).record(ns);
+    }
+
+    std::string record(BenchConn &c)
+    {
+        std::string text = "bench " + std::to_string(c.index) + "-" + std::to_string(++c.posted) + " ";
+        if (text.size() < m_o.msgSize)
+            text.append(m_filler, 0, m_o.msgSize - text.size());
+        return text;
+    }
+
+    void encodeText(BenchConn &c, Op op)
+    {
+        std::string room = m_o.room.empty() ? "" : "#" + m_o.room + " ";
+        if (op == Op::Post)
+        {
+            c.out += "POST " + room + record(c) + "\n";
+            return;
+        }
+        c.out += "VIEW " + room;
+        if (m_o.view == "since")
+            c.out += "SINCE " + std::to_string(c.lastSeen);
+        else if (m_o.view != "all")
+            c.out += "LAST " + std::to_string(m_viewLast);
+        c.out += "\n";
+    }
+
+    void encodeFrame(BenchConn &c, Op op)
+    {
+        std::string payload;
+        uint16_t flags = 0;
+        if (!m_o.room.empty())
+        {
+            flags = kFrameRoomFlag;
+            payload.push_back(static_cast<char>(m_o.room.size()));
+            payload += m_o.room;
+        }
+        if (op == Op::Post)
+        {
+            payload += record(c);
+        }
+        else if (m_o.view == "since")
+        {
+            flags |= static_cast<uint16_t>(ViewMode::Since);
+            PutU64(payload, c.lastSeen);
+        }
+        else if (m_o.view != "all")
+        {
+            flags |= static_cast<uint16_t>(ViewMode::Last);
+            PutU64(payload, m_viewLast);
+        }
+        c.out += MakeFrame(op == Op::Post ? FrameOp::Post : FrameOp::View, flags, c.nextRequestId++, payload);
+    }
+
+    const Options &m_o;
+    Stats &m_stats;
+    const Clock::time_point m_measureFrom;
+    const std::string m_filler;
+    uint64_t m_viewLast{ 20 };
+};
+
+// Connects and switches to keep-alive (or binary) mode; blocking.
+int OpenConnection(const Options &o, BenchConn &c)
+{
+    c.fd = TcpConnectHostPort(o.server);
+    if (c.fd < 0)
+        return -1;
+    c.in.reset(c.fd);
+    std::string_view reply;
+    std::string_view hello = o.binary ? kBinaryHello : std::string_view("KEEPALIVE");
+    std::string_view accept = o.binary ? kBinaryAccept : std::string_view("OK keepalive");
+    if (SendLine(c.fd, hello) != 0 || c.in.next(reply) != 1 || reply != accept)
+        return -1;
+    return ::fcntl(c.fd, F_SETFL, ::fcntl(c.fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * @brief Asks for the server's STATS dump on a blocking connection in text
+ * or binary mode. False on a broken connection or an error reply.
+ */
+bool FetchStats(int fd, LineReader &in, bool binary, uint32_t requestId, std::string &dump)
+{
+    dump.clear();
+    if (binary)
+    {
+        std::string frame = MakeFrame(FrameOp::Stats, 0, requestId, {});
+        std::string header;
+        FrameHeader h;
+        return SendAll(fd, frame.data(), frame.size()) == 0 && in.read(kFrameHeaderSize, header) == 1 &&
+               DecodeFrameHeader(header.data(), h) && h.op == FrameOp::Ok && in.read(h.length, dump) == 1;
+    }
+    // "OK <bytes>", the dump, then ".".
+    std::string_view line;
+    if (SendLine(fd, "STATS") != 0 || in.next(line) != 1 || line.substr(0, 3) != "OK ")
+        return false;
+    size_t bytes = std::strtoul(std::string(line.substr(3)).c_str(), nullptr, 10);
+    return in.read(bytes, dump) == 1 && in.next(line) == 1 && line == ".";
+}
+
+// Value of the "name value" line of a STATS dump; false if there is none.
+bool FindCounter(std::string_view dump, std::string_view name, uint64_t &value)
+{
+    for (size_t pos = 0; pos < dump.size();)
+    {
+        size_t end = std::min(dump.find('\n', pos), dump.size());
+        std::string_view line = dump.substr(pos, end - pos);
+        if (line.size() > name.size() && line.compare(0, name.size(), name) == 0 && line[name.size()] == ' ')
+        {
+            value = std::strtoull(std::string(line.substr(name.size() + 1)).c_str(), nullptr, 10);
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief Reads one counter from the server's STATS dump on a connection of
+ * its own. Returns false if the server is unreachable or does not export
+ * the counter (e.g. a build without allocation counting).
+ */
+bool ReadServerCounter(const std::string &server, std::string_view name, uint64_t &value)
+{
+    int fd = TcpConnectHostPort(server);
+    if (fd < 0)
+        return false;
+    LineReader in(fd);
+    std::string dump;
+    bool found = FetchStats(fd, in, false, 0, dump) && FindCounter(dump, name, value);
+    ::close(fd);
+    return found;
+}
+
+/**
+ * @brief The server's heap allocations on the request path so far: all of
+ * them minus the exempt ones (STATS itself is exempt). Asked on the
+ * check's own connection, so no accept or close adds to the count.
+ */
+bool ReadRequestPathAllocations(const Options &o, BenchConn &c, uint64_t &value)
+{
+    std::string dump;
+    uint64_t all = 0;
+    uint64_t exempt = 0;
+    if (!FetchStats(c.fd, c.in, o.binary, c.nextRequestId++, dump) || !FindCounter(dump, kAllocMetric, all) ||
+        !FindCounter(dump, kExemptAllocMetric, exempt))
+        return false;
+    value = all - exempt;
+    return true;
+}
+
+// Writes as much of c.out as the socket takes; false on a broken connection.
+bool FlushOut(BenchConn &c)
+{
+    while (c.outSent < c.out.size())
+    {
+        ssize_t n = ::send(c.fd, c.out.data() + c.outSent, c.out.size() - c.outSent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0)
+            return false;
+        c.outSent += static_cast<size_t>(n);
+    }
+    if (c.outSent == c.out.size())
+    {
+        c.out.clear();
+        c.outSent = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Worker thread: drives its connections until `end`.
+ */
+void RunWorker(const Options &o, std::vector<BenchConn> &conns, Stats &stats, Clock::time_point start,
+               Clock::time_point measureFrom, Clock::time_point end)
+{
+    Driver driver(o, stats, measureFrom);
+    int ep = ::epoll_create1(EPOLL_CLOEXEC);
+    // Open loop sleeps until the next send is due; epoll_wait's millisecond
+    // timeout is too coarse for that and spinning would steal the server's CPU.
+    int timer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    epoll_event tev{};
+    tev.events = EPOLLIN;
+    tev.data.u64 = kTimerEvent;
+    ::epoll_ctl(ep, EPOLL_CTL_ADD, timer, &tev);
+    for (size_t i = 0; i < conns.size(); ++i)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        ::epoll_ctl(ep, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    }
+
+    const bool open = o.rate > 0;
+    const auto interval = open ? std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(o.connections / o.rate))
+                               : Clock::duration::zero();
+    for (auto &c : conns)
+    {
+        // Stagger the open-loop schedules so connections do not fire together.
+        c.nextDue = start + (open ? interval * static_cast<int64_t>(NextRandom(c.rng) % 1000) / 1000 : Clock::duration());
+    }
+
+    std::vector<epoll_event> events(conns.size() + 1);
+    size_t alive = conns.size();
+    while (alive > 0)
+    {
+        auto now = Clock::now();
+        if (now >= end)
+            break;
+
+        // Issue whatever is due, then push it to the sockets.
+        auto wake = end;
+        for (auto &c : conns)
+        {
+            if (c.fd < 0)
+                continue;
+            if (open)
+            {
+                for (; c.nextDue <= now; c.nextDue += interval)
+                    driver.issue(c, c.nextDue);
+                wake = std::min(wake, c.nextDue);
+            }
+            else
+            {
+                while (c.pending.size() < static_cast<size_t>(o.pipeline))
+                    driver.issue(c, now);
+            }
+            if (!c.out.empty() && !FlushOut(c))
+            {
+                ::close(c.fd);
+                c.fd = -1;
+                --alive;
+                continue;
+            }
+            bool wantWrite = !c.out.empty();
+            if (wantWrite != c.wantWrite)
+            {
+                epoll_event ev{};
+                ev.events = wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+                ev.data.u64 = static_cast<uint64_t>(&c - conns.data());
+                ::epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+                c.wantWrite = wantWrite;
+            }
+        }
+
+        if (open)
+        {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch()).count();
+            itimerspec when{};
+            when.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+            when.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+            ::timerfd_settime(timer, TFD_TIMER_ABSTIME, &when, nullptr);
+        }
+        int n = ::epoll_wait(ep, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.u64 == kTimerEvent)
+            {
+                uint64_t expirations;
+                (void)!::read(timer, &expirations, sizeof expirations);
+                continue;
+            }
+            BenchConn &c = conns[events[i].data.u64];
+            if (c.fd < 0)
+                continue;
+            bool ok = true;
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                while (ok)
+                {
+                    ssize_t got = c.in.fill();
+                    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        break;
+                    ok = got > 0 && driver.parse(c);
+                }
+            }
+            if (ok && (events[i].events & EPOLLOUT))
+                ok = FlushOut(c);
+            if (!ok)
+            {
+                LOG_WARN("[BENCH] Connection " << c.index << " closed by the server");
+                ::close(c.fd);
+                c.fd = -1;
+                --alive;
+            }
+        }
+    }
+
+    for (auto &c : conns)
+    {
+        if (c.fd >= 0)
+            ::close(c.fd);
+    }
+    ::close(timer);
+    ::close(ep);
+}
+
+std::string JsonEscape(const std::string &s)
+{
+    std::string out;
+    for (char ch : s)
+    {
+        if (ch == '"' || ch == '\\')
+            out.push_back('\\');
+        out.push_back(ch);
+    }
+    return out;
+}
+} // namespace
+
+/**
+ * @brief Sends `rounds` POST + VIEW pairs on c, one command at a time
+ * (c is blocking). False on a broken connection or stream.
+ */
+bool RunPairs(Driver &driver, BenchConn &c, uint64_t rounds)
+{
+    for (uint64_t i = 0; i < 2 * rounds; ++i)
+    {
+        driver.issue(c, Clock::now(), i % 2 == 0 ? Op::Post : Op::View);
+        if (!FlushOut(c))
+            return false;
+        while (!c.pending.empty())
+        {
+            if (c.in.fill() <= 0 || !driver.parse(c))
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief --check-allocs: N POST + VIEW pairs on the default room as a
+ * warm-up, then N more that must leave the server's request-path
+ * allocation count unchanged. Returns the exit status: 0 pass, 4 fail.
+ *
+ * Only the default room with the server's default durability is held to
+ * zero; named rooms and group commit hand each command to another thread
+ * and allocate by design.
+ */
+int CheckAllocations(const Options &o)
+{
+    Stats stats;
+    Driver driver(o, stats, Clock::time_point::min());
+    BenchConn c;
+    if (OpenConnection(o, c) != 0 || ::fcntl(c.fd, F_SETFL, ::fcntl(c.fd, F_GETFL) & ~O_NONBLOCK) != 0)
+    {
+        LOG_ERROR("[BENCH] Cannot connect to " << o.server);
+        return 1;
+    }
+
+    // The warm-up reads the counters once too, so the connection has
+    // already carried a reply as large as the dump.
+    uint64_t before = 0;
+    uint64_t after = 0;
+    bool ok = RunPairs(driver, c, o.checkAllocs) && ReadRequestPathAllocations(o, c, before) &&
+              ReadRequestPathAllocations(o, c, before) && RunPairs(driver, c, o.checkAllocs) &&
+              ReadRequestPathAllocations(o, c, after);
+    ::close(c.fd);
+    if (!ok)
+    {
+        LOG_ERROR("[BENCH] Allocation check failed to run (connection lost, or the server does not count "
+                  "allocations)");
+        return 1;
+    }
+    if (stats.errors > 0)
+    {
+        LOG_ERROR("[BENCH] Allocation check: " << stats.errors << " commands got an ERR");
+        return 3;
+    }
+
+    std::fprintf(stderr, "chatbench: %" PRIu64 " POST + %" PRIu64 " VIEW, %" PRIu64 " server allocations: %s\n",
+                 o.checkAllocs, o.checkAllocs, after - before, after == before ? "ok" : "FAIL");
+    return after == before ? 0 : 4;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if (!ParseArgs(argc, argv, o))
+    {
+        std::cerr << "usage: chatbench [--server host:port] [--connections N] [--threads T] [--duration S]\n"
+                     "                 [--warmup S] [--view-percent P] [--view last:N|since|all] [--msg-size B]\n"
+                     "                 [--rate R | --pipeline D] [--binary] [--room NAME] [--json FILE]\n"
+                     "       chatbench [--server host:port] [--binary] [--view ...] [--msg-size B] --check-allocs N\n";
+        return 2;
+    }
+    if (o.checkAllocs > 0)
+        return CheckAllocations(o);
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    int threads = o.threads > 0 ? o.threads : static_cast<int>(cores);
+    threads = std::min(threads, o.connections);
+
+    // Connect everything before the clock starts.
+    std::vector<std::vector<BenchConn>> shards(static_cast<size_t>(threads));
+    for (int i = 0; i < o.connections; ++i)
+    {
+        auto &shard = shards[static_cast<size_t>(i % threads)];
+        shard.emplace_back();
+        BenchConn &c = shard.back();
+        c.index = i;
+        c.rng = 0x9E3779B97F4A7C15ull * static_cast<uint64_t>(i + 1);
+        if (OpenConnection(o, c) != 0)
+        {
+            LOG_ERROR("[BENCH] Cannot open connection " << i << " to " << o.server);
+            return 1;
+        }
+    }
+
+    const auto start = Clock::now();
+    const auto measureFrom = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.warmupS));
+    const auto end = measureFrom + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.durationS));
+
+    std::vector<Stats> stats(static_cast<size_t>(threads));
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < shards.size(); ++t)
+        workers.emplace_back(RunWorker, std::cref(o), std::ref(shards[t]), std::ref(stats[t]), start, measureFrom, end);
+
+    // The server's heap allocation count over the measured interval; the
+    // two STATS requests add a constant few of their own.
+    uint64_t allocsBefore = 0;
+    uint64_t allocsAfter = 0;
+    std::this_thread::sleep_until(measureFrom);
+    bool haveAllocs = ReadServerCounter(o.server, kAllocMetric, allocsBefore);
+    for (auto &w : workers)
+        w.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - measureFrom).count();
+    haveAllocs = haveAllocs && ReadServerCounter(o.server, kAllocMetric, allocsAfter);
+
+    Stats total;
+    for (const auto &s : stats)
+    {
+        total.all.merge(s.all);
+        total.post.merge(s.post);
+        total.view.merge(s.view);
+        total.errors += s.errors;
+        total.missed += s.missed;
+    }
+    const double throughput = static_cast<double>(total.all.count()) / elapsed;
+
+    std::string json = "{\n  \"config\": {";
+    char buf[512];
+    std::snprintf(buf, sizeof buf,
+                  "\"server\": \"%s\", \"connections\": %d, \"threads\": %d, \"mode\": \"%s\", \"rate\": %.1f, "
+                  "\"pipeline\": %d, \"duration_s\": %.1f, \"warmup_s\": %.1f, \"view_percent\": %d, "
+                  "\"view\": \"%s\", \"msg_size\": %zu, \"wire\": \"%s\", \"room\": \"%s\"},\n",
+                  JsonEscape(o.server).c_str(), o.connections, threads, o.rate > 0 ? "open" : "closed", o.rate,
+                  o.pipeline, o.durationS, o.warmupS, o.viewPercent, JsonEscape(o.view).c_str(), o.msgSize,
+                  o.binary ? "binary" : "text", JsonEscape(o.room).c_str());
+    json += buf;
+    std::snprintf(buf, sizeof buf,
+                  "  \"elapsed_s\": %.3f,\n  \"completed\": %" PRIu64 ",\n  \"errors\": %" PRIu64
+                  ",\n  \"missed\": %" PRIu64 ",\n  \"throughput_ops_s\": %.1f,\n",
+                  elapsed, total.all.count(), total.errors, total.missed, throughput);
+    json += buf;
+    if (haveAllocs && total.all.count() > 0)
+        std::snprintf(buf, sizeof buf, "%.3f",
+                      static_cast<double>(allocsAfter - allocsBefore) / static_cast<double>(total.all.count()));
+    else
+        std::snprintf(buf, sizeof buf, "null");
+    json = json + "  \"server_allocs_per_op\": " + buf + ",\n  \"latency_us\": {\n";
+    json += "    \"all\": " + total.all.toJson() + ",\n";
+    json += "    \"post\": " + total.post.toJson() + ",\n";
+    json += "    \"view\": " + total.view.toJson() + "\n  }\n}\n";
+
+    FILE *out = o.jsonPath.empty() ? stdout : std::fopen(o.jsonPath.c_str(), "w");
+    if (!out)
+    {
+        LOG_ERROR("[BENCH] Cannot write " << o.jsonPath << ": " << strerror(errno));
+        return 1;
+    }
+    std::fputs(json.c_str(), out);
+    if (out != stdout)
+        std::fclose(out);
+
+    std::fprintf(stderr, "chatbench: %.0f ops/s, p50 %.1f us, p99 %.1f us, p999 %.1f us, %" PRIu64 " errors\n",
+                 throughput, total.all.percentile(0.50) / 1000.0, total.all.percentile(0.99) / 1000.0,
+                 total.all.percentile(0.999) / 1000.0, total.errors);
+    return total.errors > 0 ? 3 : 0;
+}
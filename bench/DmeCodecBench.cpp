@@ -0,0 +1,127 @@
+#include "../client/DME.hpp"
+#include "../common/Logger.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ *  DmeCodecBench.cpp
+ *  -----------------
+ *  Microbenchmark of the per-message DME work on the client:
+ *
+ *    parse    DmeMessage::parseText() of REQUEST / REPLY / TOKEN lines
+ *    encode   DmeMessage::writeText() and writePayload() into a stack buffer
+ *    handle   RicartAgrawala::handleMessage() of a REQUEST, which answers
+ *             with a REPLY through a transport that only counts it
+ *
+ *  Every case reports messages per second and heap allocations per
+ *  message (counted by replacing the global operator new):
+ *
+ *      dmecodecbench [--iterations N]
+ */
+
+namespace
+{
+std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+class CountingTransport : public DmeTransport
+{
+  public:
+    // Encodes like PeerMesh's text wire, minus the socket write.
+    void send(const DmePeer &, const DmeMessage &msg) override
+    {
+        char buf[DmeMessage::kMaxWire];
+        m_sent += msg.writeText(buf);
+    }
+
+  private:
+    uint64_t m_sent{ 0 };
+};
+
+template <typename Fn> void Measure(const char *name, uint64_t iterations, Fn &&fn)
+{
+    fn(0); // warm caches and let reusable buffers reach their working size
+    uint64_t before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i)
+        fn(i);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double allocs = static_cast<double>(g_allocations.load() - before) / static_cast<double>(iterations);
+    std::printf("%-16s %12.0f msg/s %8.1f ns/msg %6.2f allocs/msg\n", name, static_cast<double>(iterations) / seconds,
+                seconds * 1e9 / static_cast<double>(iterations), allocs);
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    uint64_t iterations = 2000000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            std::fprintf(stderr, "usage: dmecodecbench [--iterations N]\n");
+            return 2;
+        }
+    }
+    Logger::instance().setLevel(LogLevel::Error);
+
+    const std::string request = "REQUEST 123456 2";
+    const std::string reply = "REPLY 2 123456";
+    const std::string token = "TOKEN 3 5 10 11 12 13 14 2 4 5";
+    DmeMessage msg;
+    volatile size_t sink = 0;
+
+    Measure("parse REQUEST", iterations, [&](uint64_t) { sink = sink + DmeMessage::parseText(request, msg); });
+    Measure("parse REPLY", iterations, [&](uint64_t) { sink = sink + DmeMessage::parseText(reply, msg); });
+    Measure("parse TOKEN", iterations, [&](uint64_t) { sink = sink + DmeMessage::parseText(token, msg); });
+
+    DmeMessage::parseText(request, msg);
+    char buf[DmeMessage::kMaxWire];
+    Measure("encode text", iterations, [&](uint64_t) { sink = sink + msg.writeText(buf); });
+    Measure("encode binary", iterations, [&](uint64_t) { sink = sink + msg.writePayload(buf); });
+
+    // Node 1 answers REQUESTs from node 2; node 1 never requests, so every
+    // REQUEST is granted at once with a REPLY.
+    auto dme = DME::create(DME::Algorithm::RicartAgrawala, 1, { DmePeer{ 2, "bench" } },
+                           std::make_shared<CountingTransport>());
+    Measure("handle REQUEST", iterations, [&](uint64_t i) {
+        msg.type = DmeMessage::Type::Request;
+        msg.from = 2;
+        msg.value = static_cast<int>(i + 1);
+        dme->handleMessage(msg);
+    });
+    Measure("parse+handle", iterations, [&](uint64_t) {
+        DmeMessage::parseText(request, msg);
+        dme->handleMessage(msg);
+    });
+    return sink == 0 ? 1 : 0;
+}
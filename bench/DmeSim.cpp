@@ -0,0 +1,398 @@
+#include "../client/DME.hpp"
+#include "../common/Logger.hpp"
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ *  DmeSim.cpp
+ *  ----------
+ *  Runs N DME instances in one process, connected by in-memory channels
+ *  instead of TCP, and measures them without any EC2 hosts:
+ *
+ *      dmesim --nodes 5 --mutex ra --duration 5 --delay-us 200 --reorder 10 --drop 1
+ *
+ *  Every node has a thread that loops request / hold the critical
+ *  section / release / think. The network delays each message by
+ *  --delay-us plus up to --jitter-us. Links are FIFO like TCP, except that
+ *  --reorder percent of the messages take a slow path and may overtake
+ *  or be overtaken; --drop percent are lost. A node whose request times
+ *  out (--timeout-ms) counts a timeout and asks again.
+ *
+ *  While in the critical section a node checks that nobody else is: any
+ *  overlap is a mutual-exclusion violation, reported and reflected in the
+ *  exit status (3). The JSON report (stdout or --json FILE) holds the
+ *  acquisition rate, per-node counts, message counts and the distribution
+ *  of the time from request to entry.
+ */
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+struct SimOptions
+{
+    int nodes{ 3 };
+    DME::Algorithm algorithm{ DME::Algorithm::RicartAgrawala };
+    std::string mutex{ "ra" };
+    double durationS{ 5 };
+    long csUs{ 50 };
+    long thinkUs{ 200 };
+    long delayUs{ 100 };
+    long jitterUs{ 0 };
+    double reorderPercent{ 0 };
+    double dropPercent{ 0 };
+    long timeoutMs{ 500 };
+    uint64_t seed{ 1 };
+    std::string jsonPath;
+};
+
+/**
+ * @brief In-memory network: a delivery queue ordered by due time and one
+ * dispatcher thread calling DME::handleMessage() on the receiver.
+ */
+class SimNetwork
+{
+  public:
+    explicit SimNetwork(const SimOptions &o) : m_o(o), m_rng(o.seed)
+    {
+    }
+
+    void attach(std::vector<DME *> nodes)
+    {
+        m_nodes = std::move(nodes);
+    }
+
+    // Queues msg for node `to` (ids are 1..N), or drops it.
+    void submit(int to, const DmeMessage &msg)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        ++m_sent;
+        std::uniform_real_distribution<double> percent(0.0, 100.0);
+        if (percent(m_rng) < m_o.dropPercent)
+        {
+            ++m_dropped;
+            return;
+        }
+
+        long us = m_o.delayUs + (m_o.jitterUs > 0 ? static_cast<long>(m_rng() % (m_o.jitterUs + 1)) : 0);
+        auto at = Clock::now() + std::chrono::microseconds(us);
+        auto &linkTail = m_linkTail[{ msg.from, to }];
+        if (percent(m_rng) < m_o.reorderPercent)
+        {
+            // Slow path: up to ten times the normal delay, outside the link's FIFO order.
+            long extra = static_cast<long>(m_rng() % static_cast<uint64_t>(10 * (m_o.delayUs + m_o.jitterUs) + 100));
+            at += std::chrono::microseconds(extra);
+            ++m_reordered;
+        }
+        else
+        {
+            at = std::max(at, linkTail);
+            linkTail = at;
+        }
+        m_queue.push(Delivery{ at, m_nextSeq++, to, msg });
+        m_cv.notify_one();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        while (!m_stopping)
+        {
+            if (m_queue.empty())
+            {
+                m_cv.wait(lk);
+                continue;
+            }
+            if (Clock::now() < m_queue.top().at)
+            {
+                m_cv.wait_until(lk, m_queue.top().at);
+                continue;
+            }
+            Delivery d = m_queue.top();
+            m_queue.pop();
+            ++m_delivered;
+            lk.unlock();
+            m_nodes[static_cast<size_t>(d.to - 1)]->handleMessage(d.msg);
+            lk.lock();
+        }
+    }
+
+    void stop()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stopping = true;
+        m_cv.notify_all();
+    }
+
+    uint64_t sent() const
+    {
+        return m_sent;
+    }
+    uint64_t dropped() const
+    {
+        return m_dropped;
+    }
+    uint64_t reordered() const
+    {
+        return m_reordered;
+    }
+    uint64_t delivered() const
+    {
+        return m_delivered;
+    }
+
+  private:
+    struct Delivery
+    {
+        Clock::time_point at;
+        uint64_t seq; // ties keep submission order
+        int to;
+        DmeMessage msg;
+
+        bool operator>(const Delivery &other) const
+        {
+            return at != other.at ? at > other.at : seq > other.seq;
+        }
+    };
+
+    const SimOptions &m_o;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery>> m_queue;
+    std::map<std::pair<int, int>, Clock::time_point> m_linkTail; // (from, to): latest FIFO delivery
+    std::vector<DME *> m_nodes;
+    std::mt19937_64 m_rng;
+    uint64_t m_nextSeq{ 0 };
+    uint64_t m_sent{ 0 };
+    uint64_t m_dropped{ 0 };
+    uint64_t m_reordered{ 0 };
+    uint64_t m_delivered{ 0 };
+    bool m_stopping{ false };
+};
+
+/**
+ * @brief DmeTransport shared by all simulated nodes: hands every message
+ * to the network, addressed by the peer's id.
+ */
+class SimTransport : public DmeTransport
+{
+  public:
+    explicit SimTransport(SimNetwork &network) : m_network(network)
+    {
+    }
+
+    void send(const DmePeer &peer, const DmeMessage &msg) override
+    {
+        m_network.submit(peer.id, msg);
+    }
+
+  private:
+    SimNetwork &m_network;
+};
+
+struct NodeStats
+{
+    LatencyHistogram wait;
+    uint64_t acquisitions{ 0 };
+    uint64_t timeouts{ 0 };
+};
+
+std::atomic<int> g_inCriticalSection{ 0 };
+std::atomic<uint64_t> g_violations{ 0 };
+std::atomic<bool> g_stop{ false };
+
+void RunNode(const SimOptions &o, DME *dme, NodeStats &stats)
+{
+    while (!g_stop.load(std::memory_order_relaxed))
+    {
+        auto asked = Clock::now();
+        if (!dme->requestCriticalSection())
+        {
+            ++stats.timeouts;
+            continue;
+        }
+        auto entered = Clock::now();
+
+        if (g_inCriticalSection.fetch_add(1) != 0)
+        {
+            ++g_violations;
+            LOG_ERROR("[SIM] Node " << dme->getSelfId() << " entered the critical section while it was held");
+        }
+        if (o.csUs > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(o.csUs));
+        g_inCriticalSection.fetch_sub(1);
+        dme->releaseCriticalSection();
+
+        ++stats.acquisitions;
+        stats.wait.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(entered - asked).count()));
+        if (o.thinkUs > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(o.thinkUs));
+    }
+}
+
+bool ParseArgs(int argc, char **argv, SimOptions &o)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (!strcmp(arg, "--nodes"))
+            o.nodes = std::atoi(value);
+        else if (!strcmp(arg, "--mutex"))
+        {
+            o.mutex = value;
+            if (!DME::parseAlgorithm(value, o.algorithm))
+                return false;
+        }
+        else if (!strcmp(arg, "--duration"))
+            o.durationS = std::atof(value);
+        else if (!strcmp(arg, "--cs-us"))
+            o.csUs = std::atol(value);
+        else if (!strcmp(arg, "--think-us"))
+            o.thinkUs = std::atol(value);
+        else if (!strcmp(arg, "--delay-us"))
+            o.delayUs = std::atol(value);
+        else if (!strcmp(arg, "--jitter-us"))
+            o.jitterUs = std::atol(value);
+        else if (!strcmp(arg, "--reorder"))
+            o.reorderPercent = std::atof(value);
+        else if (!strcmp(arg, "--drop"))
+            o.dropPercent = std::atof(value);
+        else if (!strcmp(arg, "--timeout-ms"))
+            o.timeoutMs = std::atol(value);
+        else if (!strcmp(arg, "--seed"))
+            o.seed = std::strtoull(value, nullptr, 10);
+        else if (!strcmp(arg, "--json"))
+            o.jsonPath = value;
+        else if (!strcmp(arg, "--log-level"))
+        {
+            LogLevel level;
+            if (!Logger::parseLevel(value, level))
+                return false;
+            Logger::instance().setLevel(level);
+        }
+        else
+            return false;
+    }
+    return o.nodes >= 2 && o.durationS > 0 && o.csUs >= 0 && o.thinkUs >= 0 && o.delayUs >= 0 && o.jitterUs >= 0 &&
+           o.timeoutMs > 0;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    // Timeouts are expected under injected loss; only errors by default.
+    Logger::instance().setLevel(LogLevel::Error);
+
+    SimOptions o;
+    if (!ParseArgs(argc, argv, o))
+    {
+        std::cerr << "usage: dmesim [--nodes N] [--mutex ra|token] [--duration S] [--cs-us U] [--think-us U]\n"
+                     "              [--delay-us U] [--jitter-us U] [--reorder PCT] [--drop PCT] [--timeout-ms MS]\n"
+                     "              [--seed N] [--json FILE] [--log-level LEVEL]\n";
+        return 2;
+    }
+
+    SimNetwork network(o);
+    auto transport = std::make_shared<SimTransport>(network);
+    std::vector<std::unique_ptr<DME>> nodes;
+    std::vector<DME *> byId;
+    for (int self = 1; self <= o.nodes; ++self)
+    {
+        std::vector<DmePeer> peers;
+        for (int id = 1; id <= o.nodes; ++id)
+        {
+            if (id != self)
+                peers.push_back(DmePeer{ id, "sim" });
+        }
+        nodes.push_back(DME::create(o.algorithm, self, std::move(peers), transport));
+        nodes.back()->setTimeout(std::chrono::milliseconds(o.timeoutMs));
+        byId.push_back(nodes.back().get());
+    }
+    network.attach(byId);
+
+    std::thread dispatcher(&SimNetwork::run, &network);
+    std::vector<NodeStats> stats(static_cast<size_t>(o.nodes));
+    std::vector<std::thread> workers;
+    const auto start = Clock::now();
+    for (size_t i = 0; i < nodes.size(); ++i)
+        workers.emplace_back(RunNode, std::cref(o), nodes[i].get(), std::ref(stats[i]));
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(o.durationS));
+    g_stop = true;
+    for (auto &w : workers)
+        w.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    network.stop();
+    dispatcher.join();
+
+    LatencyHistogram wait;
+    uint64_t acquisitions = 0, timeouts = 0;
+    std::string perNode;
+    for (const auto &s : stats)
+    {
+        wait.merge(s.wait);
+        acquisitions += s.acquisitions;
+        timeouts += s.timeouts;
+        perNode += (perNode.empty() ? "" : ", ") + std::to_string(s.acquisitions);
+    }
+    const uint64_t violations = g_violations.load();
+
+    std::string json;
+    char buf[512];
+    std::snprintf(buf, sizeof buf,
+                  "{\n  \"config\": {\"nodes\": %d, \"mutex\": \"%s\", \"duration_s\": %.1f, \"cs_us\": %ld, "
+                  "\"think_us\": %ld, \"delay_us\": %ld, \"jitter_us\": %ld, \"reorder_percent\": %.2f, "
+                  "\"drop_percent\": %.2f, \"timeout_ms\": %ld, \"seed\": %" PRIu64 "},\n",
+                  o.nodes, o.mutex == "token" ? "token" : "ra", o.durationS, o.csUs, o.thinkUs, o.delayUs, o.jitterUs,
+                  o.reorderPercent, o.dropPercent, o.timeoutMs, o.seed);
+    json += buf;
+    std::snprintf(buf, sizeof buf,
+                  "  \"elapsed_s\": %.3f,\n  \"acquisitions\": %" PRIu64 ",\n  \"acquisitions_per_s\": %.1f,\n"
+                  "  \"timeouts\": %" PRIu64 ",\n  \"violations\": %" PRIu64 ",\n"
+                  "  \"messages\": {\"sent\": %" PRIu64 ", \"dropped\": %" PRIu64 ", \"reordered\": %" PRIu64
+                  ", \"delivered\": %" PRIu64 ", \"per_acquisition\": %.2f},\n",
+                  elapsed, acquisitions, static_cast<double>(acquisitions) / elapsed, timeouts, violations,
+                  network.sent(), network.dropped(), network.reordered(), network.delivered(),
+                  acquisitions ? static_cast<double>(network.sent()) / static_cast<double>(acquisitions) : 0.0);
+    json += buf;
+    json += "  \"per_node_acquisitions\": [" + perNode + "],\n";
+    json += "  \"wait_us\": " + wait.toJson() + "\n}\n";
+
+    FILE *out = o.jsonPath.empty() ? stdout : std::fopen(o.jsonPath.c_str(), "w");
+    if (!out)
+    {
+        LOG_ERROR("[SIM] Cannot write " << o.jsonPath << ": " << strerror(errno));
+        return 1;
+    }
+    std::fputs(json.c_str(), out);
+    if (out != stdout)
+        std::fclose(out);
+
+    std::fprintf(stderr,
+                 "dmesim: %.0f acquisitions/s, wait p50 %.1f us, p99 %.1f us, %" PRIu64 " timeouts, %" PRIu64
+                 " violations\n",
+                 static_cast<double>(acquisitions) / elapsed, wait.percentile(0.50) / 1000.0,
+                 wait.percentile(0.99) / 1000.0, timeouts, violations);
+    return violations > 0 ? 3 : 0;
+}
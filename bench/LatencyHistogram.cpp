@@ -0,0 +1,84 @@
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+
+/**
+ * @brief Values below kSub get a bucket each; above that, the bucket is
+ * the position of the highest set bit plus the next kSubBits bits.
+ */
+size_t LatencyHistogram::bucketOf(uint64_t ns)
+{
+    if (ns < kSub)
+        return static_cast<size_t>(ns);
+    unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(ns));
+    unsigned shift = msb - kSubBits;
+    return (shift + 1) * kSub + static_cast<size_t>((ns >> shift) & (kSub - 1));
+}
+
+uint64_t LatencyHistogram::upperBound(size_t bucket)
+{
+    if (bucket < kSub)
+        return bucket;
+    unsigned shift = static_cast<unsigned>(bucket / kSub) - 1;
+    uint64_t lower = (kSub + bucket % kSub) << shift;
+    return lower + ((uint64_t{ 1 } << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    ++m_buckets[bucketOf(ns)];
+    ++m_count;
+    m_sum += ns;
+    m_min = std::min(m_min, ns);
+    m_max = std::max(m_max, ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < kBuckets; ++i)
+        m_buckets[i] += other.m_buckets[i];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const
+{
+    if (m_count == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(m_count)));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+            return std::min(upperBound(i), m_max);
+    }
+    return m_max;
+}
+
+std::string LatencyHistogram::toJson() const
+{
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    char buf[320];
+    std::snprintf(buf, sizeof buf,
+                  "{\"count\": %" PRIu64 ", \"mean\": %.1f, \"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+                  "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f,\n      \"histogram\": [",
+                  m_count, mean() / 1000.0, us(min()), us(percentile(0.50)), us(percentile(0.90)),
+                  us(percentile(0.99)), us(percentile(0.999)), us(m_max));
+    std::string out = buf;
+    const char *sep = "";
+    forEachBucket([&](uint64_t upperNs, uint64_t count) {
+        std::snprintf(buf, sizeof buf, "%s[%.1f, %" PRIu64 "]", sep, us(upperNs), count);
+        out += buf;
+        sep = ", ";
+    });
+    out += "]}";
+    return out;
+}
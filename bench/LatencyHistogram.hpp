@@ -0,0 +1,76 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Fixed-size log-linear histogram of latencies in nanoseconds.
+ *
+ * Every power of two is split into 32 linear sub-buckets, so a recorded
+ * value is off by at most ~3% and recording is a few bit operations with
+ * no allocation. One histogram per worker thread; merge() them at the end.
+ */
+class LatencyHistogram
+{
+  public:
+    void record(uint64_t ns);
+    void merge(const LatencyHistogram &other);
+
+    uint64_t count() const
+    {
+        return m_count;
+    }
+    uint64_t min() const
+    {
+        return m_count ? m_min : 0;
+    }
+    uint64_t max() const
+    {
+        return m_max;
+    }
+    double mean() const
+    {
+        return m_count ? static_cast<double>(m_sum) / static_cast<double>(m_count) : 0.0;
+    }
+
+    /**
+     * @brief Smallest bucket bound at or below which a fraction q of the
+     * values lie (q in [0, 1]); never above max().
+     */
+    uint64_t percentile(double q) const;
+
+    /** @brief Calls fn(upperBoundNs, count) for every non-empty bucket, in order. */
+    template <typename Fn> void forEachBucket(Fn &&fn) const
+    {
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            if (m_buckets[i] != 0)
+                fn(upperBound(i), m_buckets[i]);
+        }
+    }
+
+    /**
+     * @brief JSON object with count, mean, min, p50, p90, p99, p999 and max
+     * in microseconds, plus "histogram": [[upper_us, count], ...].
+     */
+    std::string toJson() const;
+
+  private:
+    static constexpr unsigned kSubBits = 5;
+    static constexpr size_t kSub = size_t{ 1 } << kSubBits;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t upperBound(size_t bucket);
+
+    std::array<uint64_t, kBuckets> m_buckets{};
+    uint64_t m_count{ 0 };
+    uint64_t m_sum{ 0 };
+    uint64_t m_min{ UINT64_MAX };
+    uint64_t m_max{ 0 };
+};
+
+#endif
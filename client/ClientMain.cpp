@@ -1,19 +1,29 @@
+#include "../common/Frame.hpp"
+#include "../common/Logger.hpp"
+#include "../common/Metrics.hpp"
 #include "../common/NetUtils.hpp"
 #include "../debug.hpp"
 #include "DME.hpp"
+#include "PeerMesh.hpp"
+#include "PostBatcher.hpp"
+#include "ServerSession.hpp"
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
 static void formatTimestamp(char *buf, size_t n)
 {
@@ -23,53 +33,203 @@ static void formatTimestamp(char *buf, size_t n)
     std::strftime(buf, n, "%d %b %I:%M %p", &tm);
 }
 
-static int connectPeerForever(const std::string &addr)
+// Parses "id@host:port[,id@host:port...]" and appends the entries to peers.
+static bool parsePeers(const std::string &spec, std::vector<DmePeer> &peers)
 {
-    const auto pos = addr.find(':');
-    const std::string host = addr.substr(0, pos);
-    const std::string port = addr.substr(pos + 1);
+    size_t start = 0;
+    while (start <= spec.size())
+    {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string entry = spec.substr(start, end - start);
+        size_t at = entry.find('@');
+        if (at == std::string::npos || at == 0 || at + 1 == entry.size())
+            return false;
+        peers.push_back(DmePeer{ std::atoi(entry.substr(0, at).c_str()), entry.substr(at + 1) });
+        start = end + 1;
+    }
+    return true;
+}
 
-    int fd = -1, attempt = 0;
-    while (true)
+// Newest sequence number this client has displayed; "view" asks only for
+// records after it.
+static std::atomic<uint64_t> g_lastSeenSeq{ 0 };
+
+// Newest sequence number the server assigned to one of this client's posts.
+static std::atomic<uint64_t> g_lastPostedSeq{ 0 };
+
+// Set by --compress-views: views ask for compressed history.
+static bool g_compressViews = false;
+
+// Raises seq to at least value.
+static void raiseTo(std::atomic<uint64_t> &seq, uint64_t value)
+{
+    uint64_t prev = seq.load();
+    while (prev < value && !seq.compare_exchange_weak(prev, value))
     {
-        fd = TcpConnect(host, port);
-        if (fd >= 0)
-        {
-            std::cout << Timestamp() << " [CLIENT] Connected to peer " << addr << " after " << attempt << " attempts."
-                      << std::endl;
-            return fd;
-        }
-        ++attempt;
-        std::cout << Timestamp() << " [CLIENT] Peer not ready, retrying in 2s... (attempt " << attempt << ")"
-                  << std::endl;
-        std::this_thread::sleep_for(std::chrono::seconds(2));
     }
 }
 
-static void peerAcceptLoop(int listenFd, DME *dme)
+static void printView(const ServerSession::Response &resp)
 {
-    while (true)
+    if (!resp.ok)
+    {
+        std::cerr << Timestamp() << " [CLIENT] Server error" << std::endl;
+        return;
+    }
+    for (const auto &line : resp.lines)
+        std::cout << Timestamp() << " [CLIENT] " << line << std::endl;
+
+    // A replica that is further behind than an earlier answer must not
+    // move the position back.
+    raiseTo(g_lastSeenSeq, resp.lastSeq);
+}
+
+// Prints the records of a compressed view block by block, while the rest
+// of the reply is still arriving.
+static void printRecords(const ServerSession::Response &chunk)
+{
+    for (const auto &line : chunk.lines)
+        std::cout << Timestamp() << " [CLIENT] " << line << std::endl;
+    raiseTo(g_lastSeenSeq, chunk.lastSeq);
+}
+
+// Maps the user's view command onto the server protocol:
+//   view        → records not seen yet (whole history the first time)
+//   view -a     → whole history
+//   view -n N   → newest N records
+static ServerSession::Request viewCommand(const std::string &input)
+{
+    if (input == "view -a")
+        return ServerSession::Request::view(ViewMode::All, 0, g_compressViews);
+    if (input.rfind("view -n", 0) == 0)
+        return ServerSession::Request::view(ViewMode::Last, std::strtoull(input.c_str() + 7, nullptr, 10),
+                                            g_compressViews);
+    return ServerSession::Request::view(ViewMode::Since, g_lastSeenSeq.load(), g_compressViews);
+}
+
+static void printPosted(const ServerSession::Response &resp)
+{
+    if (resp.ok)
+    {
+        raiseTo(g_lastPostedSeq, resp.lastSeq);
+        std::cout << Timestamp() << " [CLIENT] (posted";
+        if (resp.firstSeq != 0)
+            std::cout << " #" << resp.firstSeq;
+        if (resp.lastSeq != resp.firstSeq)
+            std::cout << "..#" << resp.lastSeq;
+        std::cout << ")" << std::endl;
+    }
+    else if (resp.status.empty())
+        std::cerr << Timestamp() << " [CLIENT] Server unreachable" << std::endl;
+    else if (resp.status == "ERR lock")
+        std::cerr << Timestamp() << " [CLIENT] Could not acquire lock (peer unresponsive)" << std::endl;
+    else
+        std::cerr << Timestamp() << " [CLIENT] POST failed" << std::endl;
+}
+
+/**
+ * @brief Sessions that serve views: one per --read-servers entry, or the
+ * primary's own session when there are none.
+ *
+ * Views go to the read servers in turn; one that cannot be reached is
+ * skipped, and the primary answers when none can. A view that fails on a
+ * replica, or whose answer does not yet include this client's newest
+ * post, is asked again of the primary, so a user always sees their own
+ * messages. Records a compressed view already printed are not asked for
+ * again.
+ */
+class ViewRouter
+{
+  public:
+    ViewRouter(ServerSession &primary, const std::vector<std::string> &readServers, ServerSession::Wire wire,
+               const std::string &room)
+        : m_primary(primary)
     {
-        int connFd = ::accept(listenFd, nullptr, nullptr);
-        if (connFd < 0)
-            continue;
+        for (const auto &addr : readServers)
+            m_readers.push_back(std::make_unique<ServerSession>(addr, wire, room));
+    }
 
-        std::string line;
-        while (RecvLine(connFd, line) > 0)
+    bool submit(const ServerSession::Request &request)
+    {
+        for (size_t tries = 0; tries < m_readers.size(); ++tries)
         {
-            std::cout << Timestamp() << " [CLIENT " << dme->getSelfId() << "] peer->me: " << line;
-            dme->handleRaMessage(line);
+            ServerSession &reader = *m_readers[m_next++ % m_readers.size()];
+            auto shownThrough = std::make_shared<uint64_t>(0);
+            bool sent = reader.submit(
+                request,
+                [this, request, shownThrough](const ServerSession::Response &resp) {
+                    if (!resp.ok || resp.lastSeq < g_lastPostedSeq.load())
+                    {
+                        auto rest = *shownThrough == 0
+                                        ? request
+                                        : ServerSession::Request::view(ViewMode::Since, *shownThrough, request.compress);
+                        if (m_primary.submit(rest, printView, printRecords))
+                            return;
+                    }
+                    printView(resp);
+                },
+                [shownThrough](const ServerSession::Response &chunk) {
+                    printRecords(chunk);
+                    *shownThrough = chunk.lastSeq;
+                });
+            if (sent)
+                return true;
         }
-        ::close(connFd);
+        return m_primary.submit(request, printView, printRecords);
     }
-}
 
-static void userInputLoop(const std::string &userName, const std::string &serverAddr, DME *dme)
+    // The live tail follows a read server too, when there is one.
+    ServerSession &tailSession()
+    {
+        return m_readers.empty() ? m_primary : *m_readers[m_next++ % m_readers.size()];
+    }
+
+  private:
+    ServerSession &m_primary;
+    std::vector<std::unique_ptr<ServerSession>> m_readers;
+    size_t m_next{ 0 };
+};
+
+// dme is null in --ordering server mode: the server's sequence numbers
+// order the posts and no distributed lock is taken.
+static void userInputLoop(const std::string &userName, const std::string &serverAddr,
+                          const std::vector<std::string> &readServers, DME *dme, size_t batchMax,
+                          ServerSession::Wire wire, const std::string &room, bool live)
 {
     std::cout << Timestamp() << " [CLIENT] Chat Room — DC Assignment II" << std::endl;
-    std::cout << Timestamp() << " [CLIENT] User: " << userName << " (self=" << dme->getSelfId()
-              << ", peer=" << dme->getPeerId() << ")" << std::endl;
-    std::cout << Timestamp() << " [CLIENT] Commands: view | post \"text\" | quit" << std::endl;
+    if (dme)
+    {
+        std::string peerIds;
+        for (const auto &peer : dme->getPeers())
+            peerIds += (peerIds.empty() ? "" : ",") + std::to_string(peer.id);
+        std::cout << Timestamp() << " [CLIENT] User: " << userName << " (self=" << dme->getSelfId()
+                  << ", peers=" << peerIds << ")" << std::endl;
+    }
+    else
+    {
+        std::cout << Timestamp() << " [CLIENT] User: " << userName << " (server-ordered posts)" << std::endl;
+    }
+    std::cout << Timestamp() << " [CLIENT] Commands: view [-a | -n N] | live | post \"text\" | stats | quit"
+              << std::endl;
+
+    // One keep-alive connection serves every post of this session; views
+    // may be spread over read replicas.
+    ServerSession session(serverAddr, wire, room);
+    ViewRouter views(session, readServers, wire, room);
+    // Posts go through the batcher's sender thread; declared after the
+    // session so queued posts are sent before the session shuts down.
+    PostBatcher poster(session, dme, batchMax, printPosted);
+
+    // Live tail: new records are pushed by the server and printed as they
+    // are committed, starting after the last record already shown.
+    auto startLive = [&views] {
+        if (!views.tailSession().subscribe(g_lastSeenSeq.load(), printView))
+            std::cerr << Timestamp() << " [CLIENT] Server unreachable" << std::endl;
+    };
+    if (live)
+        startLive();
 
     std::string input;
     while (true)
@@ -82,66 +242,33 @@ static void userInputLoop(const std::string &userName, const std::string &server
             break;
 
         // Handle VIEW command, user wants to see chat messages
-        // Supports "view"
-        if (input == "view" || input.rfind("view -n", 0) == 0)
+        // Supports "view", "view -a" and "view -n N". Views are pipelined:
+        // the prompt returns at once and the history is printed when the
+        // reply arrives. Posts queued before the view are sent first so the
+        // view includes them.
+        if (input == "view" || input == "view -a" || input.rfind("view -n", 0) == 0)
         {
-            int sfd = TcpConnectHostPort(serverAddr);
-            if (sfd < 0)
-            {
+            poster.drain();
+            if (!views.submit(viewCommand(input)))
                 std::cerr << Timestamp() << " [CLIENT] Server unreachable" << std::endl;
-                continue;
-            }
-
-            // Send VIEW command to server and print response lines
-            // until "." line is received
-            SendLine(sfd, input == "view" ? "VIEW" : input);
-            std::string header;
-            if (RecvLine(sfd, header) <= 0 || header.rfind("OK", 0) != 0)
-            {
-                std::cerr << Timestamp() << " [CLIENT] Server error" << std::endl;
-                ::close(sfd);
-                continue;
-            }
-
-            std::string line;
-            while (RecvLine(sfd, line) > 0)
-            {
-                if (line == ".\n" || line == ".\r\n")
-                    break;
-                std::cout << Timestamp() << " [CLIENT] " << line;
-            }
-            ::close(sfd);
+        }
+        else if (input == "live")
+        {
+            startLive();
+        }
+        else if (input == "stats")
+        {
+            // This client's own metrics; the server's are behind its STATS command.
+            std::cout << MetricsRegistry::instance().render() << std::flush;
         }
         else if (input.rfind("post ", 0) == 0)
         {
-            if (!dme->requestCriticalSection())
-            {
-                std::cerr << Timestamp() << " [CLIENT] Could not acquire lock (peer unresponsive)" << std::endl;
-                continue;
-            }
-
-            int sfd = TcpConnectHostPort(serverAddr);
-            if (sfd < 0)
-            {
-                std::cerr << Timestamp() << " [CLIENT] Server unreachable" << std::endl;
-                dme->releaseCriticalSection();
-                continue;
-            }
-
             char ts[64];
             formatTimestamp(ts, sizeof ts);
-            std::string text = input.substr(5);
-            std::string payload = std::string("POST ") + ts + " " + userName + ": " + text;
-            SendLine(sfd, payload);
-
-            std::string resp;
-            if (RecvLine(sfd, resp) > 0 && resp.rfind("OK", 0) == 0)
-                std::cout << Timestamp() << " [CLIENT] (posted)" << std::endl;
-            else
-                std::cerr << Timestamp() << " [CLIENT] POST failed" << std::endl;
-
-            ::close(sfd);
-            dme->releaseCriticalSection();
+            std::string_view text = std::string_view(input).substr(5);
+            std::string record = std::string(ts) + " " + userName + ": ";
+            record.append(text);
+            poster.enqueue(std::move(record));
         }
     }
 }
@@ -152,8 +279,19 @@ int main(int argc, char **argv)
     int selfId = 1;
     int peerId = 2;
     std::string peerAddr;
+    std::vector<DmePeer> peers;
+    DME::Algorithm algorithm = DME::Algorithm::RicartAgrawala;
+    bool serverOrdering = false;
+    size_t batchMax = 64;
+    ServerSession::Wire wire = ServerSession::Wire::Text;
+    bool live = false;
+    std::string room;
     std::string serverAddr;
+    std::vector<std::string> readServers;
     std::string listenAddr;
+    std::string metricsListen;
+    std::string metricsFile;
+    int metricsIntervalS = 10;
 
     for (int i = 1; i < argc; ++i)
     {
@@ -165,30 +303,151 @@ int main(int argc, char **argv)
             peerId = std::atoi(argv[++i]);
         else if (!strcmp(argv[i], "--peer") && i + 1 < argc)
             peerAddr = argv[++i];
+        else if (!strcmp(argv[i], "--peers") && i + 1 < argc)
+        {
+            if (!parsePeers(argv[++i], peers))
+            {
+                LOG_ERROR("[CLIENT] --peers expects id@host:port[,id@host:port...]");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--mutex") && i + 1 < argc)
+        {
+            if (!DME::parseAlgorithm(argv[++i], algorithm))
+            {
+                LOG_ERROR("[CLIENT] --mutex must be ra or token");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--ordering") && i + 1 < argc)
+        {
+            ++i;
+            if (!strcmp(argv[i], "server") || !strcmp(argv[i], "dme"))
+            {
+                serverOrdering = !strcmp(argv[i], "server");
+            }
+            else
+            {
+                LOG_ERROR("[CLIENT] --ordering must be dme or server");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--batch-max") && i + 1 < argc)
+            batchMax = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--wire") && i + 1 < argc)
+        {
+            ++i;
+            if (!strcmp(argv[i], "text") || !strcmp(argv[i], "binary"))
+            {
+                wire = !strcmp(argv[i], "binary") ? ServerSession::Wire::Binary : ServerSession::Wire::Text;
+            }
+            else
+            {
+                LOG_ERROR("[CLIENT] --wire must be text or binary");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--room") && i + 1 < argc)
+        {
+            room = argv[++i];
+            if (room.empty() || room.size() > 64 ||
+                room.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") !=
+                    std::string::npos)
+            {
+                LOG_ERROR("[CLIENT] --room must be 1-64 letters, digits, '_' or '-'");
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--live"))
+            live = true;
+        else if (!strcmp(argv[i], "--compress-views"))
+            g_compressViews = true;
         else if (!strcmp(argv[i], "--server") && i + 1 < argc)
             serverAddr = argv[++i];
+        else if (!strcmp(argv[i], "--read-servers") && i + 1 < argc)
+        {
+            std::string list = argv[++i];
+            for (size_t start = 0; start <= list.size();)
+            {
+                size_t end = std::min(list.find(',', start), list.size());
+                if (end > start)
+                    readServers.push_back(list.substr(start, end - start));
+                start = end + 1;
+            }
+        }
         else if (!strcmp(argv[i], "--listen") && i + 1 < argc)
             listenAddr = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-listen") && i + 1 < argc)
+            metricsListen = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc)
+            metricsFile = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-interval") && i + 1 < argc)
+            metricsIntervalS = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-level") && i + 1 < argc)
+        {
+            LogLevel level;
+            if (!Logger::parseLevel(argv[++i], level))
+            {
+                LOG_ERROR("[CLIENT] --log-level must be trace, debug, info, warn, error or off");
+                return 1;
+            }
+            Logger::instance().setLevel(level);
+        }
+        else if (!strcmp(argv[i], "--log-overflow") && i + 1 < argc)
+        {
+            Logger::Overflow policy;
+            if (!Logger::parseOverflow(argv[++i], policy))
+            {
+                LOG_ERROR("[CLIENT] --log-overflow must be drop or block");
+                return 1;
+            }
+            Logger::instance().setOverflow(policy);
+        }
     }
 
     char prefix[32];
     std::snprintf(prefix, sizeof prefix, "client-%d", selfId);
 
+    if (!StartMetricsExporter(metricsListen, metricsFile, metricsIntervalS))
+        return 1;
+
+    if (serverOrdering)
+    {
+        userInputLoop(userName, serverAddr, readServers, nullptr, batchMax, wire, room, live);
+        return 0;
+    }
+
     int listenFd = TcpListen(listenAddr);
     if (listenFd < 0)
     {
-        std::cerr << Timestamp() << " [CLIENT] ERROR: listen peer failed" << std::endl;
+        LOG_ERROR("[CLIENT] listen peer failed");
         return 1;
     }
 
-    int peerFd = connectPeerForever(peerAddr);
-    if (peerFd < 0)
+    // The two-node form "--peer-id N --peer host:port" is one membership entry.
+    if (!peerAddr.empty())
+        peers.push_back(DmePeer{ peerId, peerAddr });
+    if (peers.empty())
+    {
+        LOG_ERROR("[CLIENT] no peers given (--peers id@host:port,...)");
+        return 1;
+    }
+    if (peers.size() >= DmeMessage::kMaxMembers)
+    {
+        LOG_ERROR("[CLIENT] at most " << DmeMessage::kMaxMembers - 1 << " peers are supported");
         return 1;
+    }
 
-    DME dme(selfId, peerId, peerFd);
+    // Peer links come up in the background; messages for a peer that is
+    // not linked yet wait in the mesh, so the user loop starts at once.
+    auto mesh = std::make_shared<PeerMesh>(selfId, peers, wire == ServerSession::Wire::Binary);
+    std::unique_ptr<DME> dme = DME::create(algorithm, selfId, std::move(peers), mesh);
+    mesh->start(listenFd, dme.get());
 
-    std::thread tPeer(peerAcceptLoop, listenFd, &dme);
-    std::thread tUser(userInputLoop, userName, serverAddr, &dme);
+    std::thread tUser(userInputLoop, userName, serverAddr, std::cref(readServers), dme.get(), batchMax, wire, room,
+                      live);
     tUser.join();
+    // The mesh's readers deliver to the DME: stop them before it goes.
+    mesh->stop();
     return 0;
 }
@@ -1,149 +1,96 @@
 #include "DME.hpp"
-#include "../common/NetUtils.hpp"
-#include "../debug.hpp"
+#include "RicartAgrawala.hpp"
+#include "SuzukiKasami.hpp"
+#include "../common/Metrics.hpp"
 
-#include <algorithm>
-#include <chrono>
-#include <iostream>
-#include <sstream>
-#include <thread>
+#include <cassert>
 
-DME::DME(int selfId, int peerId, int peerFd) : m_selfId(selfId), m_peerId(peerId), m_peerFd(peerFd)
+namespace
 {
+MetricHistogram g_dmeWait("dme_wait_seconds", "Time from requesting the critical section to entering it");
+MetricCounter g_dmeTimeouts("dme_timeouts_total", "Critical-section requests that timed out");
+MetricCounter g_dmeDeferred("dme_deferred_replies_total", "REPLYs deferred until the critical section was left");
+MetricCounter g_dmeSent("dme_messages_sent_total", "DME messages sent to peers");
+MetricCounter g_dmeReceived("dme_messages_received_total", "DME messages received from peers");
+} // namespace
+
+DME::DME(int selfId, std::vector<DmePeer> peers, std::shared_ptr<DmeTransport> transport)
+    : m_selfId(selfId), m_peers(std::move(peers)), m_transport(std::move(transport))
+{
+    assert(m_transport && "a DME needs a transport to reach its peers");
 }
 
 /**
- * @brief Send a Ricart–Agrawala message to the peer.
- * Ensures each line ends with '\n' so the peer’s RecvLine() returns correctly.
+ * @brief Instantiate the selected mutual-exclusion algorithm.
  */
-void DME::sendLine(const std::string &line)
+std::unique_ptr<DME> DME::create(Algorithm algorithm, int selfId, std::vector<DmePeer> peers,
+                                 std::shared_ptr<DmeTransport> transport)
 {
-    std::string out = line;
-    if (out.empty() || out.back() != '\n')
-        out.push_back('\n');
-
-    SendAll(m_peerFd, out.c_str(), out.size());
-    std::cout << Timestamp() << " [DME][RA] Sent message: " << out.c_str() << std::endl;
+    if (algorithm == Algorithm::Token)
+        return std::make_unique<SuzukiKasami>(selfId, std::move(peers), std::move(transport));
+    return std::make_unique<RicartAgrawala>(selfId, std::move(peers), std::move(transport));
 }
 
-/**
- * @brief Handle incoming Ricart–Agrawala messages.
- * Supports REQUEST, REPLY, and RELEASE message types.
- */
-void DME::handleRaMessage(const std::string &msg)
+bool DME::parseAlgorithm(std::string_view name, Algorithm &algorithm)
 {
-    std::istringstream iss(msg);
-    std::string type;
-    iss >> type;
-
-    std::unique_lock<std::mutex> lk(m_mutex);
-
-    std::cout << Timestamp() << " [DME] Message Received : " << msg << std::endl;
-    std::cout << Timestamp() << " [DME] Extracted Type: " << type << std::endl;
+    if (name == "ra")
+        algorithm = Algorithm::RicartAgrawala;
+    else if (name == "token")
+        algorithm = Algorithm::Token;
+    else
+        return false;
+    return true;
+}
 
-    // ----------------------------------------------------------
-    // Handle REQUEST message
-    // ----------------------------------------------------------
-    if (type == "REQUEST")
+int DME::indexOf(int peerId) const
+{
+    for (size_t i = 0; i < m_peers.size(); ++i)
     {
-        int t, fromId;
-        iss >> t >> fromId;
-        std::cout << Timestamp() << " [DME] Extracted timestamp from message: " << t
-                  << ", extracted peer Node Id: " << fromId << std::endl;
-        m_lamportTs = std::max(m_lamportTs, t) + 1;
-        std::cout << Timestamp() << " [DME] Calculated Lamport timestamp to: " << m_lamportTs << std::endl;
-
-        std::cout << Timestamp() << " [DME][IN] Received REQUEST for Critical Section from Node: " << fromId
-                  << " with Lamport ts=" << t << ")" << std::endl;
-
-        std::cout << Timestamp() << " [DME] Current State - InCS: " << m_inCriticalSection
-                  << ", Requesting: " << m_requesting << ", ReqTs: " << m_reqTs << std::endl;
-
-        if (m_inCriticalSection || (m_requesting && (m_reqTs < t || (m_reqTs == t && m_selfId < fromId))))
-        {
-            m_deferReply = true;
-            std::cout << Timestamp() << " [DME][RA] REQUEST from:" << fromId << " ts=" << t
-                      << " deferred — currently in CS or has higher priority" << std::endl;
-        }
-        else
-        {
-            sendLine("REPLY " + std::to_string(m_selfId));
-            std::cout << Timestamp() << " [DME][RA][OUT] REQUEST from peer node " << fromId << " (timestamp=" << t
-                      << ") accepted — sent REPLY (permission granted)" << std::endl;
-        }
+        if (m_peers[i].id == peerId)
+            return static_cast<int>(i);
     }
+    return -1;
+}
+
+void DME::sendTo(size_t idx, const DmeMessage &msg)
+{
+    m_outbox.push_back(Outgoing{ idx, msg });
+}
 
-    // ----------------------------------------------------------
-    // Handle REPLY message
-    // ----------------------------------------------------------
-    else if (type == "REPLY")
+/**
+ * @brief Hand every queued message to the transport, outside m_mutex.
+ * Whoever holds m_sendMutex takes the whole outbox, in queue order, so
+ * concurrent flushes cannot reorder the messages to a peer.
+ */
+void DME::flushOutbox()
+{
+    std::lock_guard<std::mutex> sending(m_sendMutex);
     {
-        int fromId;
-        iss >> fromId;
-        m_peerReplied = true;
-        std::cout << Timestamp() << " [DME][RA] Received REPLY (permission granted) from peer " << fromId << std::endl;
-        m_cv.notify_all();
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_sending.swap(m_outbox);
     }
-
-    // ----------------------------------------------------------
-    // Handle RELEASE message
-    // ----------------------------------------------------------
-    else if (type == "RELEASE")
+    for (const Outgoing &out : m_sending)
     {
-        int fromId;
-        iss >> fromId;
-        std::cout << Timestamp() << " [DME][RA] Received RELEASE from " << fromId << " — peer exited CS" << std::endl;
-
-        if (m_deferReply)
-        {
-            sendLine("REPLY " + std::to_string(m_selfId));
-            m_deferReply = false;
-            std::cout << Timestamp() << " [DME][RA] Sent deferred REPLY to " << fromId << " after receiving RELEASE"
-                      << std::endl;
-        }
+        g_dmeSent.add();
+        m_transport->send(m_peers[out.idx], out.msg);
     }
+    m_sending.clear();
 }
 
-bool DME::requestCriticalSection()
+void DME::noteReceived()
 {
-    std::unique_lock<std::mutex> lk(m_mutex);
-
-    m_requesting = true;
-    m_inCriticalSection = false;
-    m_peerReplied = false;
-
-    m_lamportTs++;
-    m_reqTs = m_lamportTs;
-
-    sendLine("REQUEST " + std::to_string(m_reqTs) + " " + std::to_string(m_selfId));
-    std::cout << Timestamp() << " [DME][RA] REQUEST sent to peer ID: " << m_peerId << " request ID:" << m_reqTs
-              << std::endl;
-
-    while (!m_peerReplied)
-    {
-        if (m_cv.wait_for(lk, std::chrono::seconds(10)) == std::cv_status::timeout)
-        {
-            std::cerr << Timestamp() << " [DME][RA] TIMEOUT waiting for REPLY from peer " << m_peerId << std::endl;
-            m_requesting = false;
-            return false;
-        }
-    }
-
-    m_requesting = false;
-    m_inCriticalSection = true;
-    std::cout << Timestamp() << " [DME][RA] ENTER critical section (permission received)" << std::endl;
-    return true;
+    g_dmeReceived.add();
 }
 
-void DME::releaseCriticalSection()
+void DME::noteRequest(std::chrono::steady_clock::time_point asked, bool granted)
 {
-    std::lock_guard<std::mutex> lk(m_mutex);
-    if (!m_inCriticalSection)
-        return;
-
-    m_inCriticalSection = false;
-    m_lamportTs++;
+    if (granted)
+        g_dmeWait.observeSince(asked);
+    else
+        g_dmeTimeouts.add();
+}
 
-    sendLine("RELEASE " + std::to_string(m_selfId));
-    std::cout << Timestamp() << " [DME][RA] RELEASE sent — leaving critical section" << std::endl;
+void DME::noteDeferredReply()
+{
+    g_dmeDeferred.add();
 }
@@ -1,48 +1,108 @@
 #ifndef DME_HPP
 #define DME_HPP
 
+#include "DmeMessage.hpp"
+#include "DmeTransport.hpp"
+
+#include <chrono>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief One other participant of the mutual-exclusion group.
+ */
+struct DmePeer
+{
+    int id;           // node id used in DME messages
+    std::string addr; // host:port of the peer's --listen socket
+};
 
 /**
- * @brief Implements the Ricart–Agrawala Distributed Mutual Exclusion (DME)
- *        algorithm for two-node coordination.
+ * @brief Distributed Mutual Exclusion (DME) strategy interface.
+ *
+ * Owns the membership list and the transport to the peers; concrete
+ * algorithms (Ricart–Agrawala, Suzuki–Kasami) implement the protocol.
+ * Every member of a group must run the same algorithm.
  */
 class DME
 {
   public:
-    DME(int selfId, int peerId, int peerFd);
+    enum class Algorithm
+    {
+        RicartAgrawala, // --mutex ra: request/reply round with every peer per entry
+        Token           // --mutex token: Suzuki–Kasami, the token holder re-enters for free
+    };
+
+    // Messages to the peers go out through transport, which must be set
+    // (the client's PeerMesh, or the simulator's channels).
+    static std::unique_ptr<DME> create(Algorithm algorithm, int selfId, std::vector<DmePeer> peers,
+                                       std::shared_ptr<DmeTransport> transport);
+
+    // Parses "ra" / "token".
+    static bool parseAlgorithm(std::string_view name, Algorithm &algorithm);
 
-    bool requestCriticalSection(); // Request critical section
-    void releaseCriticalSection(); // Release critical section
-    void handleRaMessage(const std::string &line);
+    virtual ~DME() = default;
+
+    virtual bool requestCriticalSection() = 0; // Request critical section
+    virtual void releaseCriticalSection() = 0; // Release critical section
+    virtual void handleMessage(const DmeMessage &msg) = 0;
+
+    // How long requestCriticalSection() waits before giving up (default 10 s).
+    void setTimeout(std::chrono::milliseconds timeout)
+    {
+        m_timeout = timeout;
+    }
 
     int getSelfId() const
     {
         return m_selfId;
     }
-    int getPeerId() const
+    const std::vector<DmePeer> &getPeers() const
     {
-        return m_peerId;
+        return m_peers;
     }
 
-  private:
-    void sendLine(const std::string &line);
+  protected:
+    DME(int selfId, std::vector<DmePeer> peers, std::shared_ptr<DmeTransport> transport);
+
+    int indexOf(int peerId) const;
+
+    // Queues a message for peer idx; called with m_mutex held. Nothing is
+    // sent until flushOutbox(), which callers run after unlocking, so no
+    // socket write happens under m_mutex.
+    void sendTo(size_t idx, const DmeMessage &msg);
+    void flushOutbox();
+
+    // Metrics: a message handed to handleMessage(), a requestCriticalSection()
+    // that started at `asked`, a REPLY held back until we leave the CS.
+    static void noteReceived();
+    static void noteRequest(std::chrono::steady_clock::time_point asked, bool granted);
+    static void noteDeferredReply();
 
     std::mutex m_mutex;
     std::condition_variable m_cv;
 
     const int m_selfId;
-    const int m_peerId;
-    const int m_peerFd;
-
-    int m_lamportTs{ 0 };
-    int m_reqTs{ 0 };
-    bool m_requesting{ false };
-    bool m_inCriticalSection{ false };
-    bool m_peerReplied{ false };
-    bool m_deferReply{ false };
+    const std::vector<DmePeer> m_peers;
+    const std::shared_ptr<DmeTransport> m_transport;
+    std::chrono::milliseconds m_timeout{ std::chrono::seconds(10) };
+
+  private:
+    struct Outgoing
+    {
+        size_t idx;
+        DmeMessage msg;
+    };
+
+    std::vector<Outgoing> m_outbox; // guarded by m_mutex
+    // Held while sending, so messages leave in the order they were queued.
+    // The two vectors trade places on every flush and keep their capacity.
+    std::mutex m_sendMutex;
+    std::vector<Outgoing> m_sending;
 };
 
 #endif
@@ -0,0 +1,231 @@
+#include "DmeMessage.hpp"
+#include "../common/Frame.hpp"
+
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+char *PutText(char *out, std::string_view text)
+{
+    std::memcpy(out, text.data(), text.size());
+    return out + text.size();
+}
+
+// " <n>": the word separator and the number.
+char *PutInt(char *out, int n)
+{
+    *out++ = ' ';
+    return std::to_chars(out, out + 11, n).ptr;
+}
+
+char *PutWord(char *out, uint32_t v)
+{
+    out[0] = static_cast<char>(v >> 24);
+    out[1] = static_cast<char>(v >> 16);
+    out[2] = static_cast<char>(v >> 8);
+    out[3] = static_cast<char>(v);
+    return out + 4;
+}
+
+/**
+ * @brief Cursor over a space-separated line; every read skips the
+ * blanks before its word and fails on anything that is not a number.
+ */
+class Words
+{
+  public:
+    explicit Words(std::string_view line) : m_rest(line)
+    {
+    }
+
+    std::string_view word()
+    {
+        skipBlanks();
+        size_t end = 0;
+        while (end < m_rest.size() && m_rest[end] != ' ' && m_rest[end] != '\t')
+            ++end;
+        std::string_view w = m_rest.substr(0, end);
+        m_rest.remove_prefix(end);
+        return w;
+    }
+
+    bool number(int &n)
+    {
+        skipBlanks();
+        auto [ptr, ec] = std::from_chars(m_rest.data(), m_rest.data() + m_rest.size(), n);
+        if (ec != std::errc() || (ptr != m_rest.data() + m_rest.size() && *ptr != ' ' && *ptr != '\t'))
+            return false;
+        m_rest.remove_prefix(static_cast<size_t>(ptr - m_rest.data()));
+        return true;
+    }
+
+    // Reads a count and then that many numbers into list (cleared first).
+    bool list(std::vector<int> &list)
+    {
+        int count = 0;
+        if (!number(count) || count < 0 || static_cast<size_t>(count) > DmeMessage::kMaxMembers)
+            return false;
+        list.resize(static_cast<size_t>(count));
+        for (int &n : list)
+        {
+            if (!number(n))
+                return false;
+        }
+        return true;
+    }
+
+    bool atEnd()
+    {
+        skipBlanks();
+        return m_rest.empty();
+    }
+
+  private:
+    void skipBlanks()
+    {
+        while (!m_rest.empty() && (m_rest[0] == ' ' || m_rest[0] == '\t'))
+            m_rest.remove_prefix(1);
+    }
+
+    std::string_view m_rest;
+};
+} // namespace
+
+size_t DmeMessage::writeText(char *out) const
+{
+    char *p = out;
+    switch (type)
+    {
+    case Type::Request:
+        p = PutInt(PutText(p, "REQUEST"), value);
+        p = PutInt(p, from);
+        break;
+    case Type::Reply:
+        p = PutInt(PutText(p, "REPLY"), from);
+        p = PutInt(p, value);
+        break;
+    case Type::Release:
+        p = PutInt(PutText(p, "RELEASE"), from);
+        break;
+    case Type::TokenRequest:
+        p = PutInt(PutText(p, "TREQ"), from);
+        p = PutInt(p, value);
+        break;
+    case Type::Token:
+        p = PutInt(PutText(p, "TOKEN"), from);
+        p = PutInt(p, static_cast<int>(ln.size()));
+        for (int n : ln)
+            p = PutInt(p, n);
+        p = PutInt(p, static_cast<int>(queue.size()));
+        for (int id : queue)
+            p = PutInt(p, id);
+        break;
+    }
+    return static_cast<size_t>(p - out);
+}
+
+size_t DmeMessage::writePayload(char *out) const
+{
+    char *p = PutWord(out, static_cast<uint32_t>(from));
+    p = PutWord(p, static_cast<uint32_t>(value));
+    if (type == Type::Token)
+    {
+        p = PutWord(p, static_cast<uint32_t>(ln.size()));
+        for (int n : ln)
+            p = PutWord(p, static_cast<uint32_t>(n));
+        p = PutWord(p, static_cast<uint32_t>(queue.size()));
+        for (int id : queue)
+            p = PutWord(p, static_cast<uint32_t>(id));
+    }
+    return static_cast<size_t>(p - out);
+}
+
+std::string DmeMessage::toText() const
+{
+    char buf[kMaxWire];
+    return std::string(buf, writeText(buf));
+}
+
+std::string DmeMessage::toPayload() const
+{
+    char buf[kMaxWire];
+    return std::string(buf, writePayload(buf));
+}
+
+/**
+ * @brief Parses one text line. msg is overwritten field by field, so the
+ * TOKEN lists of a message reused across calls keep their capacity.
+ */
+bool DmeMessage::parseText(std::string_view line, DmeMessage &msg)
+{
+    Words words(line);
+    std::string_view type = words.word();
+
+    msg.from = msg.value = 0;
+    msg.ln.clear();
+    msg.queue.clear();
+    bool ok;
+    if (type == "REQUEST")
+    {
+        msg.type = Type::Request;
+        ok = words.number(msg.value) && words.number(msg.from);
+    }
+    else if (type == "REPLY")
+    {
+        // The timestamp is optional for compatibility with older peers.
+        msg.type = Type::Reply;
+        ok = words.number(msg.from) && (words.atEnd() || words.number(msg.value));
+    }
+    else if (type == "RELEASE")
+    {
+        msg.type = Type::Release;
+        ok = words.number(msg.from);
+    }
+    else if (type == "TREQ")
+    {
+        msg.type = Type::TokenRequest;
+        ok = words.number(msg.from) && words.number(msg.value);
+    }
+    else if (type == "TOKEN")
+    {
+        msg.type = Type::Token;
+        ok = words.number(msg.from) && words.list(msg.ln) && words.list(msg.queue);
+    }
+    else
+    {
+        return false;
+    }
+    return ok;
+}
+
+bool DmeMessage::parsePayload(uint16_t type, std::string_view payload, DmeMessage &msg)
+{
+    if (type < static_cast<uint16_t>(Type::Request) || type > static_cast<uint16_t>(Type::Token) ||
+        payload.size() < 8)
+        return false;
+
+    msg.type = static_cast<Type>(type);
+    msg.from = static_cast<int>(GetU32(payload.data()));
+    msg.value = static_cast<int>(GetU32(payload.data() + 4));
+    msg.ln.clear();
+    msg.queue.clear();
+    payload.remove_prefix(8);
+    if (msg.type != Type::Token)
+        return payload.empty();
+
+    for (auto *list : { &msg.ln, &msg.queue })
+    {
+        if (payload.size() < 4)
+            return false;
+        size_t count = GetU32(payload.data());
+        payload.remove_prefix(4);
+        if (count > kMaxMembers || payload.size() < count * 4)
+            return false;
+        list->resize(count);
+        for (size_t i = 0; i < count; ++i)
+            (*list)[i] = static_cast<int>(GetU32(payload.data() + 4 * i));
+        payload.remove_prefix(count * 4);
+    }
+    return payload.empty();
+}
@@ -0,0 +1,61 @@
+#ifndef DME_MESSAGE_HPP
+#define DME_MESSAGE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief One peer-to-peer DME message, independent of its wire encoding.
+ *
+ * Text form (one line each, the original protocol):
+ *   REQUEST <ts> <from>             Ricart–Agrawala request
+ *   REPLY <from> <ts>               permission for the request with timestamp ts
+ *   RELEASE <from>                  informational
+ *   TREQ <from> <n>                 Suzuki–Kasami token request number n
+ *   TOKEN <from> <k> <ln>×k <q> <id>×q
+ *
+ * Binary form: a FrameOp::Dme frame whose flags hold the type and whose
+ * payload is big-endian u32 words: from, value, then for TOKEN k, LN×k,
+ * q, queue×q.
+ *
+ * The codec does not allocate: encoding writes into a caller's buffer
+ * (kMaxWire bytes always suffice) with std::to_chars, parsing walks the
+ * input with std::from_chars, and parsing into a reused message keeps
+ * the capacity of its TOKEN lists.
+ */
+struct DmeMessage
+{
+    enum class Type : uint16_t
+    {
+        Request = 1,
+        Reply = 2,
+        Release = 3,
+        TokenRequest = 4,
+        Token = 5
+    };
+
+    // Largest group a TOKEN may describe, and the encoded size bound that follows.
+    static constexpr size_t kMaxMembers = 256;
+    static constexpr size_t kMaxWire = 16 + 12 * (4 + 2 * kMaxMembers);
+
+    Type type{ Type::Request };
+    int from{ 0 };
+    int value{ 0 };         // REQUEST/REPLY: Lamport timestamp; TREQ: request number
+    std::vector<int> ln;    // TOKEN: last request number served per member
+    std::vector<int> queue; // TOKEN: members waiting for the token
+
+    // Encode into out (at least kMaxWire bytes); return the length, without a newline.
+    size_t writeText(char *out) const;
+    size_t writePayload(char *out) const;
+
+    // Allocating conveniences, for logging.
+    std::string toText() const;
+    std::string toPayload() const;
+
+    static bool parseText(std::string_view line, DmeMessage &msg);
+    static bool parsePayload(uint16_t type, std::string_view payload, DmeMessage &msg);
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef DME_TRANSPORT_HPP
+#define DME_TRANSPORT_HPP
+
+#include "DmeMessage.hpp"
+
+struct DmePeer;
+
+/**
+ * @brief How a DME instance gets its messages to the other members.
+ *
+ * DME algorithms only decide what to send to whom; the transport moves
+ * the message. The client sends over its PeerMesh links; the
+ * simulator (bench/DmeSim.cpp) delivers through in-memory channels with
+ * injected delay, reordering and loss. Incoming messages take the other
+ * direction through DME::handleMessage(), whatever the transport.
+ */
+class DmeTransport
+{
+  public:
+    virtual ~DmeTransport() = default;
+
+    // Called without the DME's mutex held (sending may block), one call
+    // at a time per DME and in the order the algorithm produced the
+    // messages. Must not call back into the sending DME.
+    virtual void send(const DmePeer &peer, const DmeMessage &msg) = 0;
+};
+
+#endif
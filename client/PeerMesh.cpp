@@ -0,0 +1,477 @@
+#include "PeerMesh.hpp"
+#include "DME.hpp"
+#include "../common/Frame.hpp"
+#include "../common/LineReader.hpp"
+#include "../common/Logger.hpp"
+#include "../common/Metrics.hpp"
+#include "../common/NetUtils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <random>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+MetricGauge g_peerLinks("dme_peer_links", "Peers with an established DME link");
+MetricCounter g_peerDials("dme_peer_dials_total", "Outbound peer connection attempts");
+MetricCounter g_peerDropped("dme_peer_dropped_total", "DME messages dropped while a peer stayed unreachable");
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::chrono::milliseconds kConnectTimeout{ 2000 };
+constexpr std::chrono::milliseconds kFirstBackoff{ 100 };
+constexpr std::chrono::milliseconds kMaxBackoff{ 5000 };
+} // namespace
+
+PeerMesh::PeerMesh(int selfId, const std::vector<DmePeer> &peers, bool binary) : m_selfId(selfId), m_binary(binary)
+{
+    for (const auto &peer : peers)
+    {
+        m_links.push_back(std::make_unique<Link>());
+        m_links.back()->id = peer.id;
+        m_links.back()->addr = peer.addr;
+    }
+    m_wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+PeerMesh::~PeerMesh()
+{
+    stop();
+    ::close(m_wakeFd);
+}
+
+void PeerMesh::start(int listenFd, DME *dme)
+{
+    m_dme = dme;
+    m_listenFd = listenFd;
+    m_acceptor = std::thread(&PeerMesh::acceptLoop, this, listenFd);
+    m_dialler = std::thread(&PeerMesh::dialLoop, this);
+}
+
+/**
+ * @brief Shuts the mesh down in dependency order: first the threads that
+ * create connections, then the connections, then their readers.
+ */
+void PeerMesh::stop()
+{
+    if (m_stop.exchange(true))
+        return;
+
+    // shutdown() wakes a thread blocked in accept(); the dialler polls the eventfd.
+    if (m_listenFd >= 0)
+        ::shutdown(m_listenFd, SHUT_RDWR);
+    wake();
+    if (m_acceptor.joinable())
+        m_acceptor.join();
+    if (m_dialler.joinable())
+        m_dialler.join();
+    if (m_listenFd >= 0)
+        ::close(m_listenFd);
+
+    // No connection can appear now. Each reader sees EOF and retires its fd.
+    std::unordered_map<std::thread::id, std::thread> readers;
+    {
+        std::lock_guard<std::mutex> lk(m_readersMutex);
+        for (int fd : m_readerFds)
+            ::shutdown(fd, SHUT_RDWR);
+        readers.swap(m_readers);
+        m_finished.clear();
+    }
+    for (auto &reader : readers)
+        reader.second.join();
+}
+
+/**
+ * @brief Runs body on a new reader thread for connection fd. The fd is
+ * registered first, so stop() can shut it down while body blocks on it.
+ */
+void PeerMesh::startReader(int fd, std::function<void()> body)
+{
+    std::lock_guard<std::mutex> lk(m_readersMutex);
+    for (std::thread::id id : m_finished)
+    {
+        auto it = m_readers.find(id);
+        it->second.join();
+        m_readers.erase(it);
+    }
+    m_finished.clear();
+
+    m_readerFds.insert(fd);
+    std::thread reader([this, body = std::move(body)] {
+        body();
+        std::lock_guard<std::mutex> done(m_readersMutex);
+        m_finished.push_back(std::this_thread::get_id());
+    });
+    m_readers.emplace(reader.get_id(), std::move(reader));
+}
+
+// Closes a reader's fd; unregistered first so stop() never shuts down a
+// reused descriptor number.
+void PeerMesh::forget(int fd)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_readersMutex);
+        m_readerFds.erase(fd);
+    }
+    ::close(fd);
+}
+
+PeerMesh::Link *PeerMesh::find(int id) const
+{
+    for (const auto &link : m_links)
+    {
+        if (link->id == id)
+            return link.get();
+    }
+    return nullptr;
+}
+
+bool PeerMesh::linked(Link &link)
+{
+    std::lock_guard<std::mutex> lk(link.mutex);
+    return link.fd >= 0;
+}
+
+void PeerMesh::wake()
+{
+    uint64_t one = 1;
+    ssize_t n = ::write(m_wakeFd, &one, sizeof one);
+    (void)n;
+}
+
+size_t PeerMesh::encode(const DmeMessage &msg, bool binary, char *out)
+{
+    if (binary)
+    {
+        size_t payload = msg.writePayload(out + kFrameHeaderSize);
+        EncodeFrameHeader(FrameHeader{ kFrameVersion, FrameOp::Dme, static_cast<uint16_t>(msg.type), 0,
+                                       static_cast<uint32_t>(payload) },
+                          out);
+        return kFrameHeaderSize + payload;
+    }
+    size_t len = msg.writeText(out);
+    out[len++] = '\n';
+    return len;
+}
+
+/**
+ * @brief Writes the message on the peer's link, or queues it until the
+ * link is back. A failed write shuts the link down; its reader then
+ * retires it and the dialler reconnects.
+ */
+void PeerMesh::send(const DmePeer &peer, const DmeMessage &msg)
+{
+    Link *link = find(peer.id);
+    if (!link)
+        return;
+    char buf[kMaxEncoded];
+    size_t len = encode(msg, m_binary, buf);
+
+    std::lock_guard<std::mutex> lk(link->mutex);
+    if (link->fd >= 0)
+    {
+        if (SendAll(link->fd, buf, len) == 0)
+        {
+            LOG_DEBUG("[DME] Sent message to " << peer.id << ": " << msg.toText());
+            return;
+        }
+        ::shutdown(link->fd, SHUT_RDWR);
+    }
+    if (link->pending.size() >= kMaxPending)
+    {
+        link->pending.pop_front();
+        g_peerDropped.add();
+    }
+    link->pending.emplace_back(buf, len);
+}
+
+/**
+ * @brief Makes fd the link to this peer, unless the link already runs on
+ * a connection dialled by a lower id (the crossed-connect tie-break both
+ * sides apply). The connection that loses is half-closed but still read
+ * until the peer closes it. Returns the link generation, 0 if fd lost.
+ */
+uint64_t PeerMesh::adopt(Link &link, int fd, bool outbound)
+{
+    std::lock_guard<std::mutex> lk(link.mutex);
+    if (link.fd >= 0)
+    {
+        // A new connection from the same dialler replaces the old one: the
+        // peer restarted, or redialled after losing the link.
+        const int dialler = outbound ? m_selfId : link.id;
+        const int current = link.outbound ? m_selfId : link.id;
+        if (dialler > current)
+        {
+            ::shutdown(fd, SHUT_WR);
+            return 0;
+        }
+        ::shutdown(link.fd, SHUT_WR);
+    }
+    else
+    {
+        g_peerLinks.add();
+    }
+    link.fd = fd;
+    link.outbound = outbound;
+    ++link.generation;
+
+    bool ok = !m_binary || SendLine(fd, kBinaryHello) == 0;
+    while (ok && !link.pending.empty())
+    {
+        ok = SendAll(fd, link.pending.front().data(), link.pending.front().size()) == 0;
+        if (ok)
+            link.pending.pop_front();
+    }
+    if (!ok)
+        ::shutdown(fd, SHUT_RDWR);
+    LOG_INFO("[CLIENT] Linked with peer " << link.id << " (" << (outbound ? "dialled" : "accepted") << ")");
+    return link.generation;
+}
+
+// Called by a reader when its connection ended; closes fd.
+void PeerMesh::retire(Link *link, int fd, uint64_t generation)
+{
+    if (link && generation != 0)
+    {
+        std::lock_guard<std::mutex> lk(link->mutex);
+        if (link->generation == generation)
+        {
+            link->fd = -1;
+            g_peerLinks.sub();
+            LOG_INFO("[CLIENT] Link to peer " << link->id << " closed");
+        }
+    }
+    forget(fd);
+    wake();
+}
+
+void PeerMesh::acceptLoop(int listenFd)
+{
+    while (!m_stop)
+    {
+        int connFd = ::accept(listenFd, nullptr, nullptr);
+        if (connFd < 0)
+            continue;
+        if (m_stop)
+        {
+            ::close(connFd);
+            break;
+        }
+        startReader(connFd, [this, connFd] { serveInbound(connFd); });
+    }
+}
+
+/**
+ * @brief Keeps a connect in flight to every peer without a link. All
+ * connects run at once on this thread; poll() waits for the first to
+ * finish, the next retry, or a link going down (m_wakeFd).
+ */
+void PeerMesh::dialLoop()
+{
+    struct Dial
+    {
+        int fd{ -1 };
+        Clock::time_point due; // next attempt, or the connect deadline while fd >= 0
+        std::chrono::milliseconds backoff{ kFirstBackoff };
+    };
+    std::vector<Dial> dials(m_links.size());
+    std::minstd_rand rng(static_cast<unsigned>(Clock::now().time_since_epoch().count()) + static_cast<unsigned>(m_selfId));
+
+    // Retry after a random delay in [backoff/2, backoff], so members that
+    // started together do not keep dialling in lockstep.
+    auto retryLater = [&rng](Dial &dial) {
+        auto half = dial.backoff.count() / 2;
+        dial.due = Clock::now() + std::chrono::milliseconds(half + static_cast<long>(rng() % (half + 1)));
+        dial.backoff = std::min(dial.backoff * 2, kMaxBackoff);
+    };
+
+    std::vector<pollfd> fds;
+    std::vector<size_t> owners;
+    while (!m_stop)
+    {
+        const auto now = Clock::now();
+        auto next = now + kMaxBackoff;
+        fds.assign(1, pollfd{ m_wakeFd, POLLIN, 0 });
+        owners.clear();
+        for (size_t i = 0; i < m_links.size(); ++i)
+        {
+            Dial &dial = dials[i];
+            if (dial.fd < 0)
+            {
+                if (linked(*m_links[i]))
+                {
+                    // Up past its retry time: stable, the next loss redials at once.
+                    if (dial.due <= now)
+                        dial.backoff = kFirstBackoff;
+                    continue;
+                }
+                if (dial.due > now)
+                {
+                    next = std::min(next, dial.due);
+                    continue;
+                }
+                g_peerDials.add();
+                dial.fd = TcpConnectStart(m_links[i]->addr);
+                if (dial.fd < 0)
+                {
+                    retryLater(dial);
+                    next = std::min(next, dial.due);
+                    continue;
+                }
+                dial.due = now + kConnectTimeout;
+            }
+            else if (dial.due <= now)
+            {
+                LOG_DEBUG("[CLIENT] Connect to peer " << m_links[i]->id << " timed out");
+                ::close(dial.fd);
+                dial.fd = -1;
+                retryLater(dial);
+                next = std::min(next, dial.due);
+                continue;
+            }
+            fds.push_back(pollfd{ dial.fd, POLLOUT, 0 });
+            owners.push_back(i);
+            next = std::min(next, dial.due);
+        }
+
+        auto waitMs = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+        if (::poll(fds.data(), fds.size(), static_cast<int>(std::max<long>(waitMs, 0) + 1)) < 0 && errno != EINTR)
+            LOG_WARN("[CLIENT] poll() failed: " << strerror(errno));
+
+        if (fds[0].revents)
+        {
+            uint64_t count;
+            ssize_t n = ::read(m_wakeFd, &count, sizeof count);
+            (void)n;
+        }
+        for (size_t k = 1; k < fds.size(); ++k)
+        {
+            if (!fds[k].revents)
+                continue;
+            size_t i = owners[k - 1];
+            Dial &dial = dials[i];
+            int fd = dial.fd;
+            dial.fd = -1;
+            char hello[32];
+            int len = std::snprintf(hello, sizeof hello, "%s %d", kPeerHello.data(), m_selfId);
+            if (TcpConnectFinish(fd) != 0 || SendLine(fd, std::string_view(hello, static_cast<size_t>(len))) != 0)
+            {
+                LOG_DEBUG("[CLIENT] Peer " << m_links[i]->id << " not ready: " << strerror(errno));
+                ::close(fd);
+                retryLater(dial);
+                continue;
+            }
+            // Should this link drop soon (e.g. it lost a crossed connect),
+            // the next dial still waits its backoff.
+            retryLater(dial);
+            Link *link = m_links[i].get();
+            uint64_t generation = adopt(*link, fd, true);
+            startReader(fd, [this, link, fd, generation] { serveOutbound(link, fd, generation); });
+        }
+    }
+
+    for (Dial &dial : dials)
+    {
+        if (dial.fd >= 0)
+            ::close(dial.fd);
+    }
+}
+
+void PeerMesh::serveOutbound(Link *link, int fd, uint64_t generation)
+{
+    LineReader reader(fd);
+    readLoop(reader, false);
+    retire(link, fd, generation);
+}
+
+/**
+ * @brief An accepted connection: "PEER <id>" makes it that peer's link.
+ * A connection without it is an older, one-way peer; its messages are
+ * still handled.
+ */
+void PeerMesh::serveInbound(int fd)
+{
+    LineReader reader(fd);
+    std::string_view line;
+    if (reader.next(line) <= 0)
+    {
+        forget(fd);
+        return;
+    }
+
+    Link *link = nullptr;
+    uint64_t generation = 0;
+    bool frames = false;
+    if (line.size() > kPeerHello.size() && line.compare(0, kPeerHello.size(), kPeerHello) == 0 &&
+        line[kPeerHello.size()] == ' ')
+    {
+        link = find(std::atoi(std::string(line.substr(kPeerHello.size() + 1)).c_str()));
+        if (!link)
+        {
+            LOG_WARN("[CLIENT] Connection from unknown peer (" << line << ") closed");
+            forget(fd);
+            return;
+        }
+        generation = adopt(*link, fd, false);
+    }
+    else if (line == kBinaryHello)
+    {
+        frames = true;
+    }
+    else
+    {
+        DmeMessage msg;
+        if (DmeMessage::parseText(line, msg))
+            m_dme->handleMessage(msg);
+    }
+    readLoop(reader, frames);
+    retire(link, fd, generation);
+}
+
+/**
+ * @brief Hands every message on the connection to the DME until EOF. The
+ * sender may switch its direction to frames with "BINARY 1".
+ */
+void PeerMesh::readLoop(LineReader &reader, bool frames)
+{
+    DmeMessage msg; // reused, so TOKEN lists keep their capacity
+    std::string_view line;
+    while (!frames && reader.next(line) > 0)
+    {
+        LOG_DEBUG("[CLIENT " << m_selfId << "] peer->me: " << line);
+        if (line == kBinaryHello)
+            frames = true;
+        else if (DmeMessage::parseText(line, msg))
+            m_dme->handleMessage(msg);
+        else
+            LOG_WARN("[CLIENT] Malformed DME message ignored: " << line);
+    }
+    if (!frames)
+        return;
+
+    std::string frame;
+    FrameHeader h;
+    while (true)
+    {
+        frame.clear();
+        if (reader.read(kFrameHeaderSize, frame) < 0 || !DecodeFrameHeader(frame.data(), h))
+            return;
+        frame.clear();
+        if (reader.read(h.length, frame) < 0)
+            return;
+
+        if (h.op == FrameOp::Dme && DmeMessage::parsePayload(h.flags, frame, msg))
+            m_dme->handleMessage(msg);
+        else
+            LOG_WARN("[CLIENT] Malformed DME frame (op " << static_cast<int>(h.op) << ") ignored");
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef PEER_MESH_HPP
+#define PEER_MESH_HPP
+
+#include "DmeTransport.hpp"
+#include "../common/Frame.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class DME;
+class LineReader;
+
+// First line on a peer connection: "PEER <id>" names the dialling member.
+constexpr std::string_view kPeerHello = "PEER";
+
+/**
+ * @brief The client's connections to the other DME members.
+ *
+ * Every member keeps one duplex TCP link per peer and exchanges DME
+ * messages in both directions over it. Links are established in the
+ * background, so the client is usable (e.g. for "view") before the mesh
+ * is complete:
+ *
+ *  - one dialler thread starts non-blocking connects to every unlinked
+ *    peer at once and waits for them in poll(); a failed attempt is
+ *    retried after a jittered, exponentially growing backoff;
+ *  - inbound connections are each served on their own thread and named
+ *    by the dialler's "PEER <id>" line.
+ *
+ * When both members dial each other at the same time, both sides keep the
+ * connection dialled by the lower id and half-close the other, which is
+ * still read until the peer closes it, so nothing sent on it is lost.
+ *
+ * Messages for a peer without a link are queued (up to kMaxPending) and
+ * sent, in order, as soon as a link is up again; a peer that restarts is
+ * redialled and sees no difference.
+ *
+ * stop() shuts every socket down and joins every thread; the DME must
+ * outlive it, since the readers deliver to the DME until they are joined.
+ */
+class PeerMesh : public DmeTransport
+{
+  public:
+    static constexpr size_t kMaxPending = 1024;
+
+    PeerMesh(int selfId, const std::vector<DmePeer> &peers, bool binary);
+    ~PeerMesh();
+
+    PeerMesh(const PeerMesh &) = delete;
+    PeerMesh &operator=(const PeerMesh &) = delete;
+
+    // Starts accepting on listenFd (which the mesh then owns) and
+    // dialling; messages go to dme.
+    void start(int listenFd, DME *dme);
+
+    // Closes every link and joins every thread; no message reaches the
+    // DME afterwards. Idempotent.
+    void stop();
+
+    void send(const DmePeer &peer, const DmeMessage &msg) override;
+
+  private:
+    static constexpr size_t kMaxEncoded = kFrameHeaderSize + DmeMessage::kMaxWire;
+
+    // The bytes send() writes: a '\n'-terminated line, or a DME frame.
+    static size_t encode(const DmeMessage &msg, bool binary, char *out);
+
+    struct Link
+    {
+        int id;
+        std::string addr;
+        std::mutex mutex; // guards the fields below; held while writing to fd
+        int fd{ -1 };
+        bool outbound{ false };
+        uint64_t generation{ 0 };
+        std::deque<std::string> pending;
+    };
+
+    Link *find(int id) const;
+    bool linked(Link &link);
+    uint64_t adopt(Link &link, int fd, bool outbound);
+    void retire(Link *link, int fd, uint64_t generation);
+    void wake();
+    void startReader(int fd, std::function<void()> body);
+    void forget(int fd);
+
+    void acceptLoop(int listenFd);
+    void dialLoop();
+    void serveInbound(int fd);
+    void serveOutbound(Link *link, int fd, uint64_t generation);
+    void readLoop(LineReader &reader, bool frames);
+
+    const int m_selfId;
+    const bool m_binary;
+    std::vector<std::unique_ptr<Link>> m_links;
+    DME *m_dme{ nullptr };
+    int m_listenFd{ -1 };
+    int m_wakeFd{ -1 }; // eventfd: a link went down (or stop()), the dialler re-checks
+    std::atomic<bool> m_stop{ false };
+    std::thread m_acceptor;
+    std::thread m_dialler;
+
+    // Connection readers, one thread per peer connection. A reader that
+    // ends files its id under m_finished, and is joined by the next
+    // startReader() or by stop().
+    std::mutex m_readersMutex;
+    std::unordered_map<std::thread::id, std::thread> m_readers;
+    std::vector<std::thread::id> m_finished;
+    std::unordered_set<int> m_readerFds; // sockets the readers block on
+};
+
+#endif
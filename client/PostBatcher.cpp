@@ -0,0 +1,88 @@
+#include "PostBatcher.hpp"
+#include "DME.hpp"
+#include "../common/Logger.hpp"
+
+#include <algorithm>
+
+PostBatcher::PostBatcher(ServerSession &session, DME *dme, size_t maxBatch, ServerSession::Callback done)
+    : m_session(session), m_dme(dme), m_maxBatch(maxBatch > 0 ? maxBatch : 1), m_done(std::move(done))
+{
+    m_sender = std::thread(&PostBatcher::senderLoop, this);
+}
+
+PostBatcher::~PostBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_sender.join();
+}
+
+void PostBatcher::enqueue(std::string record)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_queue.push_back(std::move(record));
+    }
+    m_cv.notify_all();
+}
+
+void PostBatcher::drain()
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_cv.wait(lk, [this] { return m_queue.empty() && !m_sending; });
+}
+
+void PostBatcher::senderLoop()
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    while (true)
+    {
+        m_cv.wait(lk, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+            return; // stopping and nothing left to send
+
+        std::vector<std::string> batch;
+        batch.reserve(std::min(m_queue.size(), m_maxBatch));
+        while (!m_queue.empty() && batch.size() < m_maxBatch)
+        {
+            batch.push_back(std::move(m_queue.front()));
+            m_queue.pop_front();
+        }
+        m_sending = true;
+        lk.unlock();
+
+        sendBatch(batch);
+
+        lk.lock();
+        m_sending = false;
+        m_cv.notify_all();
+    }
+}
+
+/**
+ * @brief Send one batch under a single critical-section acquisition.
+ * The lock is held until the server acknowledges the append, so batches
+ * from different clients can never interleave.
+ */
+void PostBatcher::sendBatch(const std::vector<std::string> &batch)
+{
+    if (m_dme && !m_dme->requestCriticalSection())
+    {
+        LOG_WARN("[CLIENT] Could not acquire lock, " << batch.size() << " post(s) dropped");
+        ServerSession::Response failed;
+        failed.status = "ERR lock";
+        m_done(failed);
+        return;
+    }
+
+    ServerSession::Response resp = m_session.call(batch.size() == 1 ? ServerSession::Request::post(batch.front())
+                                                                    : ServerSession::Request::postBatch(batch));
+    LOG_DEBUG("[CLIENT] Sent batch of " << batch.size() << " post(s): " << resp.status);
+
+    if (m_dme)
+        m_dme->releaseCriticalSection();
+    m_done(resp);
+}
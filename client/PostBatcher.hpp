@@ -0,0 +1,58 @@
+#ifndef POST_BATCHER_HPP
+#define POST_BATCHER_HPP
+
+#include "ServerSession.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class DME;
+
+/**
+ * @brief Queues outgoing posts and sends them in batches from one thread.
+ *
+ * Posts are queued by the input loop and return immediately. The sender
+ * thread takes everything queued so far (up to maxBatch records), acquires
+ * the critical section once, sends the records as a single batch command
+ * ("POSTS <n>" or one PostBatch frame) and releases the lock after the
+ * server acknowledged the batch.
+ * Bursts of posts thus share one DME round and one server round trip.
+ * With a null DME (server ordering) the batch is sent without a lock.
+ */
+class PostBatcher
+{
+  public:
+    PostBatcher(ServerSession &session, DME *dme, size_t maxBatch, ServerSession::Callback done);
+    ~PostBatcher(); // sends whatever is still queued, then stops
+
+    PostBatcher(const PostBatcher &) = delete;
+    PostBatcher &operator=(const PostBatcher &) = delete;
+
+    // Queue one record (without newline).
+    void enqueue(std::string record);
+
+    // Block until every record queued so far has been sent and answered.
+    void drain();
+
+  private:
+    void senderLoop();
+    void sendBatch(const std::vector<std::string> &batch);
+
+    ServerSession &m_session;
+    DME *m_dme;
+    const size_t m_maxBatch;
+    const ServerSession::Callback m_done; // runs once per batch with the server's reply
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::string> m_queue;
+    bool m_sending{ false };
+    bool m_stop{ false };
+    std::thread m_sender;
+};
+
+#endif
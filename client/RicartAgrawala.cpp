@@ -0,0 +1,195 @@
+#include "RicartAgrawala.hpp"
+#include "../common/Logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+RicartAgrawala::RicartAgrawala(int selfId, std::vector<DmePeer> peers, std::shared_ptr<DmeTransport> transport)
+    : DME(selfId, std::move(peers), std::move(transport)), m_replied(m_peers.size(), false),
+      m_deferredTs(m_peers.size(), 0)
+{
+}
+
+/**
+ * @brief Answer every request deferred while we were requesting or in the CS.
+ * Called with m_mutex held; returns how many REPLYs were queued.
+ */
+size_t RicartAgrawala::sendDeferredReplies()
+{
+    size_t sent = 0;
+    for (size_t i = 0; i < m_peers.size(); ++i)
+    {
+        if (m_deferredTs[i] == 0)
+            continue;
+        sendTo(i, DmeMessage{ DmeMessage::Type::Reply, m_selfId, m_deferredTs[i], {}, {} });
+        m_deferredTs[i] = 0;
+        ++sent;
+    }
+    return sent;
+}
+
+/**
+ * @brief REQUEST: grant at once, or defer while we are in the CS or our
+ * own pending request has priority. Called with m_mutex held.
+ */
+RicartAgrawala::Outcome RicartAgrawala::onRequest(const DmeMessage &msg)
+{
+    const int t = msg.value;
+    m_lamportTs = std::max(m_lamportTs, t) + 1;
+
+    int idx = indexOf(msg.from);
+    if (idx < 0)
+        return Outcome::UnknownPeer;
+    if (m_inCriticalSection || (m_requesting && (m_reqTs < t || (m_reqTs == t && m_selfId < msg.from))))
+    {
+        m_deferredTs[static_cast<size_t>(idx)] = t;
+        return Outcome::Deferred;
+    }
+    sendTo(static_cast<size_t>(idx), DmeMessage{ DmeMessage::Type::Reply, m_selfId, t, {}, {} });
+    return Outcome::Granted;
+}
+
+/**
+ * @brief REPLY: count it towards the current request. Called with m_mutex held.
+ */
+RicartAgrawala::Outcome RicartAgrawala::onReply(const DmeMessage &msg)
+{
+    // The echoed request timestamp tells a late answer to an abandoned
+    // request apart from one for the current request.
+    const int forTs = msg.value;
+    int idx = indexOf(msg.from);
+    if (idx < 0 || !m_requesting || m_replied[static_cast<size_t>(idx)] || (forTs != 0 && forTs != m_reqTs))
+        return Outcome::Stale;
+    m_replied[static_cast<size_t>(idx)] = true;
+    if (++m_replyCount == m_peers.size())
+        m_cv.notify_all();
+    return Outcome::Counted;
+}
+
+/**
+ * @brief Handle incoming Ricart–Agrawala messages (REQUEST, REPLY, RELEASE).
+ * Only the state change runs under m_mutex; the answer is sent and the
+ * outcome logged after it is released.
+ */
+void RicartAgrawala::handleMessage(const DmeMessage &msg)
+{
+    noteReceived();
+    Outcome outcome = Outcome::Unexpected;
+    size_t replies = 0;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        switch (msg.type)
+        {
+        case DmeMessage::Type::Request:
+            outcome = onRequest(msg);
+            break;
+        case DmeMessage::Type::Reply:
+            outcome = onReply(msg);
+            replies = m_replyCount;
+            break;
+        case DmeMessage::Type::Release:
+            // Informational: deferred REPLYs are the actual permission.
+            outcome = Outcome::Released;
+            break;
+        case DmeMessage::Type::TokenRequest:
+        case DmeMessage::Type::Token:
+            break;
+        }
+    }
+    flushOutbox();
+
+    switch (outcome)
+    {
+    case Outcome::Granted:
+        LOG_DEBUG("[DME][RA] REQUEST from " << msg.from << " ts=" << msg.value << " granted — sent REPLY");
+        break;
+    case Outcome::Deferred:
+        noteDeferredReply();
+        LOG_DEBUG("[DME][RA] REQUEST from " << msg.from << " ts=" << msg.value
+                  << " deferred — currently in CS or has higher priority");
+        break;
+    case Outcome::UnknownPeer:
+        LOG_WARN("[DME][RA] REQUEST from unknown node " << msg.from << " ignored");
+        break;
+    case Outcome::Counted:
+        LOG_DEBUG("[DME][RA] Received REPLY from peer " << msg.from << " (" << replies << "/" << m_peers.size()
+                  << ")");
+        break;
+    case Outcome::Stale:
+        LOG_DEBUG("[DME][RA] Ignoring stale REPLY from " << msg.from);
+        break;
+    case Outcome::Released:
+        LOG_DEBUG("[DME][RA] Received RELEASE from " << msg.from << " — peer exited CS");
+        break;
+    case Outcome::Unexpected:
+        LOG_WARN("[DME][RA] Unexpected message: " << msg.toText() << " (all members must use the same --mutex)");
+        break;
+    }
+}
+
+bool RicartAgrawala::requestCriticalSection()
+{
+    const auto asked = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    m_requesting = true;
+    m_inCriticalSection = false;
+    std::fill(m_replied.begin(), m_replied.end(), false);
+    m_replyCount = 0;
+
+    m_lamportTs++;
+    m_reqTs = m_lamportTs;
+    const int reqTs = m_reqTs;
+
+    // Broadcast first, then wait for all replies together. Replies that
+    // arrive while the lock is dropped for sending are already counted
+    // when the wait starts.
+    const DmeMessage request{ DmeMessage::Type::Request, m_selfId, m_reqTs, {}, {} };
+    for (size_t i = 0; i < m_peers.size(); ++i)
+        sendTo(i, request);
+    lk.unlock();
+    flushOutbox();
+    LOG_DEBUG("[DME][RA] REQUEST sent to " << m_peers.size() << " peer(s), request ID:" << reqTs);
+    lk.lock();
+
+    auto deadline = std::chrono::steady_clock::now() + m_timeout;
+    if (!m_cv.wait_until(lk, deadline, [this] { return m_replyCount == m_peers.size(); }))
+    {
+        std::vector<bool> replied = m_replied;
+        m_requesting = false;
+        sendDeferredReplies(); // we are not entering, so nobody should wait on us
+        lk.unlock();
+        flushOutbox();
+
+        for (size_t i = 0; i < m_peers.size(); ++i)
+        {
+            if (!replied[i])
+                LOG_WARN("[DME][RA] TIMEOUT waiting for REPLY from peer " << m_peers[i].id);
+        }
+        noteRequest(asked, false);
+        return false;
+    }
+
+    m_requesting = false;
+    m_inCriticalSection = true;
+    lk.unlock();
+    noteRequest(asked, true);
+    LOG_DEBUG("[DME][RA] ENTER critical section (permission received)");
+    return true;
+}
+
+void RicartAgrawala::releaseCriticalSection()
+{
+    size_t deferred;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (!m_inCriticalSection)
+            return;
+
+        m_inCriticalSection = false;
+        m_lamportTs++;
+        deferred = sendDeferredReplies();
+    }
+    flushOutbox();
+    LOG_DEBUG("[DME][RA] Leaving critical section, " << deferred << " deferred REPLY(s) sent");
+}
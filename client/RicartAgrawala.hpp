@@ -0,0 +1,49 @@
+#ifndef RICART_AGRAWALA_HPP
+#define RICART_AGRAWALA_HPP
+
+#include "DME.hpp"
+
+/**
+ * @brief Ricart–Agrawala mutual exclusion for N participants.
+ *
+ * A request is broadcast to every peer at once; the critical section is
+ * entered when all N-1 peers have replied, in whatever order the replies
+ * arrive. Requests that lose the (timestamp, id) priority comparison are
+ * deferred and answered when we leave the critical section.
+ */
+class RicartAgrawala : public DME
+{
+  public:
+    RicartAgrawala(int selfId, std::vector<DmePeer> peers, std::shared_ptr<DmeTransport> transport);
+
+    bool requestCriticalSection() override;
+    void releaseCriticalSection() override;
+    void handleMessage(const DmeMessage &msg) override;
+
+  private:
+    // What handling one message did; logged once m_mutex is released.
+    enum class Outcome
+    {
+        Granted,     // REQUEST answered with a REPLY
+        Deferred,    // REQUEST answered when we leave the CS
+        UnknownPeer, // REQUEST from a node outside the membership
+        Counted,     // REPLY for the current request
+        Stale,       // REPLY for an abandoned request, or a duplicate
+        Released,    // RELEASE (informational)
+        Unexpected   // a message of the other algorithm
+    };
+
+    Outcome onRequest(const DmeMessage &msg);
+    Outcome onReply(const DmeMessage &msg);
+    size_t sendDeferredReplies();
+
+    int m_lamportTs{ 0 };
+    int m_reqTs{ 0 };
+    bool m_requesting{ false };
+    bool m_inCriticalSection{ false };
+    std::vector<bool> m_replied; // per peer: REPLY received for the current request
+    size_t m_replyCount{ 0 };
+    std::vector<int> m_deferredTs; // per peer: timestamp of a REQUEST waiting for our release, 0 = none
+};
+
+#endif
@@ -0,0 +1,650 @@
+#include "ServerSession.hpp"
+#include "../common/NetUtils.hpp"
+#include "../common/Logger.hpp"
+#include "../common/Lz4.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace
+{
+// Splits a VIEW body into records, dropping the "\n" (or "\r\n") of each.
+void SplitRecords(std::string_view body, std::vector<std::string> &lines)
+{
+    for (size_t pos = 0; pos < body.size();)
+    {
+        size_t nl = body.find('\n', pos);
+        size_t end = nl == std::string_view::npos ? body.size() : nl;
+        size_t len = end - pos;
+        if (len > 0 && body[end - 1] == '\r')
+            --len;
+        lines.emplace_back(body.substr(pos, len));
+        pos = end + 1;
+    }
+}
+
+// The ERR of a server that predates VIEW ... COMPRESS: its VIEW usage line
+// in text, and "bad request" for the unknown flag in binary framing.
+bool RefusesCompression(const std::string &status)
+{
+    return status.rfind("ERR usage: VIEW", 0) == 0 || status == "ERR bad request";
+}
+} // namespace
+
+ServerSession::Request ServerSession::Request::view(ViewMode mode, uint64_t arg, bool compress)
+{
+    Request r;
+    r.op = FrameOp::View;
+    r.mode = mode;
+    r.arg = arg;
+    r.compress = compress;
+    return r;
+}
+
+ServerSession::Request ServerSession::Request::post(std::string_view record)
+{
+    Request r;
+    r.op = FrameOp::Post;
+    r.record = record;
+    return r;
+}
+
+ServerSession::Request ServerSession::Request::postBatch(const std::vector<std::string> &records)
+{
+    Request r;
+    r.op = FrameOp::PostBatch;
+    r.records = &records;
+    return r;
+}
+
+ServerSession::Request ServerSession::Request::quit()
+{
+    return Request{};
+}
+
+ServerSession::Request ServerSession::Request::subscribe(uint64_t sinceSeq)
+{
+    Request r;
+    r.op = FrameOp::Subscribe;
+    r.arg = sinceSeq;
+    return r;
+}
+
+ServerSession::ServerSession(const std::string &serverAddr, Wire wire, const std::string &room)
+    : m_serverAddr(serverAddr), m_wire(wire), m_room(room)
+{
+    m_reader = std::thread(&ServerSession::readerLoop, this);
+}
+
+ServerSession::~ServerSession()
+{
+    // Let pipelined commands finish: QUIT is answered only after every
+    // earlier reply has been sent on this connection.
+    bool connected;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        connected = m_fd >= 0;
+        m_subscribed = false; // no reconnect once the server closes
+    }
+    if (connected)
+        call(Request::quit());
+
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+        if (m_fd >= 0)
+            ::shutdown(m_fd, SHUT_RDWR);
+    }
+    m_cv.notify_all();
+    m_reader.join();
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+/**
+ * @brief Switch a fresh connection to binary framing or KEEPALIVE mode.
+ * A server that does not know "BINARY 1" answers ERR and stays in text
+ * mode, so the session falls back to KEEPALIVE on the same connection.
+ */
+bool ServerSession::negotiate(int fd)
+{
+    std::string_view resp;
+    m_binary = false;
+    if (m_wire == Wire::Binary)
+    {
+        if (SendLine(fd, kBinaryHello) != 0 || m_in.next(resp) <= 0)
+            return false;
+        if (resp == kBinaryAccept)
+        {
+            m_binary = true;
+            return true;
+        }
+        LOG_WARN("[CLIENT] Server refused binary framing (" << resp << "), using text");
+    }
+
+    return SendLine(fd, "KEEPALIVE") == 0 && m_in.next(resp) > 0 && resp.substr(0, 2) == "OK";
+}
+
+/**
+ * @brief Open the server connection and negotiate its mode.
+ * Caller holds m_mutex. The handshake completes before the reader thread
+ * sees the descriptor, so the reader only ever parses command replies.
+ * A live tail is renewed from the last record it received.
+ */
+bool ServerSession::ensureConnected()
+{
+    if (m_fd >= 0)
+        return true;
+
+    int fd = TcpConnectHostPort(m_serverAddr);
+    if (fd < 0)
+        return false;
+
+    m_in.reset(fd);
+    if (!negotiate(fd))
+    {
+        LOG_WARN("[CLIENT] Server refused KEEPALIVE");
+        ::close(fd);
+        return false;
+    }
+
+    LOG_INFO("[CLIENT] Persistent server connection established (" << (m_binary ? "binary" : "text") << ")");
+    m_fd = fd;
+    m_cv.notify_all();
+    if (m_subscribed)
+        send(Request::subscribe(m_pushSeq), [](const Response &r) {
+            if (!r.ok)
+                LOG_WARN("[CLIENT] Could not renew live tail: " << r.status);
+        });
+    return true;
+}
+
+/**
+ * @brief Write one command in the text protocol.
+ * Batches go out as "POSTS <n>" plus one line per record, gathered from
+ * the caller's strings without concatenating them.
+ */
+int ServerSession::sendText(const Request &request)
+{
+    // "#room " goes right after the verb; a bare "#" keeps a record that
+    // starts with '#' in the default room.
+    std::string room;
+    if (!m_room.empty() || (request.op == FrameOp::Post && !request.record.empty() && request.record[0] == '#'))
+        room = "#" + m_room + " ";
+
+    switch (request.op)
+    {
+    case FrameOp::View: {
+        const char *compress = request.compress ? " COMPRESS" : "";
+        if (request.mode == ViewMode::Last)
+            return SendLine(m_fd, "VIEW " + room + "LAST " + std::to_string(request.arg) + compress);
+        if (request.mode == ViewMode::Since)
+            return SendLine(m_fd, "VIEW " + room + "SINCE " + std::to_string(request.arg) + compress);
+        return SendLine(m_fd, (m_room.empty() ? "VIEW" : "VIEW #" + m_room) + compress);
+    }
+    case FrameOp::Post:
+        return SendLine(m_fd, "POST " + room, request.record);
+    case FrameOp::Subscribe:
+        return SendLine(m_fd, "SUBSCRIBE " + room + std::to_string(request.arg));
+    case FrameOp::PostBatch:
+    {
+        static char newline = '\n';
+        const std::string head = "POSTS " + room + std::to_string(request.records->size()) + "\n";
+        std::vector<iovec> iov;
+        iov.reserve(1 + 2 * request.records->size());
+        iov.push_back({ const_cast<char *>(head.data()), head.size() });
+        for (const auto &record : *request.records)
+        {
+            iov.push_back({ const_cast<char *>(record.data()), record.size() });
+            iov.push_back({ &newline, 1 });
+        }
+        return SendVec(m_fd, iov.data(), static_cast<int>(iov.size()));
+    }
+    default:
+        return SendLine(m_fd, "QUIT");
+    }
+}
+
+/**
+ * @brief Write one command as a frame.
+ * Records are length-prefixed, so they are sent as they are; only the
+ * header and the per-record lengths are formatted.
+ */
+int ServerSession::sendBinary(const Request &request, uint32_t requestId)
+{
+    std::string head(kFrameHeaderSize, '\0');
+    std::string lengths; // PostBatch: the u32 prefix of each record
+    std::vector<iovec> iov;
+    size_t length = 0;
+    uint16_t flags = 0;
+
+    if (!m_room.empty() && request.op != FrameOp::Quit)
+    {
+        flags = kFrameRoomFlag;
+        head.push_back(static_cast<char>(m_room.size()));
+        head += m_room;
+    }
+
+    switch (request.op)
+    {
+    case FrameOp::View:
+        flags |= static_cast<uint16_t>(request.mode);
+        if (request.compress)
+            flags |= kViewCompressFlag;
+        if (request.mode != ViewMode::All)
+            PutU64(head, request.arg);
+        length = head.size() - kFrameHeaderSize;
+        break;
+    case FrameOp::Subscribe:
+        PutU64(head, request.arg);
+        length = head.size() - kFrameHeaderSize;
+        break;
+    case FrameOp::Post:
+        iov.push_back({ const_cast<char *>(request.record.data()), request.record.size() });
+        length = head.size() - kFrameHeaderSize + request.record.size();
+        break;
+    case FrameOp::PostBatch:
+        length = head.size() - kFrameHeaderSize;
+        for (const auto &record : *request.records)
+        {
+            PutU32(lengths, static_cast<uint32_t>(record.size()));
+            length += 4 + record.size();
+        }
+        iov.reserve(2 * request.records->size());
+        for (size_t i = 0; i < request.records->size(); ++i)
+        {
+            const auto &record = (*request.records)[i];
+            iov.push_back({ &lengths[4 * i], 4 });
+            iov.push_back({ const_cast<char *>(record.data()), record.size() });
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (length > kMaxFramePayload)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    EncodeFrameHeader(FrameHeader{ kFrameVersion, request.op, flags, requestId, static_cast<uint32_t>(length) },
+                      &head[0]);
+    iov.insert(iov.begin(), iovec{ &head[0], head.size() });
+    return SendVec(m_fd, iov.data(), static_cast<int>(iov.size()));
+}
+
+bool ServerSession::submit(const Request &request, Callback done, Callback progress)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return ensureConnected() && send(request, std::move(done), std::move(progress));
+}
+
+/**
+ * @brief Write one command on the open connection. Caller holds m_mutex.
+ */
+bool ServerSession::send(const Request &request, Callback done, Callback progress)
+{
+    Request effective = request;
+    effective.compress = request.compress && !m_compressRefused;
+
+    // Queue the reply slot before writing so the reader can never see a
+    // reply without its matching entry.
+    const uint32_t requestId = m_nextRequestId++;
+    m_pending.push_back(Pending{ request.op, requestId, std::move(done), std::move(progress), request.mode,
+                                 request.arg, effective.compress });
+    if ((m_binary ? sendBinary(effective, requestId) : sendText(effective)) != 0)
+    {
+        m_pending.pop_back();
+        ::shutdown(m_fd, SHUT_RDWR); // reader fails the rest and resets m_fd
+        return false;
+    }
+    return true;
+}
+
+bool ServerSession::subscribe(uint64_t sinceSeq, Callback onPush)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_onPush = std::move(onPush);
+    if (m_subscribed)
+        return true;
+    m_subscribed = true;
+    m_pushSeq = sinceSeq;
+    m_cv.notify_all(); // the reader keeps the tail connected from now on
+    if (m_fd < 0)
+        return ensureConnected(); // subscribes as part of the handshake
+    return send(Request::subscribe(sinceSeq), [](const Response &) {});
+}
+
+ServerSession::Response ServerSession::call(const Request &request)
+{
+    const int attempts = request.op == FrameOp::View ? 2 : 1;
+    Response result;
+
+    for (int attempt = 0; attempt < attempts; ++attempt)
+    {
+        auto promise = std::make_shared<std::promise<Response>>();
+        auto future = promise->get_future();
+        if (!submit(request, [promise](const Response &r) { promise->set_value(r); }))
+            continue;
+
+        result = future.get();
+        if (!result.status.empty())
+            break; // the server answered, even if with ERR
+    }
+    return result;
+}
+
+/**
+ * @brief Close the current connection and fail every outstanding command.
+ * Called from the reader thread when the connection breaks.
+ */
+void ServerSession::dropConnection(int fd)
+{
+    std::deque<Pending> failed;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (m_fd == fd)
+        {
+            ::close(fd);
+            m_fd = -1;
+        }
+        failed.swap(m_pending);
+    }
+
+    if (!failed.empty())
+        LOG_WARN("[CLIENT] Server connection lost, " << failed.size()
+                 << " command(s) failed; will reconnect on next command");
+    for (auto &p : failed)
+        p.done(Response{});
+}
+
+/**
+ * @brief Complete a text reply whose status line has been read.
+ * VIEW: "OK <bytes> <first> <last>" — the body is read in bulk by its
+ * byte count, then split into lines, then the "." terminator follows.
+ * With " LZ4" at the end the body is compressed blocks instead.
+ * POST: "OK <seq>"; POSTS: "OK <first> <last>".
+ */
+bool ServerSession::readTextReply(std::string_view status, const Pending &pending, Response &resp)
+{
+    resp.status = std::string(status);
+    resp.ok = resp.status.rfind("OK", 0) == 0;
+    if (!resp.ok)
+        return true;
+
+    unsigned long long a = 0, b = 0, c = 0;
+    int fields = std::sscanf(resp.status.c_str(), "OK %llu %llu %llu", &a, &b, &c);
+    if (pending.op != FrameOp::View)
+    {
+        resp.firstSeq = a;
+        resp.lastSeq = fields >= 2 ? b : a;
+        return true;
+    }
+
+    resp.firstSeq = b;
+    resp.lastSeq = c;
+    std::string_view terminator;
+    if (status.size() > 4 && status.substr(status.size() - 4) == " LZ4")
+        return readCompressedBody(a, pending, resp) && m_in.next(terminator) > 0;
+
+    std::string body;
+    if (m_in.read(a, body) < 0 || m_in.next(terminator) <= 0)
+        return false;
+    SplitRecords(body, resp.lines);
+    return true;
+}
+
+/**
+ * @brief Read the payload of a reply frame whose header has been read.
+ * Ok frames start with two u64 sequence numbers; VIEW records follow.
+ */
+bool ServerSession::readFrameReply(const FrameHeader &h, const Pending &pending, Response &resp)
+{
+    // A compressed VIEW is decoded while it arrives; only the sequence
+    // numbers are read up front.
+    const bool compressed = h.op == FrameOp::Ok && pending.compress && h.length >= 16;
+    std::string payload;
+    if (m_in.read(compressed ? 16 : h.length, payload) < 0)
+        return false;
+    if (h.requestId != pending.requestId)
+    {
+        LOG_WARN("[CLIENT] Reply for request " << h.requestId << ", expected " << pending.requestId);
+        return false;
+    }
+
+    if (h.op == FrameOp::Err)
+    {
+        resp.status = "ERR " + payload;
+        return true;
+    }
+    if (h.op != FrameOp::Ok)
+        return false;
+
+    resp.ok = true;
+    resp.status = "OK";
+    if (payload.size() >= 16)
+    {
+        resp.firstSeq = GetU64(payload.data());
+        resp.lastSeq = GetU64(payload.data() + 8);
+        if (compressed)
+            return readCompressedBody(h.length - 16, pending, resp);
+        if (pending.op == FrameOp::View)
+            SplitRecords(std::string_view(payload).substr(16), resp.lines);
+    }
+    return true;
+}
+
+/**
+ * @brief Read and decode bytes worth of compressed blocks (Lz4.hpp).
+ * Each block is expanded as soon as it is in; a record cut by the block
+ * boundary waits for the next block. Complete records go to the progress
+ * callback, numbered from resp.firstSeq, or to resp.lines without one.
+ */
+bool ServerSession::readCompressedBody(uint64_t bytes, const Pending &pending, Response &resp)
+{
+    Response chunk;
+    chunk.ok = true;
+    chunk.status = resp.status;
+    uint64_t nextSeq = resp.firstSeq;
+    std::string stored;
+    std::string text; // decoded, not yet a complete record
+
+    while (bytes > 0)
+    {
+        stored.clear();
+        if (bytes < kCompressedBlockHeader || m_in.read(kCompressedBlockHeader, stored) < 0)
+            return false;
+        const uint32_t rawLen = GetU32(stored.data());
+        const uint32_t storedLen = GetU32(stored.data() + 4);
+        bytes -= kCompressedBlockHeader;
+        stored.clear();
+        if (storedLen > bytes || rawLen > kMaxFramePayload || m_in.read(storedLen, stored) < 0)
+            return false;
+        bytes -= storedLen;
+        if (!ExpandCompressedBlock(rawLen, stored, text))
+        {
+            LOG_WARN("[CLIENT] Malformed compressed block in VIEW reply");
+            return false;
+        }
+
+        const size_t complete = text.rfind('\n') + 1; // 0 when no record ends here
+        SplitRecords(std::string_view(text).substr(0, complete), pending.progress ? chunk.lines : resp.lines);
+        text.erase(0, complete);
+        if (pending.progress && !chunk.lines.empty())
+        {
+            chunk.firstSeq = nextSeq;
+            nextSeq += chunk.lines.size();
+            chunk.lastSeq = nextSeq - 1;
+            pending.progress(chunk);
+            chunk.lines.clear();
+        }
+    }
+    return text.empty();
+}
+
+/**
+ * @brief Ask again, once and without compression, for a compressed VIEW
+ * the server answered with `status`. Only if that ERR rejected the option
+ * (RefusesCompression) and the plain view then succeeds does the session
+ * stop asking for compression; any other ERR may be transient.
+ * False if the view cannot be resent, and pending must be completed.
+ */
+bool ServerSession::retryUncompressed(int fd, Pending &pending, const std::string &status)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    // Nothing is answered after QUIT.
+    const bool quitting = std::any_of(m_pending.begin(), m_pending.end(),
+                                      [](const Pending &p) { return p.op == FrameOp::Quit; });
+    if (m_fd != fd || quitting || !send(Request::view(pending.mode, pending.arg), pending.done, pending.progress))
+        return false;
+    m_pending.back().optionRefused = RefusesCompression(status);
+    return true;
+}
+
+/**
+ * @brief Hand pushed records to the live-tail callback.
+ */
+void ServerSession::deliverPush(Response &push)
+{
+    Callback onPush;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_pushSeq = std::max(m_pushSeq, push.lastSeq);
+        onPush = m_onPush;
+    }
+    if (onPush)
+        onPush(push);
+}
+
+// "PUSH <bytes> <first> <last>" followed by the records.
+bool ServerSession::readTextPush(std::string_view header)
+{
+    Response push;
+    push.ok = true;
+    push.status = std::string(header);
+    unsigned long long bytes = 0, first = 0, last = 0;
+    if (std::sscanf(push.status.c_str(), "PUSH %llu %llu %llu", &bytes, &first, &last) != 3)
+        return false;
+
+    std::string body;
+    if (m_in.read(bytes, body) < 0)
+        return false;
+    push.firstSeq = first;
+    push.lastSeq = last;
+    SplitRecords(body, push.lines);
+    deliverPush(push);
+    return true;
+}
+
+bool ServerSession::readFramePush(const FrameHeader &h)
+{
+    std::string payload;
+    if (m_in.read(h.length, payload) < 0 || payload.size() < 16)
+        return false;
+
+    Response push;
+    push.ok = true;
+    push.status = "PUSH";
+    push.firstSeq = GetU64(payload.data());
+    push.lastSeq = GetU64(payload.data() + 8);
+    SplitRecords(std::string_view(payload).substr(16), push.lines);
+    deliverPush(push);
+    return true;
+}
+
+/**
+ * @brief Background reader: parses replies in order and completes the
+ * matching pending commands; pushes go to the live tail. While a tail is
+ * active, a lost connection is re-established right away.
+ */
+void ServerSession::readerLoop()
+{
+    while (true)
+    {
+        int fd;
+        bool binary;
+        {
+            std::unique_lock<std::mutex> lk(m_mutex);
+            while (!m_stop && m_fd < 0)
+            {
+                if (m_subscribed && ensureConnected())
+                    break;
+                if (m_subscribed)
+                    m_cv.wait_for(lk, std::chrono::seconds(1), [this] { return m_stop; });
+                else
+                    m_cv.wait(lk, [this] { return m_stop || m_fd >= 0 || m_subscribed; });
+            }
+            if (m_stop)
+                return;
+            fd = m_fd;
+            binary = m_binary;
+        }
+
+        std::string_view line;
+        std::string head;
+        FrameHeader h;
+        while (true)
+        {
+            // Each reply starts with a status line or a frame header.
+            if (binary)
+            {
+                head.clear();
+                if (m_in.read(kFrameHeaderSize, head) < 0 || !DecodeFrameHeader(head.data(), h))
+                    break;
+            }
+            else if (m_in.next(line) <= 0)
+            {
+                break;
+            }
+
+            if (binary ? h.op == FrameOp::Push : line.substr(0, 5) == "PUSH ")
+            {
+                if (!(binary ? readFramePush(h) : readTextPush(line)))
+                    break;
+                continue;
+            }
+
+            Pending pending;
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                if (m_pending.empty())
+                {
+                    // Unsolicited reply; nothing is waiting for it.
+                    if (binary && m_in.read(h.length, head) < 0)
+                        break;
+                    continue;
+                }
+                pending = std::move(m_pending.front());
+                m_pending.pop_front();
+            }
+
+            Response resp;
+            bool complete = binary ? readFrameReply(h, pending, resp) : readTextReply(line, pending, resp);
+            if (!complete)
+            {
+                pending.done(Response{});
+                break;
+            }
+            if (!resp.ok && pending.compress && !resp.status.empty() && retryUncompressed(fd, pending, resp.status))
+                continue;
+            if (resp.ok && pending.optionRefused)
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                if (!m_compressRefused)
+                    LOG_WARN("[CLIENT] Server does not support compressed views; using plain views");
+                m_compressRefused = true;
+            }
+            pending.done(resp);
+        }
+
+        dropConnection(fd);
+    }
+}
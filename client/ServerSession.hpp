@@ -0,0 +1,148 @@
+#ifndef SERVER_SESSION_HPP
+#define SERVER_SESSION_HPP
+
+#include "LineReader.hpp"
+#include "Frame.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Persistent, pipelined connection from a client to the chat server.
+ *
+ * The session opens one TCP connection, switches it to KEEPALIVE mode (or
+ * to binary framing, when requested and the server accepts it) and reuses
+ * it for every VIEW/POST. Commands are written as soon as they are
+ * submitted, without waiting for earlier replies; a background reader
+ * matches the in-order replies back to their callbacks. If the connection
+ * drops, outstanding commands fail and the next command reconnects.
+ *
+ * Every command addresses one room, fixed for the session; the empty name
+ * is the server's default room.
+ *
+ * A session can also carry a live tail (subscribe()): records pushed by
+ * the server arrive between replies and go to the push callback. A tail
+ * reconnects by itself and resumes after the last record it received.
+ *
+ * Views may ask for compressed history (VIEW ... COMPRESS). The reply is
+ * decoded block by block as it arrives, and each block's complete records
+ * can be handed to a progress callback while the rest is still in flight.
+ * A server that rejects the option is asked again without it, and the
+ * session stops asking for compression.
+ */
+class ServerSession
+{
+  public:
+    enum class Wire
+    {
+        Text,  // newline-delimited commands, always available
+        Binary // length-prefixed frames, falls back to Text if refused
+    };
+
+    struct Response
+    {
+        bool ok{ false };               // transport succeeded and the server answered OK
+        std::string status;             // status line without the newline ("OK"/"ERR <msg>" in binary)
+        uint64_t firstSeq{ 0 };         // VIEW: first sequence shown; POST(S): first stored
+        uint64_t lastSeq{ 0 };          // VIEW: last sequence in the log; POST(S): last stored
+        std::vector<std::string> lines; // VIEW and pushed records
+    };
+
+    /**
+     * @brief One server command, encoded by the session for the wire in use.
+     * Records are referenced, not copied: they must stay valid until
+     * submit() returns.
+     */
+    struct Request
+    {
+        FrameOp op{ FrameOp::Quit };
+        ViewMode mode{ ViewMode::All };
+        uint64_t arg{ 0 };
+        bool compress{ false }; // VIEW: ask for compressed blocks
+        std::string_view record;
+        const std::vector<std::string> *records{ nullptr };
+
+        static Request view(ViewMode mode = ViewMode::All, uint64_t arg = 0, bool compress = false);
+        static Request post(std::string_view record);
+        static Request postBatch(const std::vector<std::string> &records);
+        static Request quit();
+        static Request subscribe(uint64_t sinceSeq);
+    };
+
+    using Callback = std::function<void(const Response &)>;
+
+    explicit ServerSession(const std::string &serverAddr, Wire wire = Wire::Text, const std::string &room = "");
+    ~ServerSession();
+
+    ServerSession(const ServerSession &) = delete;
+    ServerSession &operator=(const ServerSession &) = delete;
+
+    // Pipeline a command; done runs on the reader thread when its reply
+    // arrives. For a compressed VIEW, progress (if set) receives the records
+    // of each block as it is decoded, with their sequence numbers, and done
+    // then carries no lines.
+    bool submit(const Request &request, Callback done, Callback progress = nullptr);
+
+    // Submit and wait for the reply. Idempotent commands (VIEW) are retried
+    // once on a fresh connection if the old one turned out to be dead.
+    Response call(const Request &request);
+
+    // Start a live tail: records after sinceSeq are passed to onPush (on
+    // the reader thread) as the server commits them.
+    bool subscribe(uint64_t sinceSeq, Callback onPush);
+
+  private:
+    struct Pending
+    {
+        FrameOp op;                  // what the reply answers
+        uint32_t requestId;          // binary only
+        Callback done;
+        Callback progress;           // compressed VIEW only
+        ViewMode mode;               // VIEW: to ask again without compression
+        uint64_t arg;
+        bool compress;
+        bool optionRefused{ false }; // resent plain after an ERR rejecting compression
+    };
+
+    bool ensureConnected();
+    bool negotiate(int fd);
+    bool send(const Request &request, Callback done, Callback progress = nullptr);
+    int sendText(const Request &request);
+    int sendBinary(const Request &request, uint32_t requestId);
+    bool readTextReply(std::string_view status, const Pending &pending, Response &resp);
+    bool readFrameReply(const FrameHeader &h, const Pending &pending, Response &resp);
+    bool readCompressedBody(uint64_t bytes, const Pending &pending, Response &resp);
+    bool retryUncompressed(int fd, Pending &pending, const std::string &status);
+    bool readTextPush(std::string_view header);
+    bool readFramePush(const FrameHeader &h);
+    void deliverPush(Response &push);
+    void readerLoop();
+    void dropConnection(int fd);
+
+    const std::string m_serverAddr;
+    const Wire m_wire;
+    const std::string m_room;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    int m_fd{ -1 };
+    bool m_binary{ false }; // current connection speaks frames
+    uint32_t m_nextRequestId{ 1 };
+    bool m_compressRefused{ false }; // the server does not know VIEW ... COMPRESS
+    LineReader m_in; // handshake on connect, then owned by the reader thread
+    bool m_stop{ false };
+    std::deque<Pending> m_pending;
+    bool m_subscribed{ false };
+    uint64_t m_pushSeq{ 0 }; // newest record pushed so far
+    Callback m_onPush;
+    std::thread m_reader;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include "SuzukiKasami.hpp"
+#include "../common/Logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+SuzukiKasami::SuzukiKasami(int selfId, std::vector<DmePeer> peers, std::shared_ptr<DmeTransport> transport)
+    : DME(selfId, std::move(peers), std::move(transport))
+{
+    m_members.push_back(m_selfId);
+    for (const auto &peer : m_peers)
+        m_members.push_back(peer.id);
+    std::sort(m_members.begin(), m_members.end());
+
+    m_rn.assign(m_members.size(), 0);
+    m_ln.assign(m_members.size(), 0);
+    m_haveToken = m_members.front() == m_selfId;
+}
+
+size_t SuzukiKasami::slotOf(int id) const
+{
+    auto it = std::lower_bound(m_members.begin(), m_members.end(), id);
+    if (it == m_members.end() || *it != id)
+        return m_members.size();
+    return static_cast<size_t>(it - m_members.begin());
+}
+
+/**
+ * @brief Hand the token to the next waiting member, if any.
+ * Called with m_mutex held while we own the token outside the CS. Members
+ * with an outstanding request (RN = LN + 1) are appended to the queue
+ * first; with nobody waiting the token simply stays here. Returns the id
+ * of the new holder, or -1; the TOKEN goes out on the next flushOutbox().
+ */
+int SuzukiKasami::passToken()
+{
+    for (size_t j = 0; j < m_members.size(); ++j)
+    {
+        int id = m_members[j];
+        if (id != m_selfId && m_rn[j] == m_ln[j] + 1 && std::find(m_queue.begin(), m_queue.end(), id) == m_queue.end())
+            m_queue.push_back(id);
+    }
+    if (m_queue.empty())
+        return -1;
+
+    int next = m_queue.front();
+    m_queue.pop_front();
+
+    m_haveToken = false;
+    sendTo(static_cast<size_t>(indexOf(next)),
+           DmeMessage{ DmeMessage::Type::Token, m_selfId, 0, m_ln, { m_queue.begin(), m_queue.end() } });
+    return next;
+}
+
+/**
+ * @brief Handle incoming Suzuki–Kasami messages (TREQ and TOKEN).
+ * The token state changes under m_mutex; a TOKEN passed on as a result is
+ * sent, and everything logged, after it is released.
+ */
+void SuzukiKasami::handleMessage(const DmeMessage &msg)
+{
+    noteReceived();
+    const int fromId = msg.from;
+    int passedTo = -1;
+    enum class Outcome
+    {
+        Recorded,
+        Granted,
+        UnknownPeer,
+        BadToken,
+        Unexpected
+    } outcome = Outcome::Unexpected;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        switch (msg.type)
+        {
+        case DmeMessage::Type::TokenRequest:
+        {
+            size_t slot = slotOf(fromId);
+            if (slot == m_members.size() || fromId == m_selfId)
+            {
+                outcome = Outcome::UnknownPeer;
+                break;
+            }
+            outcome = Outcome::Recorded;
+            m_rn[slot] = std::max(m_rn[slot], msg.value);
+            if (m_haveToken && !m_inCriticalSection && m_rn[slot] == m_ln[slot] + 1)
+                passedTo = passToken();
+            break;
+        }
+        case DmeMessage::Type::Token:
+            if (msg.ln.size() != m_members.size())
+            {
+                outcome = Outcome::BadToken;
+                break;
+            }
+            outcome = Outcome::Recorded;
+            m_ln = msg.ln;
+            m_queue.assign(msg.queue.begin(), msg.queue.end());
+
+            m_haveToken = true;
+            if (m_requesting)
+            {
+                // Grant here, so a TREQ handled before the requester wakes up
+                // cannot take the token away again.
+                m_requesting = false;
+                m_inCriticalSection = true;
+                outcome = Outcome::Granted;
+                m_cv.notify_all();
+            }
+            else
+            {
+                // Our request timed out meanwhile: count it as served, move on.
+                size_t self = slotOf(m_selfId);
+                m_ln[self] = m_rn[self];
+                passedTo = passToken();
+            }
+            break;
+        case DmeMessage::Type::Request:
+        case DmeMessage::Type::Reply:
+        case DmeMessage::Type::Release:
+            break;
+        }
+    }
+    flushOutbox();
+
+    switch (outcome)
+    {
+    case Outcome::Recorded:
+    case Outcome::Granted:
+        if (msg.type == DmeMessage::Type::Token)
+            LOG_DEBUG("[DME][SK] Token received from " << fromId);
+        break;
+    case Outcome::UnknownPeer:
+        LOG_WARN("[DME][SK] TREQ from unknown node " << fromId << " ignored");
+        break;
+    case Outcome::BadToken:
+        LOG_ERROR("[DME][SK] TOKEN from " << fromId << " has " << msg.ln.size() << " members, expected "
+                                          << m_members.size() << " (membership mismatch)");
+        break;
+    case Outcome::Unexpected:
+        LOG_WARN("[DME][SK] Unexpected message: " << msg.toText() << " (all members must use the same --mutex)");
+        break;
+    }
+    if (passedTo >= 0)
+        LOG_DEBUG("[DME][SK] Token passed to " << passedTo);
+}
+
+bool SuzukiKasami::requestCriticalSection()
+{
+    const auto asked = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    if (m_haveToken)
+    {
+        m_inCriticalSection = true;
+        lk.unlock();
+        noteRequest(asked, true);
+        LOG_DEBUG("[DME][SK] ENTER critical section (token already held, no messages)");
+        return true;
+    }
+
+    // A request that timed out is still outstanding at the other members;
+    // repeat its number instead of skipping one (RN = LN + 1 must hold).
+    size_t self = slotOf(m_selfId);
+    if (m_rn[self] == m_ln[self])
+        ++m_rn[self];
+    m_requesting = true;
+    const DmeMessage request{ DmeMessage::Type::TokenRequest, m_selfId, m_rn[self], {}, {} };
+    for (size_t i = 0; i < m_peers.size(); ++i)
+        sendTo(i, request);
+    // A TOKEN arriving while the lock is dropped already sets
+    // m_inCriticalSection, which the wait checks first.
+    lk.unlock();
+    flushOutbox();
+    lk.lock();
+
+    auto deadline = std::chrono::steady_clock::now() + m_timeout;
+    if (!m_cv.wait_until(lk, deadline, [this] { return m_inCriticalSection; }))
+    {
+        m_requesting = false;
+        lk.unlock();
+        LOG_WARN("[DME][SK] TIMEOUT waiting for the token");
+        noteRequest(asked, false);
+        return false;
+    }
+    lk.unlock();
+    noteRequest(asked, true);
+
+    LOG_DEBUG("[DME][SK] ENTER critical section (token received)");
+    return true;
+}
+
+void SuzukiKasami::releaseCriticalSection()
+{
+    int passedTo;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (!m_inCriticalSection)
+            return;
+
+        m_inCriticalSection = false;
+        size_t self = slotOf(m_selfId);
+        m_ln[self] = m_rn[self];
+        passedTo = passToken();
+    }
+    flushOutbox();
+    if (passedTo >= 0)
+        LOG_DEBUG("[DME][SK] Token passed to " << passedTo);
+    LOG_DEBUG("[DME][SK] Leaving critical section");
+}
@@ -0,0 +1,42 @@
+#ifndef SUZUKI_KASAMI_HPP
+#define SUZUKI_KASAMI_HPP
+
+#include "DME.hpp"
+
+#include <deque>
+
+/**
+ * @brief Suzuki–Kasami token-based mutual exclusion.
+ *
+ * A single token circulates among the members; whoever holds it may enter
+ * the critical section without sending anything, so a node posting in a
+ * burst pays no round trips after the first entry. A node without the
+ * token broadcasts "TREQ <id> <n>" and waits for "TOKEN ...". The token
+ * carries LN (the last request number served per node) and the queue of
+ * nodes waiting for it; it moves only when another node has asked for it.
+ *
+ * The member with the lowest id holds the token initially.
+ */
+class SuzukiKasami : public DME
+{
+  public:
+    SuzukiKasami(int selfId, std::vector<DmePeer> peers, std::shared_ptr<DmeTransport> transport);
+
+    bool requestCriticalSection() override;
+    void releaseCriticalSection() override;
+    void handleMessage(const DmeMessage &msg) override;
+
+  private:
+    size_t slotOf(int id) const;
+    int passToken();
+
+    std::vector<int> m_members; // all node ids (self included), sorted; indexes m_rn/m_ln
+    std::vector<int> m_rn;      // highest request number seen per member
+    std::vector<int> m_ln;      // token state: request number last served per member
+    std::deque<int> m_queue;    // token state: members waiting for the token
+    bool m_haveToken{ false };
+    bool m_requesting{ false };
+    bool m_inCriticalSection{ false };
+};
+
+#endif
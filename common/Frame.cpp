@@ -0,0 +1,85 @@
+#include "Frame.hpp"
+#include "NetUtils.hpp"
+
+void PutU32(std::string &out, uint32_t v)
+{
+    char b[4] = { static_cast<char>(v >> 24), static_cast<char>(v >> 16), static_cast<char>(v >> 8),
+                  static_cast<char>(v) };
+    out.append(b, sizeof b);
+}
+
+void PutU64(std::string &out, uint64_t v)
+{
+    PutU32(out, static_cast<uint32_t>(v >> 32));
+    PutU32(out, static_cast<uint32_t>(v));
+}
+
+char *PutU32(char *out, uint32_t v)
+{
+    out[0] = static_cast<char>(v >> 24);
+    out[1] = static_cast<char>(v >> 16);
+    out[2] = static_cast<char>(v >> 8);
+    out[3] = static_cast<char>(v);
+    return out + 4;
+}
+
+char *PutU64(char *out, uint64_t v)
+{
+    return PutU32(PutU32(out, static_cast<uint32_t>(v >> 32)), static_cast<uint32_t>(v));
+}
+
+uint32_t GetU32(const char *p)
+{
+    const auto *u = reinterpret_cast<const unsigned char *>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | uint32_t(u[3]);
+}
+
+uint64_t GetU64(const char *p)
+{
+    return (uint64_t(GetU32(p)) << 32) | GetU32(p + 4);
+}
+
+void EncodeFrameHeader(const FrameHeader &h, char *out)
+{
+    out[0] = static_cast<char>(h.version);
+    out[1] = static_cast<char>(h.op);
+    out[2] = static_cast<char>(h.flags >> 8);
+    out[3] = static_cast<char>(h.flags);
+    for (int i = 0; i < 4; ++i)
+    {
+        out[4 + i] = static_cast<char>(h.requestId >> (24 - 8 * i));
+        out[8 + i] = static_cast<char>(h.length >> (24 - 8 * i));
+    }
+}
+
+bool DecodeFrameHeader(const char *in, FrameHeader &h)
+{
+    const auto *u = reinterpret_cast<const unsigned char *>(in);
+    h.version = u[0];
+    h.op = static_cast<FrameOp>(u[1]);
+    h.flags = static_cast<uint16_t>((u[2] << 8) | u[3]);
+    h.requestId = GetU32(in + 4);
+    h.length = GetU32(in + 8);
+    return h.version == kFrameVersion && h.length <= kMaxFramePayload;
+}
+
+std::string MakeFrame(FrameOp op, uint16_t flags, uint32_t requestId, std::string_view payload)
+{
+    std::string frame(kFrameHeaderSize, '\0');
+    EncodeFrameHeader(FrameHeader{ kFrameVersion, op, flags, requestId, static_cast<uint32_t>(payload.size()) },
+                      &frame[0]);
+    frame.append(payload.data(), payload.size());
+    return frame;
+}
+
+int SendFrame(int fd, FrameOp op, uint16_t flags, uint32_t requestId, std::string_view payload)
+{
+    char header[kFrameHeaderSize];
+    EncodeFrameHeader(FrameHeader{ kFrameVersion, op, flags, requestId, static_cast<uint32_t>(payload.size()) },
+                      header);
+    iovec iov[2] = {
+        { header, sizeof header },
+        { const_cast<char *>(payload.data()), payload.size() },
+    };
+    return SendVec(fd, iov, 2);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ *  Frame.hpp
+ *  ---------
+ *  Length-prefixed binary framing, used instead of text lines once both
+ *  ends agreed on it. A peer opts in by sending the text line
+ *  "BINARY <version>" right after connecting; everything after that line
+ *  is a stream of frames:
+ *
+ *      0      1      2             4                 8                12
+ *      +------+------+-------------+-----------------+-----------------+
+ *      | ver  |  op  |   flags     |   request id    |  payload length |  payload...
+ *      +------+------+-------------+-----------------+-----------------+
+ *
+ *  All integers are big-endian. Decoding a header is a fixed 12-byte
+ *  read; the payload is then taken in one piece, so records may contain
+ *  any bytes and nothing is scanned for delimiters.
+ */
+
+constexpr uint8_t kFrameVersion = 1;
+constexpr size_t kFrameHeaderSize = 12;
+constexpr uint32_t kMaxFramePayload = 16u << 20;
+
+// Negotiation lines (text) for version 1.
+constexpr std::string_view kBinaryHello = "BINARY 1";
+constexpr std::string_view kBinaryAccept = "OK binary 1";
+
+enum class FrameOp : uint8_t
+{
+    // Replies (request id echoes the request)
+    Ok = 0x01,   // VIEW: u64 first-seq, u64 last-seq, records; POST(S): u64 first-seq, u64 last-seq
+    Err = 0x02,  // payload: error text
+    Push = 0x03, // SUBSCRIBE stream (request id 0): u64 first-seq, u64 last-seq, records
+
+    // Client → server
+    View = 0x10,      // flags: ViewMode [| kViewCompressFlag]; payload: u64 argument (LAST n / SINCE seq)
+    Post = 0x11,      // payload: one record
+    PostBatch = 0x12, // payload: n × (u32 length, record)
+    Quit = 0x13,      // empty; answered with Ok, then the server closes
+    Subscribe = 0x14, // payload: u64 since-seq (optional, default: newest); Ok, then Push frames
+    Stats = 0x15,     // empty; Ok with the metrics dump (Prometheus text) as payload
+
+    // Peer → peer (DME); flags carry the DME message type
+    Dme = 0x20,
+};
+
+enum class ViewMode : uint16_t
+{
+    All = 0,
+    Last = 1,
+    Since = 2
+};
+
+// Request flag: the payload starts with a room name (u8 length, name);
+// the remaining flag bits keep their per-op meaning.
+constexpr uint16_t kFrameRoomFlag = 0x8000;
+
+// VIEW flag: answer with compressed blocks (Lz4.hpp) instead of raw records.
+constexpr uint16_t kViewCompressFlag = 0x4000;
+
+struct FrameHeader
+{
+    uint8_t version{ kFrameVersion };
+    FrameOp op{ FrameOp::Ok };
+    uint16_t flags{ 0 };
+    uint32_t requestId{ 0 };
+    uint32_t length{ 0 };
+};
+
+// Writes the 12-byte wire form of h to out.
+void EncodeFrameHeader(const FrameHeader &h, char *out);
+
+// Parses 12 bytes; false if the version is unknown or the length exceeds
+// kMaxFramePayload.
+bool DecodeFrameHeader(const char *in, FrameHeader &h);
+
+// Big-endian integer helpers for payloads.
+void PutU32(std::string &out, uint32_t v);
+void PutU64(std::string &out, uint64_t v);
+// Same into a buffer; return the position after the written bytes.
+char *PutU32(char *out, uint32_t v);
+char *PutU64(char *out, uint64_t v);
+uint32_t GetU32(const char *p);
+uint64_t GetU64(const char *p);
+
+// Header + payload as one string (for small replies and deferred replies).
+std::string MakeFrame(FrameOp op, uint16_t flags, uint32_t requestId, std::string_view payload);
+
+// Sends one frame (header and payload gathered into one write).
+int SendFrame(int fd, FrameOp op, uint16_t flags, uint32_t requestId, std::string_view payload);
@@ -0,0 +1,163 @@
+#include "LineReader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+
+namespace
+{
+constexpr size_t kInitialBuffer = 16 * 1024;
+constexpr size_t kMinRead = 4096;
+} // namespace
+
+LineReader::LineReader(int fd, size_t maxLine) : m_fd(fd), m_maxLine(maxLine)
+{
+}
+
+void LineReader::reset(int fd)
+{
+    m_fd = fd;
+    m_start = m_scan = m_end = 0;
+    m_eof = false;
+}
+
+/*
+ * makeRoom()
+ * ----------
+ * Guarantees at least kMinRead free bytes after m_end: rewinds an empty
+ * buffer, slides a partial line to the front, or grows as a last resort.
+ * The buffer is allocated on first use, so idle readers cost nothing.
+ */
+void LineReader::makeRoom()
+{
+    if (m_buf.empty())
+        m_buf.resize(kInitialBuffer);
+
+    if (m_start == m_end)
+    {
+        m_start = m_scan = m_end = 0;
+    }
+    else if (m_buf.size() - m_end < kMinRead && m_start > 0)
+    {
+        std::memmove(m_buf.data(), m_buf.data() + m_start, m_end - m_start);
+        m_scan -= m_start;
+        m_end -= m_start;
+        m_start = 0;
+    }
+
+    if (m_buf.size() - m_end < kMinRead)
+        m_buf.resize(m_buf.size() * 2);
+}
+
+ssize_t LineReader::fill()
+{
+    makeRoom();
+    while (true)
+    {
+        ssize_t n = ::recv(m_fd, m_buf.data() + m_end, m_buf.size() - m_end, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n > 0)
+            m_end += static_cast<size_t>(n);
+        return n;
+    }
+}
+
+bool LineReader::popLine(std::string_view &line)
+{
+    if (m_scan == m_end)
+        return false;
+
+    const char *base = m_buf.data();
+    const void *nl = std::memchr(base + m_scan, '\n', m_end - m_scan);
+    if (!nl)
+    {
+        m_scan = m_end;
+        return false;
+    }
+
+    size_t pos = static_cast<size_t>(static_cast<const char *>(nl) - base);
+    size_t len = pos - m_start;
+    if (len > 0 && base[pos - 1] == '\r')
+        --len;
+    line = std::string_view(base + m_start, len);
+    m_start = m_scan = pos + 1;
+    return true;
+}
+
+bool LineReader::overflow() const
+{
+    return m_scan == m_end && m_end - m_start >= m_maxLine;
+}
+
+bool LineReader::peek(size_t n, std::string_view &out) const
+{
+    if (m_end - m_start < n)
+        return false;
+    out = std::string_view(m_buf.data() + m_start, n);
+    return true;
+}
+
+void LineReader::consume(size_t n)
+{
+    m_start += std::min(n, m_end - m_start);
+    m_scan = std::max(m_scan, m_start);
+}
+
+int LineReader::next(std::string_view &line)
+{
+    while (true)
+    {
+        if (popLine(line))
+            return 1;
+        if (overflow())
+        {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (m_eof)
+            break;
+
+        ssize_t n = fill();
+        if (n > 0)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        m_eof = true;
+    }
+
+    // EOF: hand out a trailing unterminated line once.
+    if (m_start == m_end)
+        return -1;
+    line = std::string_view(m_buf.data() + m_start, m_end - m_start);
+    m_start = m_scan = m_end;
+    return 1;
+}
+
+int LineReader::read(size_t n, std::string &out)
+{
+    size_t take = std::min(n, m_end - m_start);
+    out.append(m_buf.data() + m_start, take);
+    m_start += take;
+    m_scan = std::max(m_scan, m_start);
+    n -= take;
+
+    // Large remainders go straight into the destination string.
+    size_t base = out.size();
+    out.resize(base + n);
+    while (n > 0)
+    {
+        ssize_t got = ::recv(m_fd, &out[base], n, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+        {
+            out.resize(base);
+            return -1;
+        }
+        base += static_cast<size_t>(got);
+        n -= static_cast<size_t>(got);
+    }
+    return 1;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+/*
+ *  LineReader.hpp
+ *  --------------
+ *  Buffered, per-connection reader for the newline-delimited protocols.
+ *
+ *  Data is pulled from the socket with large recv() calls into one
+ *  reusable buffer and lines are located with memchr() (vectorised in
+ *  glibc), instead of one recv() per byte. Lines are returned as
+ *  std::string_view into that buffer: no copy, and no allocation once the
+ *  buffer has grown to its working size. A view stays valid until the
+ *  next call that reads from the socket (fill(), next(), read()).
+ *  Bytes after the last complete line are kept for the next call.
+ *
+ *  Works on blocking descriptors (next()) and inside an event loop on
+ *  non-blocking ones (fill() + popLine()). Length-prefixed frames are
+ *  read from the same buffer with peek() + consume().
+ */
+class LineReader
+{
+  public:
+    explicit LineReader(int fd = -1, size_t maxLine = 8192);
+
+    // Switches to a new descriptor and discards any buffered bytes.
+    void reset(int fd);
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    // Blocking use: returns 1 with the next line (without "\n" / "\r\n"),
+    // 0 if a non-blocking socket has no complete line yet, -1 on EOF, error
+    // or a line longer than maxLine. A final unterminated line before EOF
+    // is still returned.
+    int next(std::string_view &line);
+
+    // Reads exactly n raw bytes (buffered first) and appends them to out.
+    // Returns 1 on success, -1 on EOF or error.
+    int read(size_t n, std::string &out);
+
+    // Event-loop use: one recv() into the buffer. Returns the byte count,
+    // 0 on EOF, -1 on error (errno set; EAGAIN when nothing is ready).
+    ssize_t fill();
+
+    // Extracts the next complete line already buffered, without I/O.
+    bool popLine(std::string_view &line);
+
+    // True when maxLine bytes are buffered without a newline among them.
+    bool overflow() const;
+
+    // Binary framing: view of the first n buffered bytes without consuming
+    // them (false if fewer are buffered), and dropping n consumed bytes.
+    bool peek(size_t n, std::string_view &out) const;
+    void consume(size_t n);
+
+    size_t buffered() const
+    {
+        return m_end - m_start;
+    }
+
+  private:
+    void makeRoom();
+
+    int m_fd;
+    size_t m_maxLine;
+    std::vector<char> m_buf;
+    size_t m_start{ 0 }; // first unconsumed byte
+    size_t m_scan{ 0 };  // bytes before this offset hold no newline
+    size_t m_end{ 0 };   // end of valid data
+    bool m_eof{ false };
+};
@@ -0,0 +1,302 @@
+#include "Logger.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+/*
+ *  Logger.cpp
+ *  ----------
+ *  Bounded MPSC ring (per-slot sequence numbers, after D. Vyukov's
+ *  bounded queue): producers claim a slot with one CAS on m_tail, fill it
+ *  and publish it by storing its sequence number. The single writer
+ *  thread consumes slots in order and hands them back by advancing the
+ *  sequence by one lap.
+ */
+
+std::atomic<uint8_t> Logger::s_level{ static_cast<uint8_t>(LogLevel::Info) };
+
+namespace
+{
+constexpr size_t kMask = Logger::kCapacity - 1;
+constexpr size_t kOutBuffer = 64 * 1024;
+
+const char *LevelTag(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::Trace:
+        return "[TRACE] ";
+    case LogLevel::Debug:
+        return "[DEBUG] ";
+    case LogLevel::Warn:
+        return "[WARN] ";
+    case LogLevel::Error:
+        return "[ERROR] ";
+    default:
+        return "";
+    }
+}
+
+void WriteAll(int fd, const char *p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+}
+
+void FlushAtExit()
+{
+    Logger::instance().flush();
+}
+} // namespace
+
+static_assert((Logger::kCapacity & (Logger::kCapacity - 1)) == 0, "ring capacity must be a power of two");
+
+LogLine &LogLine::operator<<(double v)
+{
+    char tmp[32];
+    int n = std::snprintf(tmp, sizeof tmp, "%g", v);
+    append(tmp, n > 0 ? static_cast<size_t>(n) : 0);
+    return *this;
+}
+
+/*
+ * instance()
+ * ----------
+ * The logger is deliberately never destroyed: detached threads may still
+ * log while static destructors run. Queued messages are flushed at exit().
+ */
+Logger &Logger::instance()
+{
+    static Logger *logger = [] {
+        auto *l = new Logger();
+        std::atexit(FlushAtExit);
+        return l;
+    }();
+    return *logger;
+}
+
+Logger::Logger() : m_slots(new Slot[kCapacity])
+{
+    for (size_t i = 0; i < kCapacity; ++i)
+        m_slots[i].seq.store(i, std::memory_order_relaxed);
+    m_writer = std::thread(&Logger::writerLoop, this);
+}
+
+Logger::~Logger()
+{
+    m_stop = true;
+    {
+        std::lock_guard<std::mutex> lk(m_wakeMutex);
+        m_wakeCv.notify_one();
+    }
+    if (m_writer.joinable())
+        m_writer.join();
+}
+
+bool Logger::parseLevel(std::string_view name, LogLevel &level)
+{
+    static const std::pair<std::string_view, LogLevel> kNames[] = {
+        { "trace", LogLevel::Trace }, { "debug", LogLevel::Debug }, { "info", LogLevel::Info },
+        { "warn", LogLevel::Warn },   { "error", LogLevel::Error }, { "off", LogLevel::Off },
+    };
+    for (const auto &entry : kNames)
+    {
+        if (entry.first == name)
+        {
+            level = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Logger::parseOverflow(std::string_view name, Overflow &policy)
+{
+    if (name == "drop")
+        policy = Overflow::Drop;
+    else if (name == "block")
+        policy = Overflow::Block;
+    else
+        return false;
+    return true;
+}
+
+bool Logger::tryPush(LogLevel level, std::time_t now, const char *text, size_t len)
+{
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &m_slots[pos & kMask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false; // ring full
+        }
+        else
+        {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->time = now;
+    slot->level = level;
+    slot->len = static_cast<uint16_t>(len);
+    std::memcpy(slot->text, text, len);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+/*
+ * submit()
+ * --------
+ * Hot path: a coarse clock read, one CAS and a memcpy. The writer is only
+ * signalled when it has gone idle.
+ */
+void Logger::submit(LogLevel level, const char *text, size_t len)
+{
+    timespec ts{};
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+
+    while (!tryPush(level, ts.tv_sec, text, len))
+    {
+        if (m_overflow.load(std::memory_order_relaxed) == Overflow::Drop)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_wakeMutex);
+            m_wakeCv.notify_one();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    // Pairs with the fence in writerLoop(): either the writer sees this
+    // message before sleeping or we see it idle and wake it.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_writerIdle.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lk(m_wakeMutex);
+        m_wakeCv.notify_one();
+    }
+}
+
+/*
+ * drain()
+ * -------
+ * Writes every published message in two batched write() calls (stdout
+ * and stderr). Returns the number of messages consumed.
+ */
+size_t Logger::drain()
+{
+    static std::time_t cachedSecond = -1;
+    static char stamp[32];
+    static size_t stampLen = 0;
+    static char out[kOutBuffer];
+    static char err[kOutBuffer];
+    size_t outLen = 0, errLen = 0, count = 0;
+
+    auto emit = [&](bool toErr, std::time_t t, const char *tag, const char *text, size_t len) {
+        if (t != cachedSecond)
+        {
+            std::tm tm{};
+            localtime_r(&t, &tm);
+            stampLen = std::strftime(stamp, sizeof stamp, "[%Y-%m-%d %H:%M:%S] ", &tm);
+            cachedSecond = t;
+        }
+        char *buf = toErr ? err : out;
+        size_t &used = toErr ? errLen : outLen;
+        size_t tagLen = std::strlen(tag);
+        if (used + stampLen + tagLen + len + 1 > kOutBuffer)
+        {
+            WriteAll(toErr ? STDERR_FILENO : STDOUT_FILENO, buf, used);
+            used = 0;
+        }
+        std::memcpy(buf + used, stamp, stampLen);
+        used += stampLen;
+        std::memcpy(buf + used, tag, tagLen);
+        used += tagLen;
+        std::memcpy(buf + used, text, len);
+        used += len;
+        buf[used++] = '\n';
+    };
+
+    while (true)
+    {
+        Slot &slot = m_slots[m_head & kMask];
+        if (slot.seq.load(std::memory_order_acquire) != m_head + 1)
+            break;
+        emit(slot.level >= LogLevel::Warn, slot.time, LevelTag(slot.level), slot.text, slot.len);
+        slot.seq.store(m_head + kCapacity, std::memory_order_release);
+        ++m_head;
+        ++count;
+    }
+
+    uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+    {
+        char note[64];
+        int n = std::snprintf(note, sizeof note, "[LOG] %llu messages dropped (ring full)",
+                              static_cast<unsigned long long>(dropped));
+        emit(true, std::time(nullptr), LevelTag(LogLevel::Warn), note, static_cast<size_t>(n));
+    }
+
+    if (outLen > 0)
+        WriteAll(STDOUT_FILENO, out, outLen);
+    if (errLen > 0)
+        WriteAll(STDERR_FILENO, err, errLen);
+    m_written.fetch_add(count, std::memory_order_release);
+    return count;
+}
+
+void Logger::writerLoop()
+{
+    while (true)
+    {
+        if (drain() > 0)
+            continue;
+        if (m_stop.load())
+            return;
+
+        m_writerIdle.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lk(m_wakeMutex);
+            m_wakeCv.wait_for(lk, std::chrono::milliseconds(100), [this] {
+                const Slot &slot = m_slots[m_head & kMask];
+                return m_stop.load() || slot.seq.load(std::memory_order_acquire) == m_head + 1;
+            });
+        }
+        m_writerIdle.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::flush()
+{
+    uint64_t target = m_tail.load(std::memory_order_acquire);
+    {
+        std::lock_guard<std::mutex> lk(m_wakeMutex);
+        m_wakeCv.notify_one();
+    }
+    while (m_written.load(std::memory_order_acquire) < target && m_writer.joinable())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
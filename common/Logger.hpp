@@ -0,0 +1,209 @@
+#pragma once
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+/*
+ *  Logger.hpp
+ *  ----------
+ *  Asynchronous, level-filtered logging for client and server.
+ *
+ *  Call sites use the LOG_* macros with stream syntax:
+ *
+ *      LOG_DEBUG("[NET] TcpConnect(): connected fd=" << fd);
+ *
+ *  - Compile-time filter: levels below CHAT_LOG_COMPILE_LEVEL compile to
+ *    nothing (pass -DCHAT_LOG_COMPILE_LEVEL=2 to strip TRACE/DEBUG).
+ *  - Runtime filter: one relaxed atomic load; the message operands are not
+ *    even evaluated when the level is disabled.
+ *  - The message is formatted into a fixed-size stack buffer (no heap
+ *    allocation) and pushed into a lock-free multi-producer/single-consumer
+ *    ring. Callers never touch stdout, flush, or call localtime_r.
+ *  - A background writer thread drains the ring, prefixes the timestamp
+ *    (formatted at most once per second) and writes in large batches:
+ *    WARN/ERROR to stderr, everything else to stdout.
+ *  - When the ring is full, messages are either dropped (and counted) or
+ *    the producer waits for space, per the configured overflow policy.
+ */
+
+enum class LogLevel : uint8_t
+{
+    Trace = 0,
+    Debug = 1,
+    Info = 2,
+    Warn = 3,
+    Error = 4,
+    Off = 5
+};
+
+#ifndef CHAT_LOG_COMPILE_LEVEL
+#define CHAT_LOG_COMPILE_LEVEL 0
+#endif
+
+constexpr LogLevel kLogCompileLevel = static_cast<LogLevel>(CHAT_LOG_COMPILE_LEVEL);
+
+class Logger
+{
+  public:
+    enum class Overflow
+    {
+        Drop,
+        Block
+    };
+
+    static constexpr size_t kSlotText = 240; // longer messages are truncated
+    static constexpr size_t kCapacity = 8192; // ring slots, power of two
+
+    static Logger &instance();
+
+    static bool enabled(LogLevel level)
+    {
+        return static_cast<uint8_t>(level) >= s_level.load(std::memory_order_relaxed);
+    }
+
+    void setLevel(LogLevel level)
+    {
+        s_level.store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
+    void setOverflow(Overflow policy)
+    {
+        m_overflow.store(policy, std::memory_order_relaxed);
+    }
+
+    // Parses "trace|debug|info|warn|error|off" / "drop|block".
+    static bool parseLevel(std::string_view name, LogLevel &level);
+    static bool parseOverflow(std::string_view name, Overflow &policy);
+
+    // Queues one formatted message (without timestamp or newline).
+    void submit(LogLevel level, const char *text, size_t len);
+
+    // Blocks until everything queued so far has been written.
+    void flush();
+
+    ~Logger();
+
+  private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        std::time_t time;
+        LogLevel level;
+        uint16_t len;
+        char text[kSlotText];
+    };
+
+    Logger();
+    bool tryPush(LogLevel level, std::time_t now, const char *text, size_t len);
+    void writerLoop();
+    size_t drain();
+
+    static std::atomic<uint8_t> s_level;
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<size_t> m_tail{ 0 }; // next slot producers claim
+    alignas(64) size_t m_head{ 0 };              // next slot the writer reads
+    std::atomic<Overflow> m_overflow{ Overflow::Drop };
+    std::atomic<uint64_t> m_dropped{ 0 };
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCv;
+    std::atomic<bool> m_writerIdle{ false };
+    std::atomic<uint64_t> m_written{ 0 }; // messages drained so far
+    std::atomic<bool> m_stop{ false };
+    std::thread m_writer;
+};
+
+/*
+ * LogLine
+ * -------
+ * Stack buffer a single log statement is streamed into; submitted to the
+ * Logger when the statement ends.
+ */
+class LogLine
+{
+  public:
+    explicit LogLine(LogLevel level) : m_level(level)
+    {
+    }
+    ~LogLine()
+    {
+        Logger::instance().submit(m_level, m_buf, m_len);
+    }
+
+    LogLine(const LogLine &) = delete;
+    LogLine &operator=(const LogLine &) = delete;
+
+    LogLine &operator<<(std::string_view s)
+    {
+        append(s.data(), s.size());
+        return *this;
+    }
+    LogLine &operator<<(const char *s)
+    {
+        return *this << std::string_view(s ? s : "(null)");
+    }
+    LogLine &operator<<(const std::string &s)
+    {
+        return *this << std::string_view(s);
+    }
+    LogLine &operator<<(char c)
+    {
+        append(&c, 1);
+        return *this;
+    }
+    LogLine &operator<<(bool b)
+    {
+        return *this << (b ? '1' : '0');
+    }
+    LogLine &operator<<(double v);
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool> &&
+                                                      !std::is_same_v<T, char>>>
+    LogLine &operator<<(T v)
+    {
+        char tmp[24];
+        auto res = std::to_chars(tmp, tmp + sizeof tmp, v);
+        append(tmp, static_cast<size_t>(res.ptr - tmp));
+        return *this;
+    }
+
+  private:
+    void append(const char *s, size_t n)
+    {
+        size_t room = Logger::kSlotText - m_len;
+        if (n > room)
+            n = room;
+        for (size_t i = 0; i < n; ++i)
+            m_buf[m_len + i] = s[i];
+        m_len += n;
+    }
+
+    LogLevel m_level;
+    size_t m_len{ 0 };
+    char m_buf[Logger::kSlotText];
+};
+
+#define CHAT_LOG(level, expr)                                                                                        \
+    do                                                                                                               \
+    {                                                                                                                \
+        if ((level) >= kLogCompileLevel && Logger::enabled(level))                                                  \
+        {                                                                                                            \
+            LogLine chatLogLine_(level);                                                                             \
+            chatLogLine_ << expr;                                                                                    \
+        }                                                                                                            \
+    } while (0)
+
+#define LOG_TRACE(expr) CHAT_LOG(LogLevel::Trace, expr)
+#define LOG_DEBUG(expr) CHAT_LOG(LogLevel::Debug, expr)
+#define LOG_INFO(expr) CHAT_LOG(LogLevel::Info, expr)
+#define LOG_WARN(expr) CHAT_LOG(LogLevel::Warn, expr)
+#define LOG_ERROR(expr) CHAT_LOG(LogLevel::Error, expr)
@@ -0,0 +1,220 @@
+#include "Lz4.hpp"
+#include "Frame.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace
+{
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5; // the format ends every block with literals
+constexpr size_t kMatchStartLimit = 12; // no match may start later than this before the end
+constexpr size_t kMaxOffset = 65535;
+constexpr unsigned kHashLog = 12;
+constexpr uint32_t kNoPosition = UINT32_MAX;
+
+uint32_t Read32(const uint8_t *p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+// Writes the 255-run extension of a length field that hit 15.
+uint8_t *PutLength(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+// Reads a length extension; false if the input ends first.
+bool GetLength(const uint8_t *&ip, const uint8_t *iend, size_t &len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= iend)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+// One sequence: literals [anchor, anchor + litLen), then a match of
+// matchLen (>= kMinMatch) at offset, or no match when matchLen is 0.
+uint8_t *PutSequence(uint8_t *op, const uint8_t *oend, const uint8_t *anchor, size_t litLen, size_t offset,
+                     size_t matchLen)
+{
+    if (static_cast<size_t>(oend - op) < 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1)
+        return nullptr;
+    uint8_t *token = op++;
+    *token = static_cast<uint8_t>((litLen >= 15 ? 15 : litLen) << 4);
+    if (litLen >= 15)
+        op = PutLength(op, litLen - 15);
+    std::memcpy(op, anchor, litLen);
+    op += litLen;
+    if (matchLen == 0)
+        return op;
+
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+    matchLen -= kMinMatch;
+    *token |= static_cast<uint8_t>(matchLen >= 15 ? 15 : matchLen);
+    if (matchLen >= 15)
+        op = PutLength(op, matchLen - 15);
+    return op;
+}
+} // namespace
+
+/*
+ * Lz4Compress()
+ * -------------
+ * Greedy: every position is looked up once in a hash of its first four
+ * bytes, and a confirmed match is extended both ways. After a run of
+ * misses the scan speeds up, so incompressible data costs little.
+ */
+size_t Lz4Compress(const char *src, size_t n, char *dst, size_t cap)
+{
+    const auto *base = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *ip = base;
+    const uint8_t *anchor = base;
+    const uint8_t *const iend = base + n;
+    auto *op = reinterpret_cast<uint8_t *>(dst);
+    const uint8_t *const oend = op + cap;
+
+    if (n > kMatchStartLimit)
+    {
+        thread_local std::array<uint32_t, 1u << kHashLog> table;
+        table.fill(kNoPosition);
+        const uint8_t *const mflimit = iend - kMatchStartLimit;
+        const uint8_t *const matchlimit = iend - kLastLiterals;
+        unsigned misses = 0;
+
+        while (ip <= mflimit)
+        {
+            const uint32_t sequence = Read32(ip);
+            uint32_t &slot = table[Hash(sequence)];
+            const uint32_t ref = slot;
+            slot = static_cast<uint32_t>(ip - base);
+            if (ref == kNoPosition || static_cast<size_t>(ip - base) - ref > kMaxOffset ||
+                Read32(base + ref) != sequence)
+            {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            const uint8_t *match = base + ref;
+            while (ip > anchor && match > base && ip[-1] == match[-1])
+            {
+                --ip;
+                --match;
+            }
+            const uint8_t *const start = ip;
+            const size_t offset = static_cast<size_t>(ip - match);
+            ip += kMinMatch;
+            match += kMinMatch;
+            while (ip < matchlimit && *ip == *match)
+            {
+                ++ip;
+                ++match;
+            }
+
+            op = PutSequence(op, oend, anchor, static_cast<size_t>(start - anchor), offset,
+                             static_cast<size_t>(ip - start));
+            if (!op)
+                return 0;
+            anchor = ip;
+        }
+    }
+
+    op = PutSequence(op, oend, anchor, static_cast<size_t>(iend - anchor), 0, 0);
+    return op ? static_cast<size_t>(op - reinterpret_cast<uint8_t *>(dst)) : 0;
+}
+
+bool Lz4Decompress(const char *src, size_t n, char *dst, size_t rawLen)
+{
+    const auto *ip = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *const iend = ip + n;
+    auto *const obase = reinterpret_cast<uint8_t *>(dst);
+    uint8_t *op = obase;
+    uint8_t *const oend = obase + rawLen;
+
+    while (ip < iend)
+    {
+        const uint8_t token = *ip++;
+        size_t litLen = token >> 4;
+        if (litLen == 15 && !GetLength(ip, iend, litLen))
+            return false;
+        if (litLen > static_cast<size_t>(iend - ip) || litLen > static_cast<size_t>(oend - op))
+            return false;
+        std::memcpy(op, ip, litLen);
+        op += litLen;
+        ip += litLen;
+        if (ip == iend)
+            break; // the last sequence has no match
+
+        if (iend - ip < 2)
+            return false;
+        const size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        size_t matchLen = token & 15;
+        if (matchLen == 15 && !GetLength(ip, iend, matchLen))
+            return false;
+        matchLen += kMinMatch;
+        if (offset == 0 || offset > static_cast<size_t>(op - obase) || matchLen > static_cast<size_t>(oend - op))
+            return false;
+
+        const uint8_t *match = op - offset;
+        if (offset >= matchLen)
+        {
+            std::memcpy(op, match, matchLen);
+            op += matchLen;
+        }
+        else
+        {
+            // Overlapping copy repeats the last `offset` bytes.
+            for (size_t i = 0; i < matchLen; ++i)
+                *op++ = *match++;
+        }
+    }
+    return op == oend;
+}
+
+void AppendCompressedBlock(std::string &out, const char *data, size_t len)
+{
+    const size_t at = out.size();
+    out.resize(at + kCompressedBlockHeader + Lz4CompressBound(len));
+    char *header = &out[at];
+    size_t stored = Lz4Compress(data, len, header + kCompressedBlockHeader, Lz4CompressBound(len));
+    if (stored == 0 || stored >= len)
+    {
+        std::memcpy(header + kCompressedBlockHeader, data, len);
+        stored = len;
+    }
+    PutU32(PutU32(header, static_cast<uint32_t>(len)), static_cast<uint32_t>(stored));
+    out.resize(at + kCompressedBlockHeader + stored);
+}
+
+bool ExpandCompressedBlock(uint32_t rawLen, std::string_view stored, std::string &out)
+{
+    if (stored.size() == rawLen)
+    {
+        out.append(stored.data(), stored.size());
+        return true;
+    }
+    const size_t at = out.size();
+    out.resize(at + rawLen);
+    if (Lz4Decompress(stored.data(), stored.size(), &out[at], rawLen))
+        return true;
+    out.resize(at);
+    return false;
+}
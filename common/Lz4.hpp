@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ *  Lz4.hpp
+ *  -------
+ *  A small, self-contained codec for the LZ4 block format, used to send
+ *  chat history compressed (VIEW ... COMPRESS). Chat text is repetitive
+ *  (timestamps, user names), so a greedy single-probe match finder gets
+ *  most of the gain at a few hundred MB/s; decoding is a tight copy loop.
+ *  The output is standard LZ4 blocks, readable by any LZ4 implementation.
+ *
+ *  Compressed history travels as a sequence of independent blocks:
+ *
+ *      u32 raw length | u32 stored length | stored bytes
+ *
+ *  (big-endian, like frames). A block whose stored length equals its raw
+ *  length is stored as is, since it did not get smaller. Blocks are cut
+ *  at fixed stream offsets, not at record boundaries; a record may span
+ *  two blocks.
+ */
+
+constexpr size_t kCompressedBlockHeader = 8;
+
+// Largest output Lz4Compress() can produce for n input bytes.
+constexpr size_t Lz4CompressBound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+// Compresses n bytes into dst (capacity cap); returns the compressed size,
+// or 0 if it does not fit.
+size_t Lz4Compress(const char *src, size_t n, char *dst, size_t cap);
+
+// Decompresses one block that expands to exactly rawLen bytes into dst.
+// Returns false on malformed input; never reads or writes out of bounds.
+bool Lz4Decompress(const char *src, size_t n, char *dst, size_t rawLen);
+
+// Appends data as one block (header included) to out.
+void AppendCompressedBlock(std::string &out, const char *data, size_t len);
+
+// Appends the rawLen bytes a block expands to; stored is the block after
+// its header. False if the block is malformed.
+bool ExpandCompressedBlock(uint32_t rawLen, std::string_view stored, std::string &out);
@@ -0,0 +1,225 @@
+#include "Metrics.hpp"
+#include "Logger.hpp"
+#include "NetUtils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+size_t MetricShard()
+{
+    static std::atomic<size_t> next{ 0 };
+    thread_local const size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+Metric::Metric(const char *name, const char *help) : m_name(name), m_help(help)
+{
+    MetricsRegistry::instance().add(this);
+}
+
+namespace
+{
+void RenderHeader(std::string &out, const char *name, const char *help, const char *type)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+} // namespace
+
+uint64_t MetricCounter::value() const
+{
+    uint64_t sum = 0;
+    for (const auto &slot : m_slots)
+        sum += slot.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+void MetricCounter::render(std::string &out) const
+{
+    RenderHeader(out, m_name, m_help, "counter");
+    out += m_name;
+    out += ' ' + std::to_string(value()) + '\n';
+}
+
+int64_t MetricGauge::value() const
+{
+    int64_t sum = 0;
+    for (const auto &slot : m_slots)
+        sum += slot.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+void MetricGauge::render(std::string &out) const
+{
+    RenderHeader(out, m_name, m_help, "gauge");
+    out += m_name;
+    out += ' ' + std::to_string(value()) + '\n';
+}
+
+void MetricCounterFn::render(std::string &out) const
+{
+    RenderHeader(out, m_name, m_help, "counter");
+    out += m_name;
+    out += ' ' + std::to_string(m_read()) + '\n';
+}
+
+void MetricGaugeFn::render(std::string &out) const
+{
+    RenderHeader(out, m_name, m_help, "gauge");
+    char line[160];
+    std::snprintf(line, sizeof line, "%s %.15g\n", m_name, m_read());
+    out += line;
+}
+
+const std::array<uint64_t, MetricHistogram::kBounds> MetricHistogram::kBoundsUs = {
+    1,      2,      5,      10,      20,      50,      100,     200,     500,     1000,    2000,
+    5000,   10000,  20000,  50000,   100000,  200000,  500000,  1000000, 2000000, 5000000, 10000000,
+};
+
+void MetricHistogram::observe(std::chrono::nanoseconds elapsed)
+{
+    uint64_t ns = static_cast<uint64_t>(std::max<int64_t>(elapsed.count(), 0));
+    uint64_t us = (ns + 999) / 1000; // bucket "le" bounds are inclusive
+    size_t bucket = static_cast<size_t>(std::lower_bound(kBoundsUs.begin(), kBoundsUs.end(), us) - kBoundsUs.begin());
+    Slot &slot = m_slots[MetricShard()];
+    slot.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    slot.sumNs.fetch_add(ns, std::memory_order_relaxed);
+}
+
+uint64_t MetricHistogram::count() const
+{
+    uint64_t n = 0;
+    for (const auto &slot : m_slots)
+    {
+        for (const auto &bucket : slot.buckets)
+            n += bucket.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void MetricHistogram::render(std::string &out) const
+{
+    std::array<uint64_t, kBounds + 1> counts{};
+    uint64_t sumNs = 0;
+    for (const auto &slot : m_slots)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += slot.buckets[i].load(std::memory_order_relaxed);
+        sumNs += slot.sumNs.load(std::memory_order_relaxed);
+    }
+
+    RenderHeader(out, m_name, m_help, "histogram");
+    char line[160];
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        cumulative += counts[i];
+        if (i < kBounds)
+            std::snprintf(line, sizeof line, "%s_bucket{le=\"%g\"} %" PRIu64 "\n", m_name,
+                          static_cast<double>(kBoundsUs[i]) / 1e6, cumulative);
+        else
+            std::snprintf(line, sizeof line, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", m_name, cumulative);
+        out += line;
+    }
+    std::snprintf(line, sizeof line, "%s_sum %.9f\n%s_count %" PRIu64 "\n", m_name,
+                  static_cast<double>(sumNs) / 1e9, m_name, cumulative);
+    out += line;
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+void MetricsRegistry::add(const Metric *metric)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_metrics.push_back(metric);
+}
+
+std::string MetricsRegistry::render() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    std::string out;
+    for (const Metric *metric : m_metrics)
+        metric->render(out);
+    return out;
+}
+
+namespace
+{
+void ServeMetricsHttp(int listenFd)
+{
+    while (true)
+    {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno != EINTR)
+                LOG_WARN("[METRICS] accept() failed: " << strerror(errno));
+            continue;
+        }
+        // The request itself is not interpreted: every path gets the dump.
+        timeval timeout{ 1, 0 };
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+        char request[4096];
+        ssize_t n = ::recv(fd, request, sizeof request, 0);
+        (void)n;
+
+        std::string body = MetricsRegistry::instance().render();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        SendAll(fd, response.data(), response.size());
+        ::close(fd);
+    }
+}
+
+void WriteMetricsFile(const std::string &file, int intervalS)
+{
+    const std::string tmp = file + ".tmp";
+    while (true)
+    {
+        std::string body = MetricsRegistry::instance().render();
+        FILE *f = std::fopen(tmp.c_str(), "w");
+        bool ok = f && std::fwrite(body.data(), 1, body.size(), f) == body.size();
+        if (f && std::fclose(f) != 0)
+            ok = false;
+        if (!ok || std::rename(tmp.c_str(), file.c_str()) != 0)
+            LOG_WARN("[METRICS] Cannot write " << file << ": " << strerror(errno));
+        std::this_thread::sleep_for(std::chrono::seconds(intervalS));
+    }
+}
+} // namespace
+
+bool StartMetricsExporter(const std::string &listenAddr, const std::string &file, int intervalS)
+{
+    if (!listenAddr.empty())
+    {
+        int listenFd = TcpListen(listenAddr);
+        if (listenFd < 0)
+        {
+            LOG_ERROR("[METRICS] Cannot listen on " << listenAddr);
+            return false;
+        }
+        std::thread(ServeMetricsHttp, listenFd).detach();
+        LOG_INFO("[METRICS] Serving metrics on http://" << listenAddr << "/metrics");
+    }
+    if (!file.empty())
+        std::thread(WriteMetricsFile, file, std::max(intervalS, 1)).detach();
+    return true;
+}
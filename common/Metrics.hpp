@@ -0,0 +1,187 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ *  Metrics.hpp
+ *  -----------
+ *  Low-overhead process metrics for client and server.
+ *
+ *  Metrics are defined once, at namespace scope, where they are updated:
+ *
+ *      static MetricCounter g_views("chat_view_requests_total", "VIEW commands served");
+ *      g_views.add();
+ *
+ *  Recording never takes a lock. Every metric keeps kMetricShards
+ *  cache-line sized slots and a thread always updates "its" slot with a
+ *  relaxed atomic add, so threads on different cores do not bounce a
+ *  shared line. Reading (STATS, the exporter) sums the slots; the sum is
+ *  not a snapshot across metrics, which is fine for monitoring.
+ *
+ *  Histograms have fixed buckets (1 µs to 10 s, 1-2-5 steps) and are
+ *  rendered in Prometheus text format, with values in seconds.
+ */
+
+constexpr size_t kMetricShards = 16;
+
+// Slot of the calling thread; assigned round-robin on first use.
+size_t MetricShard();
+
+class Metric
+{
+  public:
+    Metric(const char *name, const char *help);
+    virtual ~Metric() = default;
+
+    Metric(const Metric &) = delete;
+    Metric &operator=(const Metric &) = delete;
+
+    // Appends "# HELP", "# TYPE" and the sample line(s) to out.
+    virtual void render(std::string &out) const = 0;
+
+  protected:
+    const char *const m_name;
+    const char *const m_help;
+};
+
+class MetricCounter : public Metric
+{
+  public:
+    MetricCounter(const char *name, const char *help) : Metric(name, help)
+    {
+    }
+
+    void add(uint64_t n = 1)
+    {
+        m_slots[MetricShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+    void render(std::string &out) const override;
+
+  private:
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> value{ 0 };
+    };
+    std::array<Slot, kMetricShards> m_slots;
+};
+
+class MetricGauge : public Metric
+{
+  public:
+    MetricGauge(const char *name, const char *help) : Metric(name, help)
+    {
+    }
+
+    void add(int64_t n = 1)
+    {
+        m_slots[MetricShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+    void sub(int64_t n = 1)
+    {
+        add(-n);
+    }
+    int64_t value() const;
+    void render(std::string &out) const override;
+
+  private:
+    struct alignas(64) Slot
+    {
+        std::atomic<int64_t> value{ 0 };
+    };
+    std::array<Slot, kMetricShards> m_slots;
+};
+
+// A counter kept elsewhere, e.g. by code that runs before static metrics
+// are constructed; read() is called on every render.
+class MetricCounterFn : public Metric
+{
+  public:
+    MetricCounterFn(const char *name, const char *help, uint64_t (*read)()) : Metric(name, help), m_read(read)
+    {
+    }
+
+    void render(std::string &out) const override;
+
+  private:
+    uint64_t (*const m_read)();
+};
+
+// A gauge computed on every render, e.g. from state owned by one object.
+class MetricGaugeFn : public Metric
+{
+  public:
+    MetricGaugeFn(const char *name, const char *help, double (*read)()) : Metric(name, help), m_read(read)
+    {
+    }
+
+    void render(std::string &out) const override;
+
+  private:
+    double (*const m_read)();
+};
+
+class MetricHistogram : public Metric
+{
+  public:
+    // Upper bounds in microseconds: 1, 2, 5, 10, ... 5 s, 10 s (+Inf after).
+    static constexpr size_t kBounds = 22;
+    static const std::array<uint64_t, kBounds> kBoundsUs;
+
+    MetricHistogram(const char *name, const char *help) : Metric(name, help)
+    {
+    }
+
+    void observe(std::chrono::nanoseconds elapsed);
+    void observeSince(std::chrono::steady_clock::time_point start)
+    {
+        observe(std::chrono::steady_clock::now() - start);
+    }
+    uint64_t count() const;
+    void render(std::string &out) const override;
+
+  private:
+    struct alignas(64) Slot
+    {
+        std::array<std::atomic<uint64_t>, kBounds + 1> buckets{}; // last: above every bound
+        std::atomic<uint64_t> sumNs{ 0 };
+    };
+    std::array<Slot, kMetricShards> m_slots;
+};
+
+/*
+ * MetricsRegistry
+ * ---------------
+ * Every metric registers itself on construction. The mutex guards only
+ * the list (registration at startup, rendering); never the hot path.
+ */
+class MetricsRegistry
+{
+  public:
+    static MetricsRegistry &instance();
+
+    void add(const Metric *metric);
+    // Every metric in Prometheus text exposition format.
+    std::string render() const;
+
+  private:
+    mutable std::mutex m_mutex;
+    std::vector<const Metric *> m_metrics;
+};
+
+/*
+ * StartMetricsExporter()
+ * ----------------------
+ * Background thread that publishes MetricsRegistry::render():
+ *  - listenAddr "host:port": answers every HTTP request on it (e.g. a
+ *    Prometheus scrape of /metrics) with the current dump;
+ *  - file: rewritten atomically (temp file + rename) every intervalS s.
+ * Either may be empty. Returns false if the listener cannot be opened.
+ */
+bool StartMetricsExporter(const std::string &listenAddr, const std::string &file, int intervalS);
@@ -1,12 +1,15 @@
 #include <algorithm>
-#include <iostream>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <string.h>
 #include <string>
 #include <sys/socket.h>
 #include <unistd.h>
 
-#include "../debug.hpp"
+#include "Logger.hpp"
 #include "NetUtils.hpp"
 
 /*
@@ -16,10 +19,12 @@
  *   - TcpListen(host:port)     → create listening socket
  *   - TcpConnect(host, port)   → connect to remote host
  *   - TcpConnectHostPort()     → same, single string "host:port"
- *   - RecvLine()               → read one newline-terminated line
+ *   - TcpConnectStart/Finish() → non-blocking connect, awaited with poll()
+ *   - SendVec() / SendVecOnce() → gathered writes from iovecs
  *   - SendAll() / SendLine()   → send data or full line
  *
- *  These wrappers are deliberately minimalist and portable.
+ *  These wrappers are deliberately minimalist and portable. Reading is
+ *  done through LineReader (LineReader.hpp), which buffers large recv()s.
  */
 
 namespace
@@ -32,14 +37,13 @@ void SplitHostPort(const std::string &hostPort, std::string &host, std::string &
     {
         host = hostPort;
         port.clear();
-        std::cout << Timestamp() << " [NET] SplitHostPort(): no ':' found, host=" << host << ", port=<empty>"
-                  << std::endl;
+        LOG_TRACE("[NET] SplitHostPort(): no ':' found, host=" << host << ", port=<empty>");
     }
     else
     {
         host = hostPort.substr(0, pos);
         port = hostPort.substr(pos + 1);
-        std::cout << Timestamp() << " [NET] SplitHostPort(): host=" << host << ", port=" << port << std::endl;
+        LOG_TRACE("[NET] SplitHostPort(): host=" << host << ", port=" << port);
     }
 }
 } // namespace
@@ -52,7 +56,7 @@ void SplitHostPort(const std::string &hostPort, std::string &host, std::string &
  */
 int TcpListen(const std::string &hostPort)
 {
-    std::cout << Timestamp() << " [NET] TcpListen() called with hostPort=" << hostPort << std::endl;
+    LOG_DEBUG("[NET] TcpListen() called with hostPort=" << hostPort);
 
     std::string host, port;
     SplitHostPort(hostPort, host, port);
@@ -68,20 +72,20 @@ int TcpListen(const std::string &hostPort)
     int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
     if (ret != 0)
     {
-        std::cerr << Timestamp() << " [NET] getaddrinfo() failed: " << gai_strerror(ret) << std::endl;
+        LOG_ERROR("[NET] getaddrinfo() failed: " << gai_strerror(ret));
         return -1;
     }
 
     int listenFd = -1;
     for (auto *rp = result; rp; rp = rp->ai_next)
     {
-        std::cout << Timestamp() << " [NET] Creating socket: family=" << rp->ai_family
-                  << ", socktype=" << rp->ai_socktype << ", protocol=" << rp->ai_protocol << std::endl;
+        LOG_TRACE("[NET] Creating socket: family=" << rp->ai_family
+                  << ", socktype=" << rp->ai_socktype << ", protocol=" << rp->ai_protocol);
 
         listenFd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
         if (listenFd < 0)
         {
-            std::cerr << Timestamp() << " [NET] socket() failed: " << strerror(errno) << std::endl;
+            LOG_WARN("[NET] socket() failed: " << strerror(errno));
             continue;
         }
 
@@ -90,15 +94,14 @@ int TcpListen(const std::string &hostPort)
 #ifdef SO_REUSEPORT
         setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
 #endif
-        std::cout << Timestamp() << " [NET] Attempting bind() and listen() on socket fd=" << listenFd << std::endl;
-        if (bind(listenFd, rp->ai_addr, rp->ai_addrlen) == 0 && listen(listenFd, 64) == 0)
+        LOG_TRACE("[NET] Attempting bind() and listen() on socket fd=" << listenFd);
+        if (bind(listenFd, rp->ai_addr, rp->ai_addrlen) == 0 && listen(listenFd, SOMAXCONN) == 0)
         {
-            std::cout << Timestamp() << " [NET] TcpListen(): Successfully bound and listening on fd=" << listenFd
-                      << std::endl;
+            LOG_INFO("[NET] TcpListen(): Successfully bound and listening on fd=" << listenFd);
             break;
         }
 
-        std::cerr << Timestamp() << " [NET] bind()/listen() failed: " << strerror(errno) << std::endl;
+        LOG_WARN("[NET] bind()/listen() failed: " << strerror(errno));
         close(listenFd);
         listenFd = -1;
     }
@@ -125,7 +128,7 @@ int TcpConnect(const std::string &host, const std::string &port)
     int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
     if (ret != 0)
     {
-        std::cerr << Timestamp() << " [NET] getaddrinfo() failed: " << gai_strerror(ret) << std::endl;
+        LOG_ERROR("[NET] getaddrinfo() failed: " << gai_strerror(ret));
         return -1;
     }
 
@@ -135,14 +138,14 @@ int TcpConnect(const std::string &host, const std::string &port)
         sockFd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
         if (sockFd < 0)
         {
-            std::cerr << Timestamp() << " [NET] socket() failed: " << strerror(errno) << std::endl;
+            LOG_WARN("[NET] socket() failed: " << strerror(errno));
             continue;
         }
 
-        std::cout << Timestamp() << " [NET] Attempting connect()" << std::endl;
+        LOG_TRACE("[NET] Attempting connect()");
         if (connect(sockFd, rp->ai_addr, rp->ai_addrlen) == 0)
         {
-            std::cout << Timestamp() << " [NET] TcpConnect(): successfully connected" << std::endl;
+            LOG_DEBUG("[NET] TcpConnect(): successfully connected");
             break;
         }
 
@@ -161,7 +164,7 @@ int TcpConnect(const std::string &host, const std::string &port)
  */
 int TcpConnectHostPort(const std::string &hostPort)
 {
-    std::cout << Timestamp() << " [NET] TcpConnectHostPort() input: " << hostPort << std::endl;
+    LOG_DEBUG("[NET] TcpConnectHostPort() input: " << hostPort);
     std::string host, port;
     SplitHostPort(hostPort, host, port);
     int fd = TcpConnect(host, port);
@@ -169,76 +172,161 @@ int TcpConnectHostPort(const std::string &hostPort)
 }
 
 /*
- * RecvLine()
- * ----------
- * Reads a single '\n'-terminated line from the socket.
- * The returned string includes the newline character.
- * Returns number of bytes read, or -1 on error/EOF.
+ * TcpConnectStart()
+ * -----------------
+ * Starts a connect() without waiting for it, so one thread can have
+ * connects to many hosts in flight. Name resolution still blocks, which is
+ * immediate for the numeric addresses used here.
  */
-int RecvLine(int fd, std::string &out, size_t max)
+int TcpConnectStart(const std::string &hostPort)
 {
-    out.clear();
-    char ch;
-    while (out.size() + 1 < max)
+    std::string host, port;
+    SplitHostPort(hostPort, host, port);
+
+    struct addrinfo hints
     {
-        ssize_t n = ::recv(fd, &ch, 1, 0);
-        if (n <= 0)
-        {
-            std::cerr << Timestamp() << " [NET] recv() returned " << n << std::endl;
-            return out.empty() ? -1 : static_cast<int>(out.size());
-        }
+    };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
 
-        out.push_back(ch);
-        if (ch == '\n')
-        {
-            break;
-        }
+    struct addrinfo *result = nullptr;
+    int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+    if (ret != 0)
+    {
+        LOG_ERROR("[NET] getaddrinfo() failed: " << gai_strerror(ret));
+        return -1;
     }
 
-    return static_cast<int>(out.size());
+    int sockFd = socket(result->ai_family, result->ai_socktype | SOCK_NONBLOCK, result->ai_protocol);
+    if (sockFd >= 0 && connect(sockFd, result->ai_addr, result->ai_addrlen) != 0 && errno != EINPROGRESS)
+    {
+        close(sockFd);
+        sockFd = -1;
+    }
+    freeaddrinfo(result);
+    return sockFd;
 }
 
 /*
- * SendAll()
+ * TcpConnectFinish()
+ * ------------------
+ * Outcome of a connect started by TcpConnectStart(), once poll() reported
+ * the socket writable.
+ */
+int TcpConnectFinish(int fd)
+{
+    int err = 0;
+    socklen_t len = sizeof err;
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+        return -1;
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK) == 0 ? 0 : -1;
+}
+
+/*
+ * SendVecOnce()
+ * -------------
+ * Single gathered write; the caller decides what to do with a short count
+ * or EAGAIN (the reactor re-arms EPOLLOUT, SendVec() polls).
+ */
+ssize_t SendVecOnce(int fd, const iovec *iov, int iovcnt)
+{
+    msghdr msg{};
+    msg.msg_iov = const_cast<iovec *>(iov);
+    msg.msg_iovlen = static_cast<size_t>(iovcnt);
+    while (true)
+    {
+        ssize_t n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        return n;
+    }
+}
+
+/*
+ * SendVec()
  * ---------
- * Sends the entire buffer over the socket, retrying if necessary.
+ * Sends all iovecs, resuming after partial writes by skipping the fully
+ * written entries and trimming the first partial one in place. Nothing is
+ * copied; on a non-blocking socket it waits in poll() until writable.
  * Returns 0 on success, -1 on error.
  */
-int SendAll(int fd, const void *buf, size_t len)
+int SendVec(int fd, iovec *iov, int iovcnt)
 {
-    const char *ptr = static_cast<const char *>(buf);
-    size_t totalSent = 0;
-
-    std::string message(ptr, len);
-    std::cout << Timestamp() << " [NET][SEND] " << message << std::endl;
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        total += iov[i].iov_len;
 
-    while (totalSent < len)
+    while (iovcnt > 0)
     {
-        ssize_t n = ::send(fd, ptr + totalSent, len - totalSent, 0);
-        if (n <= 0)
+        if (iov->iov_len == 0)
+        {
+            ++iov;
+            --iovcnt;
+            continue;
+        }
+
+        ssize_t n = SendVecOnce(fd, iov, std::min(iovcnt, IOV_MAX));
+        if (n < 0)
         {
-            std::cerr << Timestamp() << " [NET][ERROR] send() failed: " << strerror(errno) << std::endl;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pollfd pfd{ fd, POLLOUT, 0 };
+                if (::poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                    continue;
+            }
+            LOG_ERROR("[NET] send() failed: " << strerror(errno));
             return -1;
         }
-        totalSent += static_cast<size_t>(n);
+
+        size_t done = static_cast<size_t>(n);
+        while (iovcnt > 0 && done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
     }
 
+    LOG_TRACE("[NET][SEND] fd=" << fd << " " << total << " bytes");
     return 0;
 }
 
+/*
+ * SendAll()
+ * ---------
+ * Sends the entire buffer over the socket, retrying if necessary.
+ * Returns 0 on success, -1 on error.
+ */
+int SendAll(int fd, const void *buf, size_t len)
+{
+    iovec iov{ const_cast<void *>(buf), len };
+    return SendVec(fd, &iov, 1);
+}
+
 /*
  * SendLine()
  * ----------
- * Sends a string as a complete line, ensuring a trailing newline.
+ * Sends head and body as a complete line, ensuring a trailing newline.
  */
-int SendLine(int fd, const std::string &line)
+int SendLine(int fd, std::string_view head, std::string_view body)
 {
-    std::string msg = line;
-    if (msg.empty() || msg.back() != '\n')
-    {
-        msg.push_back('\n');
-    }
-    int result = SendAll(fd, msg.data(), msg.size());
-    std::cout << Timestamp() << " [NET] SendLine(): sent " << msg.size() << " bytes, result=" << result << std::endl;
-    return result;
+    std::string_view last = body.empty() ? head : body;
+    bool terminated = !last.empty() && last.back() == '\n';
+
+    iovec iov[3] = {
+        { const_cast<char *>(head.data()), head.size() },
+        { const_cast<char *>(body.data()), body.size() },
+        { const_cast<char *>("\n"), terminated ? 0u : 1u },
+    };
+    return SendVec(fd, iov, 3);
 }
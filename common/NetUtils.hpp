@@ -1,9 +1,31 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 int TcpListen(const std::string &hostPort);
 int TcpConnect(const std::string &host, const std::string &port);
 int TcpConnectHostPort(const std::string &hostPort);
-int RecvLine(int fd, std::string &out, size_t max = 8192);
+
+// Non-blocking connect: returns a non-blocking socket whose connect() to
+// the first address of hostPort is under way (or already done), or -1.
+// Wait for POLLOUT, then TcpConnectFinish() returns 0 and makes the socket
+// blocking again, or returns -1 with errno set and the caller closes it.
+int TcpConnectStart(const std::string &hostPort);
+int TcpConnectFinish(int fd);
+
+// One sendmsg() of the iovecs (MSG_NOSIGNAL, retried on EINTR). Returns the
+// bytes sent, or -1 with errno set (EAGAIN when a non-blocking socket is full).
+ssize_t SendVecOnce(int fd, const iovec *iov, int iovcnt);
+
+// Sends every byte described by iov, advancing over partial writes (iov is
+// modified). Waits for POLLOUT when a non-blocking socket is full.
+// Returns 0 on success, -1 on error.
+int SendVec(int fd, iovec *iov, int iovcnt);
+
 int SendAll(int fd, const void *buf, size_t len);
-int SendLine(int fd, const std::string &line);
+
+// Sends head + body followed by '\n' (unless already terminated) as one
+// gathered write, without building the line in a temporary string.
+int SendLine(int fd, std::string_view head, std::string_view body = {});
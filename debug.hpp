@@ -1,24 +1,24 @@
 #ifndef DEBUG_HPP
 #define DEBUG_HPP
 
-#include <chrono>
 #include <ctime>
-#include <iomanip>
-#include <sstream>
-#include <string>
 
 // Returns a formatted timestamp string in the format: [YYYY-MM-DD HH:MM:SS]
-inline std::string Timestamp()
+// The string is cached per thread and only reformatted when the second changes.
+inline const char *Timestamp()
 {
-    using namespace std::chrono;
-    auto now = system_clock::now();
-    std::time_t t = system_clock::to_time_t(now);
-    std::tm tm{};
-    localtime_r(&t, &tm);
+    thread_local std::time_t cachedSecond = -1;
+    thread_local char stamp[32];
 
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "[%Y-%m-%d %H:%M:%S]");
-    return oss.str();
+    std::time_t t = std::time(nullptr);
+    if (t != cachedSecond)
+    {
+        std::tm tm{};
+        localtime_r(&t, &tm);
+        std::strftime(stamp, sizeof stamp, "[%Y-%m-%d %H:%M:%S]", &tm);
+        cachedSecond = t;
+    }
+    return stamp;
 }
 
 #endif // DEBUG_HPP
@@ -0,0 +1,170 @@
+#include "AllocCounter.hpp"
+#include "../common/Metrics.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// Constant-initialised, so allocations made during static initialisation
+// (before any Metric object exists) are counted too.
+struct alignas(64) AllocSlot
+{
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> exempt{ 0 };
+};
+AllocSlot g_allocSlots[kMetricShards];
+
+void Count()
+{
+    AllocSlot &slot = g_allocSlots[MetricShard()];
+    slot.count.fetch_add(1, std::memory_order_relaxed);
+    if (t_allocExemptDepth > 0)
+        slot.exempt.fetch_add(1, std::memory_order_relaxed);
+}
+
+void *CountedAlloc(size_t size) noexcept
+{
+    Count();
+    return std::malloc(size ? size : 1);
+}
+
+void *CountedAlignedAlloc(size_t size, std::align_val_t align) noexcept
+{
+    Count();
+    // aligned_alloc() wants a multiple of the alignment (a power of two).
+    const size_t a = static_cast<size_t>(align);
+    return std::aligned_alloc(a, ((size ? size : 1) + a - 1) & ~(a - 1));
+}
+
+uint64_t Sum(std::atomic<uint64_t> AllocSlot::*field)
+{
+    uint64_t sum = 0;
+    for (const auto &slot : g_allocSlots)
+        sum += (slot.*field).load(std::memory_order_relaxed);
+    return sum;
+}
+
+MetricCounterFn g_heapAllocations("chat_heap_allocations_total", "Heap allocations (operator new calls) made so far",
+                                  HeapAllocations);
+MetricCounterFn g_exemptHeapAllocations("chat_heap_allocations_exempt_total",
+                                        "Heap allocations made outside the request path (storage growth, STATS)",
+                                        ExemptHeapAllocations);
+} // namespace
+
+uint64_t HeapAllocations()
+{
+    return Sum(&AllocSlot::count);
+}
+
+uint64_t ExemptHeapAllocations()
+{
+    return Sum(&AllocSlot::exempt);
+}
+
+void *operator new(size_t size)
+{
+    if (void *p = CountedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return CountedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return CountedAlloc(size);
+}
+
+void *operator new(size_t size, std::align_val_t align)
+{
+    if (void *p = CountedAlignedAlloc(size, align))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return CountedAlignedAlloc(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return CountedAlignedAlloc(size, align);
+}
+
+// Every block above comes from malloc() or aligned_alloc(), so every
+// delete is free().
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    std::free(p);
+}
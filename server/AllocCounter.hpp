@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+
+/*
+ *  AllocCounter.hpp
+ *  ----------------
+ *  Counts every heap allocation the server makes. The server replaces the
+ *  global operator new with one that bumps a per-thread slot (the same
+ *  sharding as Metrics.hpp) before calling malloc(); the total is exported
+ *  as chat_heap_allocations_total.
+ *
+ *  This is the check for the allocation-free request path: take STATS
+ *  (or a scrape) before and after a steady-state load and divide the
+ *  difference by the requests served. chatbench does exactly that when
+ *  the server exports the counter, and `chatbench --check-allocs N`
+ *  fails unless the request path made no allocation at all.
+ *
+ *  Work that allocates by design but not per request runs inside an
+ *  AllocExemption: growing the history's storage (a new cache block, a
+ *  larger segment index, a new segment) and rendering STATS. Those
+ *  allocations are counted again as chat_heap_allocations_exempt_total,
+ *  so the request path is the difference of the two counters.
+ *
+ *  Every replaceable operator new is counted: plain, array, nothrow and
+ *  over-aligned (std::align_val_t).
+ */
+
+// Allocations since the process started.
+uint64_t HeapAllocations();
+
+// Allocations made inside an AllocExemption (also in HeapAllocations()).
+uint64_t ExemptHeapAllocations();
+
+// Exemption depth of this thread. Header-only, so code shared with tools
+// that do not count allocations (chatexport) can mark its scopes too.
+inline thread_local unsigned t_allocExemptDepth = 0;
+
+/*
+ * Marks the allocations of the current thread, for its lifetime, as not
+ * belonging to the request path. Scopes nest.
+ */
+class AllocExemption
+{
+  public:
+    AllocExemption()
+    {
+        ++t_allocExemptDepth;
+    }
+    ~AllocExemption()
+    {
+        --t_allocExemptDepth;
+    }
+    AllocExemption(const AllocExemption &) = delete;
+    AllocExemption &operator=(const AllocExemption &) = delete;
+};
@@ -0,0 +1,68 @@
+#include "../common/Logger.hpp"
+#include "ChatLog.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+/*
+ *  ChatExport.cpp
+ *  --------------
+ *  Writes a segmented chat log back out in the original plain text format,
+ *  one "message\n" line per record, archived segments included:
+ *
+ *      chatexport --file ./chat.txt [--out chat-export.txt] [--since SEQ]
+ *
+ *  Reads the segment files directly, so it can run next to a live server.
+ *  Records failing their CRC check are skipped and reported.
+ */
+int main(int argc, char **argv)
+{
+    std::string file = "./chat.txt";
+    std::string outPath;
+    uint64_t sinceSeq = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--file") && i + 1 < argc)
+            file = argv[++i];
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc)
+            outPath = argv[++i];
+        else if (!strcmp(argv[i], "--since") && i + 1 < argc)
+            sinceSeq = std::strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            LOG_ERROR("usage: chatexport [--file path] [--out path] [--since seq]");
+            return 2;
+        }
+    }
+
+    int outFd = STDOUT_FILENO;
+    if (!outPath.empty())
+    {
+        outFd = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (outFd < 0)
+        {
+            LOG_ERROR("[EXPORT] open(" << outPath << ") failed: " << strerror(errno));
+            return 1;
+        }
+    }
+
+    uint64_t bad = 0;
+    int64_t written = ChatLog::exportText(file, outFd, sinceSeq, bad);
+    if (written < 0)
+    {
+        LOG_ERROR("[EXPORT] Export of " << file << " failed: " << strerror(errno));
+        return 1;
+    }
+    if (bad > 0)
+        LOG_WARN("[EXPORT] Skipped " << bad << " record(s) failing their CRC check");
+    if (outFd != STDOUT_FILENO) // INFO goes to stdout, which may hold the export
+    {
+        LOG_INFO("[EXPORT] " << written << " record(s) written to " << outPath);
+        ::close(outFd);
+    }
+    return bad > 0 ? 3 : 0;
+}
@@ -0,0 +1,969 @@
+#include "ChatLog.hpp"
+#include "AllocCounter.hpp"
+#include "Crc32c.hpp"
+#include "../common/Logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr size_t kScanChunk = 64 * 1024;
+constexpr size_t kImportChunk = 1024 * 1024;
+constexpr size_t kExportChunk = 1024 * 1024;
+
+// One record in a segment's .idx file (native endian).
+struct IndexEntry
+{
+    uint32_t offset; // start of the record in the segment's .log
+    uint32_t crc;    // CRC-32C of the record, newline included
+};
+static_assert(sizeof(IndexEntry) == 8, "index entries are 8 bytes on disk");
+
+// write() the whole buffer, retrying on short writes and EINTR.
+bool WriteFully(int fd, const void *buf, size_t len)
+{
+    const char *p = static_cast<const char *>(buf);
+    while (len > 0)
+    {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// pread() exactly len bytes at offset; returns false on error or short file.
+bool ReadFully(int fd, void *buf, size_t len, uint64_t offset)
+{
+    char *p = static_cast<char *>(buf);
+    while (len > 0)
+    {
+        ssize_t n = ::pread(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+uint64_t FileSize(int fd)
+{
+    struct stat st
+    {
+    };
+    return ::fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+std::string SegmentFile(const std::string &dir, uint64_t baseSeq, const char *ext)
+{
+    char name[32];
+    std::snprintf(name, sizeof name, "/%020llu%s", static_cast<unsigned long long>(baseSeq), ext);
+    return dir + name;
+}
+
+// Base sequence numbers of the "<20 digits>.log" files in dir, ascending.
+std::vector<uint64_t> ListSegments(const std::string &dir)
+{
+    std::vector<uint64_t> bases;
+    DIR *d = ::opendir(dir.c_str());
+    if (!d)
+        return bases;
+    while (dirent *e = ::readdir(d))
+    {
+        size_t len = std::strlen(e->d_name);
+        uint64_t base = 0;
+        if (len != 24 || std::strcmp(e->d_name + 20, ".log") != 0)
+            continue;
+        auto res = std::from_chars(e->d_name, e->d_name + 20, base);
+        if (res.ec == std::errc() && res.ptr == e->d_name + 20 && base > 0)
+            bases.push_back(base);
+    }
+    ::closedir(d);
+    std::sort(bases.begin(), bases.end());
+    return bases;
+}
+
+void SyncDir(const std::string &dir)
+{
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Reads a whole .idx file; a missing or unreadable file yields no entries.
+std::vector<IndexEntry> ReadIndex(int fd)
+{
+    std::vector<IndexEntry> entries(static_cast<size_t>(FileSize(fd) / sizeof(IndexEntry)));
+    if (!entries.empty() && !ReadFully(fd, entries.data(), entries.size() * sizeof(IndexEntry), 0))
+        entries.clear();
+    return entries;
+}
+
+/*
+ * ScanRecords()
+ * -------------
+ * Walks the newline-terminated records in the first `size` bytes of a
+ * segment file, calling onRecord(offset, record, crc) for each until it
+ * returns false. Returns where the scan stopped: the start of the record
+ * that was refused, or the end of the last complete one (bytes after it
+ * are a torn write). Returns -1 on a read error.
+ */
+template <typename OnRecord>
+int64_t ScanRecords(int fd, uint64_t size, OnRecord &&onRecord)
+{
+    std::string chunk(kScanChunk, '\0');
+    std::string carry; // start of a record that spans chunks
+    uint64_t recordStart = 0;
+
+    for (uint64_t pos = 0; pos < size;)
+    {
+        size_t len = static_cast<size_t>(std::min<uint64_t>(kScanChunk, size - pos));
+        if (!ReadFully(fd, &chunk[0], len, pos))
+            return -1;
+
+        for (size_t i = 0; i < len;)
+        {
+            const void *nl = std::memchr(&chunk[i], '\n', len - i);
+            if (!nl)
+            {
+                carry.append(&chunk[i], len - i);
+                break;
+            }
+            size_t upto = static_cast<size_t>(static_cast<const char *>(nl) - chunk.data()) + 1;
+            std::string_view record(&chunk[i], upto - i);
+            if (!carry.empty())
+            {
+                carry.append(record);
+                record = carry;
+            }
+            if (!onRecord(recordStart, record, Crc32c(record.data(), record.size())))
+                return static_cast<int64_t>(recordStart);
+            recordStart = pos + upto;
+            carry.clear();
+            i = upto;
+        }
+        pos += len;
+    }
+    return static_cast<int64_t>(recordStart);
+}
+} // namespace
+
+/*
+ * Segment
+ * -------
+ * One data file and its index. Shared with slices (FileRange::pin), so
+ * the descriptor stays open while queued data still refers to it.
+ */
+struct ChatLog::Segment
+{
+    uint64_t baseSeq{ 1 };    // sequence number of the first record
+    uint64_t baseOffset{ 0 }; // stream offset of the first byte
+    uint64_t size{ 0 };       // bytes in the data file
+    uint64_t count{ 0 };      // records
+    int fd{ -1 };             // data file; O_APPEND while this is the tail
+    int idxFd{ -1 };          // index file, open while this is the tail
+    bool loaded{ false };     // `index` holds all `count` entries
+    std::vector<IndexEntry> index;
+
+    ~Segment()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        if (idxFd >= 0)
+            ::close(idxFd);
+    }
+};
+
+ChatLog::~ChatLog()
+{
+    if (m_syncThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lk(m_syncMutex);
+            m_stopSync = true;
+        }
+        m_syncCv.notify_all();
+        m_syncThread.join();
+    }
+}
+
+void ChatLog::setDurability(Durability mode, std::chrono::microseconds window, size_t maxBatch)
+{
+    m_durability = mode;
+    m_groupWindow = window;
+    m_groupMax = std::max<size_t>(maxBatch, 1);
+}
+
+void ChatLog::setSegments(uint64_t segmentBytes, size_t retainSegments)
+{
+    // Index entries hold 32-bit offsets.
+    m_segmentBytes = std::clamp<uint64_t>(segmentBytes, 64 * 1024, 1u << 30);
+    m_retainSegments = retainSegments;
+}
+
+/*
+ * open()
+ * ------
+ * Opens the segments, recovers the tail and warms the cache. Only the
+ * tail segment is read; its size is bounded by the segment size, so
+ * restart cost does not grow with the history.
+ */
+bool ChatLog::open(const std::string &path, size_t cacheBytes)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_path = path;
+    m_dir = path + ".segments";
+    m_cache.setCapacity(cacheBytes);
+
+    if (!openSegments() || !warmCache())
+        return false;
+
+    if (m_durability == Durability::Group)
+        m_syncThread = std::thread(&ChatLog::syncLoop, this);
+
+    LOG_INFO("[LOG] " << path << ": " << lastSeqLocked() << " records in " << m_segments.size() << " segment(s), "
+             << m_end << " bytes (" << m_cache.size() << " bytes cached)");
+    return true;
+}
+
+bool ChatLog::openSegments()
+{
+    struct stat st
+    {
+    };
+    std::vector<uint64_t> bases = ListSegments(m_dir);
+    if (bases.empty() && ::stat(m_path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        return importLegacy();
+
+    if (::mkdir(m_dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("[LOG] mkdir(" << m_dir << ") failed: " << strerror(errno));
+        return false;
+    }
+    if (bases.empty())
+        return createSegment(1);
+
+    for (size_t i = 0; i < bases.size(); ++i)
+    {
+        const bool tail = i + 1 == bases.size();
+        auto segment = std::make_shared<Segment>();
+        segment->baseSeq = bases[i];
+        segment->baseOffset = m_end;
+
+        const std::string logPath = SegmentFile(m_dir, bases[i], ".log");
+        segment->fd = ::open(logPath.c_str(), (tail ? O_RDWR | O_APPEND : O_RDONLY) | O_CLOEXEC);
+        if (segment->fd < 0)
+        {
+            LOG_ERROR("[LOG] open(" << logPath << ") failed: " << strerror(errno));
+            return false;
+        }
+        segment->size = FileSize(segment->fd);
+
+        if (tail)
+        {
+            const std::string idxPath = SegmentFile(m_dir, bases[i], ".idx");
+            segment->idxFd = ::open(idxPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (segment->idxFd < 0 || !recoverTail(*segment))
+            {
+                LOG_ERROR("[LOG] Cannot recover " << logPath);
+                return false;
+            }
+        }
+        else
+        {
+            // Sealed: the next segment's name fixes the record count; the
+            // index is read when a VIEW first reaches this segment.
+            segment->count = bases[i + 1] - bases[i];
+            if (::stat(SegmentFile(m_dir, bases[i], ".idx").c_str(), &st) != 0 ||
+                static_cast<uint64_t>(st.st_size) != segment->count * sizeof(IndexEntry))
+            {
+                LOG_WARN("[LOG] " << logPath << ": index does not match, rebuilding it");
+                indexed(*segment);
+            }
+        }
+
+        m_end += segment->size;
+        m_segments.push_back(std::move(segment));
+    }
+    archiveOld();
+    return true;
+}
+
+/*
+ * importLegacy()
+ * --------------
+ * Converts a plain chat file written by older versions into segments. The
+ * segments are built in a temporary directory that is renamed into place
+ * when complete, so a crash part-way simply restarts the import.
+ */
+bool ChatLog::importLegacy()
+{
+    const std::string finalDir = m_dir;
+    m_dir = finalDir + ".tmp";
+    for (uint64_t base : ListSegments(m_dir))
+    {
+        ::unlink(SegmentFile(m_dir, base, ".log").c_str());
+        ::unlink(SegmentFile(m_dir, base, ".idx").c_str());
+    }
+    if ((::mkdir(m_dir.c_str(), 0755) < 0 && errno != EEXIST) || !createSegment(1))
+    {
+        LOG_ERROR("[LOG] Cannot create " << m_dir << ": " << strerror(errno));
+        return false;
+    }
+
+    int legacy = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (legacy < 0)
+    {
+        LOG_ERROR("[LOG] open(" << m_path << ") failed: " << strerror(errno));
+        return false;
+    }
+
+    const uint64_t size = FileSize(legacy);
+    std::string chunk;
+    std::vector<uint32_t> crcs;
+    bool ok = true;
+    for (uint64_t pos = 0; ok && pos < size;)
+    {
+        // Whole lines only; a final unterminated line gets its newline.
+        chunk.resize(static_cast<size_t>(std::min<uint64_t>(kImportChunk, size - pos)));
+        ok = ReadFully(legacy, &chunk[0], chunk.size(), pos);
+        if (!ok)
+            break;
+        size_t take = chunk.rfind('\n') + 1;
+        if (take == 0)
+            take = chunk.size();
+        pos += take;
+        chunk.resize(take);
+        if (chunk.back() != '\n')
+            chunk.push_back('\n');
+
+        crcs.clear();
+        for (size_t at = 0; at < chunk.size();)
+        {
+            size_t next = chunk.find('\n', at) + 1;
+            crcs.push_back(Crc32c(chunk.data() + at, next - at));
+            at = next;
+        }
+        ok = writeRecords(chunk, crcs);
+    }
+    ::close(legacy);
+
+    const Segment &tail = *m_segments.back();
+    ok = ok && ::fdatasync(tail.fd) == 0 && ::fdatasync(tail.idxFd) == 0;
+    ok = ok && ::rename(m_dir.c_str(), finalDir.c_str()) == 0;
+    if (!ok)
+    {
+        LOG_ERROR("[LOG] Importing " << m_path << " failed: " << strerror(errno));
+        return false;
+    }
+    m_dir = finalDir;
+    ::rename(m_path.c_str(), (m_path + ".imported").c_str());
+    ::unlink((m_path + ".idx").c_str());
+
+    LOG_INFO("[LOG] Imported " << lastSeqLocked() << " records from " << m_path << " (kept as " << m_path
+             << ".imported)");
+    return true;
+}
+
+bool ChatLog::createSegment(uint64_t baseSeq)
+{
+    auto segment = std::make_shared<Segment>();
+    segment->baseSeq = baseSeq;
+    segment->baseOffset = m_end;
+    segment->loaded = true;
+
+    const std::string logPath = SegmentFile(m_dir, baseSeq, ".log");
+    const std::string idxPath = SegmentFile(m_dir, baseSeq, ".idx");
+    segment->fd = ::open(logPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    segment->idxFd = ::open(idxPath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (segment->fd < 0 || segment->idxFd < 0)
+    {
+        LOG_ERROR("[LOG] Cannot create segment " << logPath << ": " << strerror(errno));
+        return false;
+    }
+    SyncDir(m_dir);
+    m_segments.push_back(std::move(segment));
+    return true;
+}
+
+/*
+ * recoverTail()
+ * -------------
+ * Checks every record of the tail segment against its index entry. The
+ * first record whose CRC does not match, and everything after it, is cut
+ * off. Complete records beyond the index (written just before a crash)
+ * are indexed again, unless they contain NUL bytes, the mark of a write
+ * the file system had not finished. An unterminated last record is a torn
+ * write and is removed as well.
+ */
+bool ChatLog::recoverTail(Segment &tail)
+{
+    const std::vector<IndexEntry> stored = ReadIndex(tail.idxFd);
+    tail.index.clear();
+    bool trustIndex = true; // data and index agree so far
+    const char *damage = "torn write";
+
+    int64_t valid = ScanRecords(tail.fd, tail.size, [&](uint64_t offset, std::string_view record, uint32_t crc) {
+        size_t k = tail.index.size();
+        if (trustIndex && k < stored.size())
+        {
+            if (stored[k].offset != offset)
+            {
+                trustIndex = false;
+                LOG_WARN("[LOG] " << m_dir << ": index disagrees with the data at record " << tail.baseSeq + k
+                         << ", re-indexing the rest of the tail");
+            }
+            else if (stored[k].crc != crc)
+            {
+                damage = "CRC mismatch";
+                return false;
+            }
+        }
+        if ((!trustIndex || k >= stored.size()) && record.find('\0') != std::string_view::npos)
+        {
+            damage = "unwritten bytes";
+            return false;
+        }
+        tail.index.push_back(IndexEntry{ static_cast<uint32_t>(offset), crc });
+        return true;
+    });
+    if (valid < 0)
+        return false;
+
+    if (static_cast<uint64_t>(valid) < tail.size)
+    {
+        LOG_WARN("[LOG] " << m_dir << ": dropping " << tail.size - static_cast<uint64_t>(valid)
+                 << " bytes after record " << tail.baseSeq + tail.index.size() - 1 << " (" << damage << ")");
+        if (::ftruncate(tail.fd, static_cast<off_t>(valid)) != 0)
+            return false;
+        tail.size = static_cast<uint64_t>(valid);
+    }
+
+    // Usually the index only lacks the newest entries; otherwise rewrite it.
+    bool prefix = stored.size() <= tail.index.size() &&
+                  std::equal(stored.begin(), stored.end(), tail.index.begin(), [](const auto &a, const auto &b) {
+                      return a.offset == b.offset && a.crc == b.crc;
+                  });
+    size_t keep = prefix ? stored.size() : 0;
+    if (!prefix && ::ftruncate(tail.idxFd, 0) != 0)
+        return false;
+    if (keep < tail.index.size() &&
+        !WriteFully(tail.idxFd, tail.index.data() + keep, (tail.index.size() - keep) * sizeof(IndexEntry)))
+        return false;
+
+    tail.count = tail.index.size();
+    tail.loaded = true;
+    return true;
+}
+
+/*
+ * indexed()
+ * ---------
+ * Loads a sealed segment's index on first use. An index that is missing,
+ * short or out of order is rebuilt from the data file; the result always
+ * holds `count` non-decreasing offsets, so offset arithmetic stays safe
+ * even if the segment was damaged behind the server's back.
+ */
+ChatLog::Segment &ChatLog::indexed(Segment &segment)
+{
+    if (segment.loaded)
+        return segment;
+
+    int idxFd = ::open(SegmentFile(m_dir, segment.baseSeq, ".idx").c_str(), O_RDONLY | O_CLOEXEC);
+    segment.index = idxFd >= 0 ? ReadIndex(idxFd) : std::vector<IndexEntry>();
+    if (idxFd >= 0)
+        ::close(idxFd);
+
+    bool ok = segment.index.size() == segment.count && (segment.index.empty() || segment.index[0].offset == 0);
+    for (size_t i = 1; ok && i < segment.index.size(); ++i)
+        ok = segment.index[i].offset > segment.index[i - 1].offset && segment.index[i].offset < segment.size;
+    if (!ok)
+    {
+        segment.index.clear();
+        ScanRecords(segment.fd, segment.size, [&](uint64_t offset, std::string_view, uint32_t crc) {
+            segment.index.push_back(IndexEntry{ static_cast<uint32_t>(offset), crc });
+            return segment.index.size() < segment.count;
+        });
+        if (segment.index.size() != segment.count)
+            LOG_ERROR("[LOG] Segment " << segment.baseSeq << " holds " << segment.index.size() << " records, expected "
+                      << segment.count);
+        segment.index.resize(segment.count, IndexEntry{ static_cast<uint32_t>(segment.size), 0 });
+    }
+    segment.loaded = true;
+    return segment;
+}
+
+/*
+ * rollSegment()
+ * -------------
+ * Seals the tail and starts a new one. The old tail is synced first, so a
+ * sealed segment is always complete on disk and never needs recovery.
+ */
+bool ChatLog::rollSegment()
+{
+    Segment &tail = *m_segments.back();
+    if (::fdatasync(tail.fd) != 0 || ::fdatasync(tail.idxFd) != 0)
+    {
+        LOG_ERROR("[LOG] fdatasync before sealing a segment failed: " << strerror(errno));
+        return false;
+    }
+    ::close(tail.idxFd);
+    tail.idxFd = -1;
+
+    if (!createSegment(lastSeqLocked() + 1))
+        return false;
+    LOG_DEBUG("[LOG] " << m_dir << ": sealed segment " << tail.baseSeq << " (" << tail.count << " records)");
+    archiveOld();
+    return true;
+}
+
+/*
+ * archiveOld()
+ * ------------
+ * Moves the oldest sealed segments beyond the retention limit into
+ * "archive/". Slices still being sent keep their descriptors open.
+ */
+void ChatLog::archiveOld()
+{
+    if (m_retainSegments == 0 || m_segments.size() <= m_retainSegments)
+        return;
+
+    const std::string archive = m_dir + "/archive";
+    if (::mkdir(archive.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("[LOG] mkdir(" << archive << ") failed: " << strerror(errno));
+        return;
+    }
+    while (m_segments.size() > m_retainSegments)
+    {
+        uint64_t base = m_segments.front()->baseSeq;
+        for (const char *ext : { ".log", ".idx" })
+            ::rename(SegmentFile(m_dir, base, ext).c_str(), SegmentFile(archive, base, ext).c_str());
+        m_segments.pop_front();
+        LOG_INFO("[LOG] " << m_dir << ": archived segment " << base);
+    }
+    SyncDir(m_dir);
+}
+
+/*
+ * warmCache()
+ * -----------
+ * Loads the newest cache-capacity bytes of the record stream into memory.
+ */
+bool ChatLog::warmCache()
+{
+    uint64_t start = m_end - m_segments.front()->baseOffset > m_cache.capacity() ? m_end - m_cache.capacity()
+                                                                               : m_segments.front()->baseOffset;
+    m_cache.reset(start);
+
+    std::string chunk(kScanChunk, '\0');
+    for (uint64_t pos = start; pos < m_end;)
+    {
+        size_t len = static_cast<size_t>(std::min<uint64_t>(kScanChunk, m_end - pos));
+        if (!readStream(pos, pos + len, &chunk[0]))
+            return false;
+        m_cache.append(chunk.data(), len);
+        pos += len;
+    }
+    return true;
+}
+
+// Copies stream bytes [start, stop) from the segment files.
+bool ChatLog::readStream(uint64_t start, uint64_t stop, char *out)
+{
+    for (const auto &segment : m_segments)
+    {
+        uint64_t from = std::max(start, segment->baseOffset);
+        uint64_t until = std::min(stop, segment->baseOffset + segment->size);
+        if (from < until && !ReadFully(segment->fd, out + (from - start), static_cast<size_t>(until - from),
+                                       from - segment->baseOffset))
+            return false;
+    }
+    return true;
+}
+
+/*
+ * append()
+ * --------
+ * Single-record form of appendBatch().
+ */
+uint64_t ChatLog::append(const std::string &message, DurableCallback onDurable)
+{
+    std::string record = message;
+    record.push_back('\n');
+    return appendBatch(record, std::move(onDurable));
+}
+
+/*
+ * appendBatch()
+ * -------------
+ * Checksums the records outside the lock, then writes them and their
+ * index entries, each with one write() no matter how many records the
+ * batch holds.
+ */
+uint64_t ChatLog::appendBatch(std::string_view records, DurableCallback onDurable)
+{
+    if (records.empty() || records.back() != '\n')
+        return 0;
+
+    // Reused by every append on this thread.
+    thread_local std::vector<uint32_t> crcs;
+    crcs.clear();
+    for (size_t pos = 0; pos < records.size();)
+    {
+        size_t next = records.find('\n', pos) + 1;
+        crcs.push_back(Crc32c(records.data() + pos, next - pos));
+        pos = next;
+    }
+
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if (m_segments.empty() || !writeRecords(records, crcs))
+            return 0;
+        seq = lastSeqLocked();
+    }
+
+    if (m_durability == Durability::Group && onDurable)
+    {
+        // The records are already written, so the next fdatasync() covers them.
+        std::lock_guard<std::mutex> lk(m_syncMutex);
+        m_batch.emplace_back(seq, std::move(onDurable));
+        if (m_batch.size() == 1 || m_batch.size() >= m_groupMax)
+            m_syncCv.notify_one();
+    }
+    return seq;
+}
+
+/*
+ * writeRecords()
+ * --------------
+ * Caller holds m_mutex. The data file is written first: a crash in
+ * between leaves records without index entries, which recoverTail()
+ * checks and indexes again. A failed write is cut off again so the next
+ * batch starts on a record boundary. Only the data file is synced per
+ * batch; the index is synced when its segment is sealed.
+ *
+ * A new segment and a larger index are storage growth, not part of the
+ * request, and allocate under an AllocExemption (AllocCounter.hpp).
+ */
+bool ChatLog::writeRecords(std::string_view records, const std::vector<uint32_t> &crcs)
+{
+    if (m_segments.back()->size > 0 && m_segments.back()->size + records.size() > m_segmentBytes)
+    {
+        AllocExemption growth;
+        if (!rollSegment())
+            return false;
+    }
+    Segment &tail = *m_segments.back();
+
+    bool written = WriteFully(tail.fd, records.data(), records.size());
+    if (!written || (m_durability == Durability::Strict && ::fdatasync(tail.fd) != 0))
+    {
+        LOG_ERROR("[LOG] " << (written ? "fdatasync" : "append") << " failed: " << strerror(errno));
+        if (::ftruncate(tail.fd, static_cast<off_t>(tail.size)) != 0)
+            LOG_ERROR("[LOG] Cannot cut off a failed append: " << strerror(errno));
+        return false;
+    }
+
+    const size_t before = tail.index.size();
+    if (tail.index.capacity() - before < crcs.size())
+    {
+        AllocExemption growth;
+        tail.index.reserve(std::max(tail.index.capacity() * 2, before + crcs.size()));
+    }
+    size_t pos = 0;
+    for (uint32_t crc : crcs)
+    {
+        tail.index.push_back(IndexEntry{ static_cast<uint32_t>(tail.size + pos), crc });
+        pos = records.find('\n', pos) + 1;
+    }
+    WriteFully(tail.idxFd, tail.index.data() + before, crcs.size() * sizeof(IndexEntry));
+
+    tail.size += records.size();
+    tail.count += crcs.size();
+    m_end += records.size();
+    m_cache.append(records.data(), records.size());
+    return true;
+}
+
+/*
+ * syncLoop()
+ * ----------
+ * Group commit thread. Waits for the first record of a batch, lets the
+ * batch fill for up to m_groupWindow (or m_groupMax records), then makes
+ * the whole batch durable with one fdatasync() and acknowledges every
+ * record in it. Records arriving during the sync form the next batch.
+ * Only the tail needs syncing: a segment is synced when it is sealed.
+ */
+void ChatLog::syncLoop()
+{
+    std::vector<std::pair<uint64_t, DurableCallback>> batch;
+    std::unique_lock<std::mutex> lk(m_syncMutex);
+    while (true)
+    {
+        m_syncCv.wait(lk, [this] { return m_stopSync || !m_batch.empty(); });
+        if (m_batch.empty())
+            return; // stopping, nothing left to acknowledge
+
+        auto deadline = std::chrono::steady_clock::now() + m_groupWindow;
+        m_syncCv.wait_until(lk, deadline, [this] { return m_stopSync || m_batch.size() >= m_groupMax; });
+
+        batch.swap(m_batch);
+        lk.unlock();
+
+        SegmentPtr tail;
+        {
+            std::lock_guard<std::mutex> logLock(m_mutex);
+            tail = m_segments.back();
+        }
+        bool ok = ::fdatasync(tail->fd) == 0;
+        if (!ok)
+            LOG_ERROR("[LOG] group fdatasync failed: " << strerror(errno));
+        for (auto &entry : batch)
+            entry.second(entry.first, ok);
+        batch.clear();
+
+        lk.lock();
+    }
+}
+
+uint64_t ChatLog::lastSeqLocked() const
+{
+    if (m_segments.empty())
+        return 0;
+    const Segment &tail = *m_segments.back();
+    return tail.baseSeq + tail.count - 1;
+}
+
+uint64_t ChatLog::lastSeq()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return lastSeqLocked();
+}
+
+uint64_t ChatLog::firstSeq()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_segments.empty() ? 1 : m_segments.front()->baseSeq;
+}
+
+// Caller holds m_mutex; seq must be online.
+ChatLog::Segment &ChatLog::segmentFor(uint64_t seq)
+{
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), seq,
+                               [](uint64_t s, const SegmentPtr &segment) { return s < segment->baseSeq; });
+    return indexed(**std::prev(it));
+}
+
+// Stream offset where record seq starts (the stream end past the newest).
+uint64_t ChatLog::startOf(uint64_t seq)
+{
+    if (seq > lastSeqLocked())
+        return m_end;
+    Segment &segment = segmentFor(seq);
+    return segment.baseOffset + segment.index[seq - segment.baseSeq].offset;
+}
+
+// Newest record starting at or before stream offset (which is < m_end).
+uint64_t ChatLog::lastStartingAt(uint64_t offset)
+{
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), offset,
+                               [](uint64_t o, const SegmentPtr &segment) { return o < segment->baseOffset; });
+    Segment &segment = indexed(**std::prev(it));
+    auto pos = std::upper_bound(segment.index.begin(), segment.index.end(), offset - segment.baseOffset,
+                                [](uint64_t o, const IndexEntry &e) { return o < e.offset; });
+    return segment.baseSeq + static_cast<uint64_t>(pos - segment.index.begin()) - 1;
+}
+
+/*
+ * slice()
+ * -------
+ * Captures the byte range of records firstSeq..lastSeq and pins the
+ * segments and cache blocks that cover it. Segments are append-only and
+ * pinned blocks are never modified below the captured end, so the slice
+ * stays valid after the lock is released.
+ */
+void ChatLog::slice(uint64_t firstSeq, Slice &out, uint64_t lastSeq, uint64_t maxBytes)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    const uint64_t oldest = m_segments.front()->baseSeq;
+    out.lastSeq = std::min(lastSeq, lastSeqLocked());
+    out.firstSeq = std::max(firstSeq, oldest);
+    out.files.clear();
+    out.blocks.clear();
+    if (out.firstSeq > out.lastSeq)
+    {
+        out.firstSeq = out.lastSeq + 1;
+        out.start = out.cached = out.end = startOf(std::max(out.firstSeq, oldest));
+        return;
+    }
+
+    out.start = startOf(out.firstSeq);
+    out.end = startOf(out.lastSeq + 1);
+    if (out.end - out.start > maxBytes)
+    {
+        // Keep the records that end within maxBytes, but at least one.
+        out.lastSeq = std::max(out.firstSeq, lastStartingAt(out.start + maxBytes) - 1);
+        out.end = startOf(out.lastSeq + 1);
+    }
+    out.cached = std::min(out.end, std::max(out.start, m_cache.begin()));
+    m_cache.snapshot(out.cached, out.end, out.blocks);
+
+    if (out.cached > out.start)
+    {
+        for (const auto &segment : m_segments)
+        {
+            uint64_t from = std::max(out.start, segment->baseOffset);
+            uint64_t until = std::min(out.cached, segment->baseOffset + segment->size);
+            if (from < until)
+                out.files.push_back(
+                    FileRange{ segment, segment->fd, from - segment->baseOffset, static_cast<size_t>(until - from) });
+        }
+    }
+}
+
+bool ChatLog::copy(const Slice &slice, uint64_t start, uint64_t stop, char *out)
+{
+    // The file ranges cover [slice.start, slice.cached) back to back.
+    uint64_t pos = slice.start;
+    for (const auto &file : slice.files)
+    {
+        uint64_t from = std::max(start, pos);
+        uint64_t until = std::min(stop, pos + file.len);
+        if (from < until && !ReadFully(file.fd, out + (from - start), static_cast<size_t>(until - from),
+                                       file.offset + (from - pos)))
+        {
+            LOG_ERROR("[LOG] pread failed: " << strerror(errno));
+            return false;
+        }
+        pos += file.len;
+    }
+    if (stop > slice.cached)
+    {
+        uint64_t from = std::max(start, slice.cached);
+        LogCache::copy(slice.blocks, from, stop, out + (from - start));
+    }
+    return true;
+}
+
+/*
+ * readFrom()
+ * ----------
+ * Copies records firstSeq..newest into out: the cached part from memory,
+ * only history older than the cache from disk.
+ */
+uint64_t ChatLog::readFrom(uint64_t firstSeq, std::string &out, uint64_t &lastSeq)
+{
+    Slice s;
+    slice(firstSeq, s);
+    lastSeq = s.lastSeq;
+
+    out.resize(s.size());
+    char *dst = &out[0];
+    for (const auto &file : s.files)
+    {
+        if (!ReadFully(file.fd, dst, file.len, file.offset))
+        {
+            LOG_ERROR("[LOG] pread failed: " << strerror(errno));
+            out.clear();
+            return s.firstSeq;
+        }
+        dst += file.len;
+    }
+    if (s.end > s.cached)
+        LogCache::copy(s.blocks, s.cached, s.end, dst);
+    return s.firstSeq;
+}
+
+/*
+ * exportText()
+ * ------------
+ * Rebuilds the plain chat file: the archived segments, then the online
+ * ones, each record checked against its index entry. Records the index
+ * does not cover yet (the live tail) are written if they look complete.
+ */
+int64_t ChatLog::exportText(const std::string &path, int outFd, uint64_t sinceSeq, uint64_t &bad)
+{
+    const std::string dir = path + ".segments";
+    const std::string archive = dir + "/archive";
+    std::vector<std::pair<uint64_t, std::string>> segments;
+    for (uint64_t base : ListSegments(dir))
+        segments.emplace_back(base, dir);
+    for (uint64_t base : ListSegments(archive))
+    {
+        if (std::none_of(segments.begin(), segments.end(), [base](const auto &s) { return s.first == base; }))
+            segments.emplace_back(base, archive);
+    }
+    std::sort(segments.begin(), segments.end());
+
+    bad = 0;
+    int64_t written = 0;
+    uint64_t nextSeq = 1; // records below this were already exported
+    std::string out;
+    for (const auto &[base, from] : segments)
+    {
+        int fd = ::open(SegmentFile(from, base, ".log").c_str(), O_RDONLY | O_CLOEXEC);
+        int idxFd = ::open(SegmentFile(from, base, ".idx").c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            LOG_ERROR("[LOG] Cannot open segment " << base << " in " << from << ": " << strerror(errno));
+            if (idxFd >= 0)
+                ::close(idxFd);
+            return -1;
+        }
+        const std::vector<IndexEntry> stored = idxFd >= 0 ? ReadIndex(idxFd) : std::vector<IndexEntry>();
+        if (idxFd >= 0)
+            ::close(idxFd);
+
+        uint64_t seq = base;
+        bool ok = true;
+        int64_t end = ScanRecords(fd, FileSize(fd), [&](uint64_t offset, std::string_view record, uint32_t crc) {
+            size_t k = static_cast<size_t>(seq - base);
+            bool good = k < stored.size() ? stored[k].offset == offset && stored[k].crc == crc
+                                          : record.find('\0') == std::string_view::npos;
+            if (!good)
+                ++bad;
+            else if (seq > sinceSeq && seq >= nextSeq)
+            {
+                out.append(record);
+                ++written;
+            }
+            ++seq;
+            if (out.size() >= kExportChunk)
+            {
+                ok = WriteFully(outFd, out.data(), out.size());
+                out.clear();
+            }
+            return ok;
+        });
+        ::close(fd);
+        if (end < 0 || !ok)
+            return -1;
+        nextSeq = std::max(nextSeq, seq);
+    }
+    if (!out.empty() && !WriteFully(outFd, out.data(), out.size()))
+        return -1;
+    return written;
+}
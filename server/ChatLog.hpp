@@ -0,0 +1,207 @@
+#pragma once
+#include "LogCache.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ *  ChatLog.hpp
+ *  -----------
+ *  The shared chat history: an append-only sequence of records, each with
+ *  a sequence number (1, 2, 3, ...) and stored as one line of text.
+ *
+ *  Records are kept in segments under "<path>.segments/". A segment is a
+ *  data file holding its records back to back, exactly as they are sent to
+ *  clients, plus an index file with one fixed-size entry per record:
+ *
+ *      <first seq, 20 digits>.log   record bytes, "message\n" each
+ *      <first seq, 20 digits>.idx   { u32 offset in .log, u32 CRC-32C }
+ *
+ *  A new segment is started once the current one (the tail) would exceed
+ *  the segment size; older segments are sealed and never written again.
+ *  The data files concatenated in order form the record stream, and
+ *  offsets in this interface are positions in that stream.
+ *
+ *  Startup cost does not depend on the length of the history: sealed
+ *  segments are only stat()ed, their indexes are read the first time they
+ *  are needed, and only the tail is checked. Recovery verifies the CRC of
+ *  every record in the tail, indexes complete records whose entry never
+ *  reached disk and cuts off a torn last write, so a crash never leaves a
+ *  partial or corrupted record behind. Sealed segments beyond the
+ *  retention limit move to "<path>.segments/archive/"; exportText() turns
+ *  any of them back into the plain chat file.
+ *
+ *  The newest part of the stream is also held in a LogCache, loaded once
+ *  at startup and extended by every append, so the hot end of the history
+ *  is served from memory. Older ranges are sent straight from the segment
+ *  files. All methods are thread-safe.
+ *
+ *  Durability modes for appends:
+ *    None    → write() only; the OS flushes whenever it likes
+ *    Strict  → fdatasync() after every record, under the log lock
+ *    Group   → records are written immediately but acknowledged through a
+ *              callback once a background thread has covered them with a
+ *              shared fdatasync(); one sync per batch window
+ */
+class ChatLog
+{
+  public:
+    enum class Durability
+    {
+        None,
+        Group,
+        Strict
+    };
+
+    // Invoked (on the sync thread) once the group-committed record seq is
+    // on stable storage; ok is false if the sync failed.
+    using DurableCallback = std::function<void(uint64_t seq, bool ok)>;
+
+    // A byte range of one segment file; pin keeps the descriptor open.
+    struct FileRange
+    {
+        std::shared_ptr<const void> pin;
+        int fd{ -1 };
+        uint64_t offset{ 0 };
+        size_t len{ 0 };
+    };
+
+    /*
+     * Slice
+     * -----
+     * Records firstSeq..lastSeq located without copying: the stream range
+     * [start, cached) is only on disk (in `files`, oldest first), [cached,
+     * end) is in the pinned cache blocks. Every record ends with '\n'.
+     */
+    struct Slice
+    {
+        uint64_t firstSeq{ 1 };
+        uint64_t lastSeq{ 0 };
+        uint64_t start{ 0 };
+        uint64_t cached{ 0 };
+        uint64_t end{ 0 };
+        std::vector<FileRange> files;
+        std::vector<LogCache::BlockRef> blocks;
+
+        size_t size() const
+        {
+            return static_cast<size_t>(end - start);
+        }
+    };
+
+    ChatLog() = default;
+    ~ChatLog();
+
+    // Must be called before open(). In Group mode a batch is synced once it
+    // holds maxBatch records or `window` after its first record.
+    void setDurability(Durability mode, std::chrono::microseconds window, size_t maxBatch);
+    Durability durability() const
+    {
+        return m_durability;
+    }
+
+    // Must be called before open(). Segments are rolled once they would
+    // exceed segmentBytes; with retainSegments > 0 only that many newest
+    // segments stay online and older ones are moved to the archive.
+    void setSegments(uint64_t segmentBytes, size_t retainSegments);
+
+    ChatLog(const ChatLog &) = delete;
+    ChatLog &operator=(const ChatLog &) = delete;
+
+    // Opens (creating if needed) the segments of the log at path, recovers
+    // the tail segment and loads up to cacheBytes of the newest history
+    // into memory. A plain chat file left at path by older versions is
+    // imported into segments once and renamed to "<path>.imported".
+    bool open(const std::string &path, size_t cacheBytes);
+
+    // Appends one record (without newline); returns its sequence number or
+    // 0 on failure. In Group mode onDurable runs once the record is synced
+    // (only if append succeeded); in the other modes the record is as
+    // durable as it will get when append() returns and onDurable is unused.
+    uint64_t append(const std::string &message, DurableCallback onDurable = nullptr);
+
+    // Appends several records at once; records holds each one terminated
+    // by '\n'. Returns the sequence number of the last record (the first
+    // is that minus the record count plus one) or 0 on failure; onDurable
+    // receives the last sequence number too.
+    uint64_t appendBatch(std::string_view records, DurableCallback onDurable = nullptr);
+
+    // Sequence number of the newest record (0 when the log is empty).
+    uint64_t lastSeq();
+
+    // Sequence number of the oldest record still online (archived ones
+    // are gone from VIEW), or lastSeq() + 1 when there is none.
+    uint64_t firstSeq();
+
+    // Locates records firstSeq..lastSeq (default: newest); both ends are
+    // clamped to the valid range, and the slice is cut short after the
+    // last whole record within maxBytes (it always holds at least one).
+    // The slice stays valid while it is held.
+    void slice(uint64_t firstSeq, Slice &out, uint64_t lastSeq = UINT64_MAX, uint64_t maxBytes = UINT64_MAX);
+
+    // Copies stream bytes [start, stop) of a held slice to out; the range
+    // must lie within [slice.start, slice.end). False on a read error.
+    static bool copy(const Slice &slice, uint64_t start, uint64_t stop, char *out);
+
+    // Reads records firstSeq..newest into out; firstSeq is clamped to the
+    // valid range. Returns the sequence number of the first record read and
+    // stores the newest one in lastSeq.
+    uint64_t readFrom(uint64_t firstSeq, std::string &out, uint64_t &lastSeq);
+
+    // Writes records after sinceSeq as plain text to outFd, archived
+    // segments included. Reads the files directly, so it is safe while a
+    // server is appending to the log. Records failing their CRC are skipped
+    // and counted in `bad`. Returns the number written, or -1 on I/O error.
+    static int64_t exportText(const std::string &path, int outFd, uint64_t sinceSeq, uint64_t &bad);
+
+  private:
+    struct Segment;
+    using SegmentPtr = std::shared_ptr<Segment>;
+
+    bool openSegments();
+    bool importLegacy();
+    bool createSegment(uint64_t baseSeq);
+    bool recoverTail(Segment &tail);
+    bool rollSegment();
+    void archiveOld();
+    Segment &indexed(Segment &segment);
+    Segment &segmentFor(uint64_t seq);
+    uint64_t startOf(uint64_t seq);
+    uint64_t lastStartingAt(uint64_t offset);
+    bool writeRecords(std::string_view records, const std::vector<uint32_t> &crcs);
+    uint64_t lastSeqLocked() const;
+    bool readStream(uint64_t start, uint64_t stop, char *out);
+    bool warmCache();
+    void syncLoop();
+
+    std::mutex m_mutex;
+    std::string m_path;
+    std::string m_dir;                 // "<path>.segments"
+    std::deque<SegmentPtr> m_segments; // oldest first; back() is the tail
+    uint64_t m_end{ 0 };               // bytes in the record stream
+    LogCache m_cache;                  // newest bytes of the record stream
+
+    uint64_t m_segmentBytes{ 64u << 20 };
+    size_t m_retainSegments{ 0 };
+
+    Durability m_durability{ Durability::None };
+    std::chrono::microseconds m_groupWindow{ 200 };
+    size_t m_groupMax{ 256 };
+
+    // Group commit: records written but not yet synced, and the thread that
+    // syncs them.
+    std::mutex m_syncMutex;
+    std::condition_variable m_syncCv;
+    std::vector<std::pair<uint64_t, DurableCallback>> m_batch;
+    bool m_stopSync{ false };
+    std::thread m_syncThread;
+};
@@ -0,0 +1,102 @@
+#include "CompressedHistory.hpp"
+#include "../common/Lz4.hpp"
+#include "../common/Metrics.hpp"
+
+#include <algorithm>
+
+namespace
+{
+MetricCounter g_chunkHits("chat_compressed_chunk_hits_total", "VIEW COMPRESS chunks served from the cache");
+MetricCounter g_chunkMisses("chat_compressed_chunk_misses_total", "VIEW COMPRESS chunks compressed on demand");
+} // namespace
+
+void CompressedHistory::setCapacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_capacity = bytes;
+    evict();
+}
+
+CompressedHistory::Block CompressedHistory::find(uint64_t offset)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto it = m_chunks.find(offset);
+    return it == m_chunks.end() ? nullptr : it->second;
+}
+
+void CompressedHistory::insert(uint64_t offset, const Block &block)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (block->size() > m_capacity)
+        return;
+    auto [it, added] = m_chunks.emplace(offset, block);
+    if (!added)
+        return;
+    m_order.push_back(offset);
+    m_size += block->size();
+    evict();
+}
+
+// Drops the oldest chunks while over capacity. Readers still sending one
+// keep it alive through their own reference.
+void CompressedHistory::evict()
+{
+    while (m_size > m_capacity && !m_order.empty())
+    {
+        auto it = m_chunks.find(m_order.front());
+        m_size -= it->second->size();
+        m_chunks.erase(it);
+        m_order.pop_front();
+    }
+}
+
+/*
+ * encode()
+ * --------
+ * [start, end) splits into a head up to the first chunk boundary, whole
+ * chunks, and a tail after the last boundary; any of them may be empty.
+ * The whole chunks come from the cache. The slice was taken when the log
+ * ended at slice.end or later, so every chunk ending at or before
+ * slice.end is complete and will never change.
+ */
+bool CompressedHistory::encode(const ChatLog::Slice &slice, std::vector<Block> &blocks)
+{
+    blocks.clear();
+    thread_local std::string raw;
+
+    auto compress = [&slice](uint64_t from, uint64_t until) -> Block {
+        raw.resize(static_cast<size_t>(until - from));
+        if (!ChatLog::copy(slice, from, until, &raw[0]))
+            return nullptr;
+        auto block = std::make_shared<std::string>();
+        AppendCompressedBlock(*block, raw.data(), raw.size());
+        return block;
+    };
+
+    for (uint64_t pos = slice.start; pos < slice.end;)
+    {
+        const uint64_t chunk = pos - pos % kChunkSize;
+        const uint64_t until = std::min(chunk + kChunkSize, slice.end);
+        const bool whole = pos == chunk && until == chunk + kChunkSize;
+
+        Block block = whole ? find(chunk) : nullptr;
+        if (block)
+        {
+            g_chunkHits.add();
+        }
+        else
+        {
+            block = compress(pos, until);
+            if (!block)
+                return false;
+            if (whole)
+            {
+                g_chunkMisses.add();
+                insert(chunk, block);
+            }
+        }
+        blocks.push_back(std::move(block));
+        pos = until;
+    }
+    return true;
+}
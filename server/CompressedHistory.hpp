@@ -0,0 +1,62 @@
+#pragma once
+#include "ChatLog.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  CompressedHistory.hpp
+ *  ---------------------
+ *  Compressed copies of a room's history for VIEW ... COMPRESS.
+ *
+ *  The record stream is cut into chunks at fixed 64 KB offsets, and each
+ *  chunk is compressed into one block (Lz4.hpp). The log is append-only, so
+ *  once the stream has grown past the end of a chunk, that chunk never
+ *  changes again. Whole chunks are therefore compressed once, kept in a
+ *  bounded cache and queued to every later reader by reference. Only the
+ *  partial chunks at either end of a requested range, and the part of the
+ *  stream not yet filling a chunk, are compressed per request.
+ *
+ *  Thread-safe. The default room is read from every reactor. Two readers
+ *  missing the same chunk at the same time may both compress it; the
+ *  second result simply replaces the first.
+ */
+class CompressedHistory
+{
+  public:
+    static constexpr uint64_t kChunkSize = 64 * 1024;
+
+    // One encoded block, header included, ready to queue.
+    using Block = std::shared_ptr<const std::string>;
+
+    explicit CompressedHistory(size_t capacity = 0) : m_capacity(capacity)
+    {
+    }
+
+    CompressedHistory(const CompressedHistory &) = delete;
+    CompressedHistory &operator=(const CompressedHistory &) = delete;
+
+    // Bytes of compressed chunks to keep; 0 disables the cache.
+    void setCapacity(size_t bytes);
+
+    // Encodes the slice's records as blocks, replacing the contents of
+    // blocks. False if part of the history could not be read.
+    bool encode(const ChatLog::Slice &slice, std::vector<Block> &blocks);
+
+  private:
+    Block find(uint64_t offset);
+    void insert(uint64_t offset, const Block &block);
+    void evict();
+
+    std::mutex m_mutex;
+    size_t m_capacity;
+    size_t m_size{ 0 };
+    std::unordered_map<uint64_t, Block> m_chunks; // by stream offset of the chunk
+    std::deque<uint64_t> m_order;                 // cached chunks, oldest insertion first
+};
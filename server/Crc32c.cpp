@@ -0,0 +1,86 @@
+#include "Crc32c.hpp"
+
+#include <cstring>
+
+namespace
+{
+constexpr uint32_t kPolynomial = 0x82F63B78; // Castagnoli, bit-reflected
+
+struct Tables
+{
+    uint32_t t[8][256];
+
+    Tables()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (kPolynomial & (0u - (crc & 1)));
+            t[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            for (int k = 1; k < 8; ++k)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    }
+};
+
+const Tables &Table()
+{
+    static const Tables tables;
+    return tables;
+}
+
+uint32_t Software(const unsigned char *p, size_t len, uint32_t crc)
+{
+    const auto &t = Table().t;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8)
+    {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+#endif
+    while (len-- > 0)
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) uint32_t Hardware(const unsigned char *p, size_t len, uint32_t crc)
+{
+    uint64_t crc64 = crc;
+    while (len >= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (len-- > 0)
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif
+} // namespace
+
+uint32_t Crc32c(const void *data, size_t len, uint32_t crc)
+{
+    const auto *p = static_cast<const unsigned char *>(data);
+#if defined(__x86_64__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware)
+        return ~Hardware(p, len, ~crc);
+#endif
+    return ~Software(p, len, ~crc);
+}
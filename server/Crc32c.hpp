@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/*
+ *  Crc32c.hpp
+ *  ----------
+ *  CRC-32C (Castagnoli), the checksum kept for every record of the chat
+ *  log. Uses the SSE4.2 crc32 instruction when the CPU has it and a
+ *  slicing-by-8 table otherwise.
+ *
+ *  Pass the previous result as `crc` to checksum data in pieces:
+ *  Crc32c(b, nb, Crc32c(a, na)) == Crc32c(ab, na + nb).
+ */
+uint32_t Crc32c(const void *data, size_t len, uint32_t crc = 0);
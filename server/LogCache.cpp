@@ -0,0 +1,98 @@
+#include "LogCache.hpp"
+#include "AllocCounter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void LogCache::setCapacity(size_t capacity)
+{
+    m_capacity = capacity;
+    evict();
+}
+
+void LogCache::reset(uint64_t offset)
+{
+    m_blocks.clear();
+    m_spare.reset();
+    m_begin = m_end = offset;
+}
+
+/*
+ * append()
+ * --------
+ * Fills the open tail block and starts new blocks as needed. With a zero
+ * capacity the cache stays empty and only tracks the file end. A block
+ * that is not a recycled spare is storage growth (AllocCounter.hpp).
+ */
+void LogCache::append(const char *data, size_t len)
+{
+    if (m_capacity == 0)
+    {
+        m_end += len;
+        m_begin = m_end;
+        return;
+    }
+
+    while (len > 0)
+    {
+        if (m_blocks.empty() || m_blocks.back()->used == kBlockSize)
+        {
+            AllocExemption growth;
+            auto block = m_spare ? std::move(m_spare) : std::make_shared<Block>();
+            block->offset = m_end;
+            block->used = 0;
+            m_blocks.push_back(std::move(block));
+        }
+
+        Block &tail = *m_blocks.back();
+        size_t n = std::min(len, kBlockSize - tail.used);
+        std::memcpy(tail.data + tail.used, data, n);
+        tail.used += n;
+        m_end += n;
+        data += n;
+        len -= n;
+    }
+    evict();
+}
+
+// Evicts whole blocks from the front while the cache is over capacity. A
+// block no reader still pins is kept for the next append(), so a cache at
+// capacity recycles its memory instead of allocating 64 KB per block.
+void LogCache::evict()
+{
+    while (!m_blocks.empty() && size() > m_capacity)
+    {
+        if (m_blocks.front().use_count() == 1)
+            m_spare = std::move(m_blocks.front());
+        m_blocks.pop_front();
+        m_begin = m_blocks.empty() ? m_end : m_blocks.front()->offset;
+    }
+}
+
+void LogCache::snapshot(uint64_t start, uint64_t stop, std::vector<BlockRef> &blocks) const
+{
+    blocks.clear();
+    start = std::max(start, m_begin);
+    stop = std::min(stop, m_end);
+    if (start >= stop)
+        return;
+
+    // Blocks are contiguous and all but the last are full, so the first
+    // relevant block can be located arithmetically.
+    size_t first = static_cast<size_t>((start - m_blocks.front()->offset) / kBlockSize);
+    for (size_t i = first; i < m_blocks.size() && m_blocks[i]->offset < stop; ++i)
+        blocks.push_back(m_blocks[i]);
+}
+
+void LogCache::copy(const std::vector<BlockRef> &blocks, uint64_t start, uint64_t stop, char *out)
+{
+    for (const auto &block : blocks)
+    {
+        uint64_t from = std::max(start, block->offset);
+        uint64_t to = std::min(stop, block->offset + kBlockSize);
+        if (from >= to)
+            continue;
+        std::memcpy(out, block->data + (from - block->offset), static_cast<size_t>(to - from));
+        out += to - from;
+    }
+}
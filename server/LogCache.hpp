@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/*
+ *  LogCache.hpp
+ *  ------------
+ *  In-memory copy of the newest part of the chat file.
+ *
+ *  The cache is a run of fixed-size blocks that mirrors the file range
+ *  [begin(), end()). New records are appended to the last block; once the
+ *  cache holds more than its capacity, whole blocks are evicted from the
+ *  front and that history is served from disk again.
+ *
+ *  Blocks are reference counted and never reallocated, so a reader can pin
+ *  a range with snapshot(), drop the owner's lock and copy (or send) the
+ *  bytes while appends and evictions carry on. Bytes below the end()
+ *  observed at snapshot time never change.
+ *
+ *  Not thread-safe on its own; ChatLog serialises access.
+ */
+class LogCache
+{
+  public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    struct Block
+    {
+        uint64_t offset{ 0 }; // file offset of data[0]
+        size_t used{ 0 };     // bytes filled
+        char data[kBlockSize];
+    };
+    using BlockRef = std::shared_ptr<const Block>;
+
+    explicit LogCache(size_t capacity = 0) : m_capacity(capacity)
+    {
+    }
+
+    void setCapacity(size_t capacity);
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    // Drops everything and restarts the cache at file offset `offset`.
+    void reset(uint64_t offset);
+
+    // Appends bytes that were just written at file offset end().
+    void append(const char *data, size_t len);
+
+    uint64_t begin() const
+    {
+        return m_begin;
+    }
+    uint64_t end() const
+    {
+        return m_end;
+    }
+    size_t size() const
+    {
+        return static_cast<size_t>(m_end - m_begin);
+    }
+
+    // Pins the blocks covering [start, stop) (clamped to the cached range).
+    void snapshot(uint64_t start, uint64_t stop, std::vector<BlockRef> &blocks) const;
+
+    // Copies [start, stop) out of pinned blocks; the range must be covered.
+    static void copy(const std::vector<BlockRef> &blocks, uint64_t start, uint64_t stop, char *out);
+
+  private:
+    void evict();
+
+    size_t m_capacity;
+    uint64_t m_begin{ 0 };
+    uint64_t m_end{ 0 };
+    std::deque<std::shared_ptr<Block>> m_blocks;
+    std::shared_ptr<Block> m_spare; // last evicted block nobody pinned; reused by append()
+};
@@ -0,0 +1,710 @@
+#include "Reactor.hpp"
+#include "../common/Logger.hpp"
+#include "../common/Metrics.hpp"
+#include "../common/NetUtils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*
+ *  Reactor.cpp
+ *  -----------
+ *  Level-triggered epoll loop. Every socket is non-blocking; a slow or
+ *  stalled client only ever occupies its own Connection object and never
+ *  blocks the loop for other users.
+ *
+ *  Connection-level commands handled here rather than by the server:
+ *    KEEPALIVE → keep the connection open and accept pipelined commands
+ *    QUIT      → answer "OK bye" and close after flushing
+ */
+
+namespace
+{
+constexpr int kMaxEvents = 256;
+constexpr size_t kMaxPendingOut = 1 << 20;
+constexpr int kMaxIov = 64;
+constexpr size_t kMaxIdleConnections = 64;
+
+MetricGauge g_activeConnections("chat_connections_active", "Client connections currently open");
+MetricCounter g_acceptedConnections("chat_connections_accepted_total", "Client connections accepted");
+MetricCounter g_bytesReceived("chat_bytes_received_total", "Bytes read from client sockets");
+MetricCounter g_bytesSent("chat_bytes_sent_total", "Bytes written to client sockets, sendfile() included");
+
+int SetNonBlocking(int fd)
+{
+    int flags = ::fcntl(fd, F_GETFL, 0);
+    if (flags < 0)
+        return -1;
+    return ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+} // namespace
+
+void OutChunk::clear()
+{
+    owned.clear();
+    data = nullptr;
+    pin.reset();
+    fileFd = -1;
+    fileOffset = 0;
+    len = sent = 0;
+    ticket = 0;
+}
+
+OutChunk &ChunkQueue::emplace_back()
+{
+    if (m_tail == m_slots.size() && m_head > 0)
+    {
+        // Move the live chunks to the front; the sent ones become spares.
+        std::rotate(m_slots.begin(), begin(), m_slots.end());
+        m_tail -= m_head;
+        m_head = 0;
+    }
+    if (m_tail == m_slots.size())
+        m_slots.emplace_back();
+    OutChunk &chunk = m_slots[m_tail++];
+    chunk.clear();
+    return chunk;
+}
+
+void ChunkQueue::pop_front()
+{
+    m_slots[m_head].clear(); // drop the pin now, not when the slot is reused
+    if (++m_head == m_tail)
+        m_head = m_tail = 0;
+}
+
+void ChunkQueue::clear()
+{
+    while (!empty())
+        pop_front();
+}
+
+void ChunkQueue::replace(iterator pos, ChunkQueue &other)
+{
+    const size_t at = static_cast<size_t>(pos - begin());
+    const size_t n = other.size();
+    if (n == 0)
+    {
+        std::rotate(pos, pos + 1, end());
+        m_slots[--m_tail].clear();
+        return;
+    }
+    // Open n - 1 slots after pos: append them, then rotate them into place.
+    for (size_t i = 1; i < n; ++i)
+        emplace_back();
+    std::rotate(begin() + static_cast<std::ptrdiff_t>(at + 1), end() - static_cast<std::ptrdiff_t>(n - 1), end());
+    for (size_t i = 0; i < n; ++i)
+        m_slots[m_head + at + i] = std::move(other.m_slots[other.m_head + i]);
+    other.m_head = other.m_tail = 0;
+}
+
+void OutQueue::write(std::string_view text)
+{
+    if (text.empty())
+        return;
+    // Coalesce consecutive protocol text into one owned chunk.
+    if (out.empty() || out.back().data || out.back().fileFd >= 0 || out.back().ticket)
+        out.emplace_back();
+    OutChunk &chunk = out.back();
+    chunk.owned.append(text.data(), text.size());
+    chunk.len = chunk.owned.size();
+    outPending += text.size();
+}
+
+void OutQueue::writeRef(const char *data, size_t len, std::shared_ptr<const void> pin)
+{
+    if (len == 0)
+        return;
+    OutChunk &chunk = out.emplace_back();
+    chunk.data = data;
+    chunk.len = len;
+    chunk.pin = std::move(pin);
+    outPending += len;
+}
+
+void OutQueue::writeFile(int fileFd, uint64_t offset, size_t len, std::shared_ptr<const void> pin)
+{
+    if (len == 0)
+        return;
+    OutChunk &chunk = out.emplace_back();
+    chunk.fileFd = fileFd;
+    chunk.fileOffset = offset;
+    chunk.len = len;
+    chunk.pin = std::move(pin);
+    outPending += len;
+}
+
+void Connection::reuse(int newFd, uint64_t newId, Reactor *owner)
+{
+    fd = newFd;
+    id = newId;
+    reactor = owner;
+    state = State::Reading;
+    keepAlive = binary = false;
+    events = 0;
+    reader.reset(newFd);
+    nextTicket = 0;
+    bodyLines = 0;
+    body.clear();
+    scratch.clear();
+    onBody = nullptr;
+    onDrained = nullptr;
+    out.clear();
+    outPending = 0;
+}
+
+DeferredReply Connection::deferReply()
+{
+    out.emplace_back();
+    out.back().ticket = ++nextTicket;
+    return DeferredReply{ reactor, fd, id, nextTicket };
+}
+
+void Connection::readBody(size_t lines, std::function<void(Connection &, std::string &body)> done)
+{
+    body.clear();
+    if (lines == 0)
+    {
+        done(*this, body);
+        return;
+    }
+    bodyLines = lines;
+    onBody = std::move(done);
+}
+
+void DeferredReply::complete(std::string text) const
+{
+    OutQueue reply;
+    reply.write(text);
+    complete(std::move(reply));
+}
+
+void DeferredReply::complete(OutQueue reply) const
+{
+    Reactor *r = reactor;
+    int f = fd;
+    uint64_t c = connId, t = ticket;
+    auto shared = std::make_shared<OutQueue>(std::move(reply)); // std::function needs a copyable task
+    r->post([r, f, c, t, shared] { r->completeDeferred(f, c, t, std::move(*shared)); });
+}
+
+Reactor::Reactor(int listenFd, CommandHandler handler, FrameHandler frameHandler)
+    : m_listenFd(listenFd), m_handler(std::move(handler)), m_frameHandler(std::move(frameHandler))
+{
+    m_epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0)
+    {
+        LOG_ERROR("[REACTOR] epoll_create1() failed: " << strerror(errno));
+        return;
+    }
+
+    SetNonBlocking(m_listenFd);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_listenFd;
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &ev);
+
+    m_wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.data.fd = m_wakeFd;
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+
+    // Pooling a closed connection must not allocate either.
+    m_idle.reserve(kMaxIdleConnections);
+}
+
+Reactor::~Reactor()
+{
+    for (const auto &conn : m_conns)
+    {
+        if (conn)
+            ::close(conn->fd);
+    }
+    if (m_epollFd >= 0)
+        ::close(m_epollFd);
+    if (m_wakeFd >= 0)
+        ::close(m_wakeFd);
+}
+
+void Reactor::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_postMutex);
+        m_posted.push_back(std::move(task));
+    }
+    uint64_t one = 1;
+    ssize_t n = ::write(m_wakeFd, &one, sizeof one);
+    (void)n; // EAGAIN means a wake-up is already pending
+}
+
+void Reactor::runPosted()
+{
+    uint64_t count;
+    ssize_t n = ::read(m_wakeFd, &count, sizeof count);
+    (void)n;
+
+    {
+        std::lock_guard<std::mutex> lk(m_postMutex);
+        m_running.swap(m_posted);
+    }
+    for (auto &task : m_running)
+        task();
+    m_running.clear(); // both vectors keep their capacity
+}
+
+Connection *Reactor::lookup(int fd) const
+{
+    return fd >= 0 && static_cast<size_t>(fd) < m_conns.size() ? m_conns[static_cast<size_t>(fd)].get() : nullptr;
+}
+
+Connection *Reactor::connection(int fd, uint64_t connId)
+{
+    Connection *conn = lookup(fd);
+    return conn && conn->id == connId ? conn : nullptr;
+}
+
+/*
+ * completeDeferred()
+ * ------------------
+ * Fills a reply slot reserved with deferReply() with the reply's chunks
+ * and resumes flushing.
+ */
+void Reactor::completeDeferred(int fd, uint64_t connId, uint64_t ticket, OutQueue reply)
+{
+    Connection *found = connection(fd, connId);
+    if (!found)
+        return;
+    Connection &conn = *found;
+
+    for (auto chunk = conn.out.begin(); chunk != conn.out.end(); ++chunk)
+    {
+        if (chunk->ticket != ticket)
+            continue;
+        conn.out.replace(chunk, reply.out);
+        conn.outPending += reply.outPending;
+        break;
+    }
+    flush(conn);
+}
+
+/*
+ * run()
+ * -----
+ * Waits for readiness events and dispatches them to the owning connection.
+ */
+void Reactor::run()
+{
+    if (m_epollFd < 0)
+        return;
+
+    epoll_event events[kMaxEvents];
+    while (true)
+    {
+        int n = ::epoll_wait(m_epollFd, events, kMaxEvents, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("[REACTOR] epoll_wait() failed: " << strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == m_listenFd)
+            {
+                acceptAll();
+                continue;
+            }
+            if (fd == m_wakeFd)
+            {
+                runPosted();
+                continue;
+            }
+
+            Connection *found = lookup(fd);
+            if (!found)
+                continue;
+            Connection &conn = *found;
+
+            if (events[i].events & (EPOLLHUP | EPOLLERR))
+            {
+                closeConnection(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                flush(conn);
+                if (!lookup(fd))
+                    continue;
+            }
+            if ((events[i].events & EPOLLIN) && conn.state != Connection::State::Closing)
+                onReadable(conn);
+        }
+    }
+}
+
+/*
+ * acceptAll()
+ * -----------
+ * Drains the accept queue; each new socket starts in the Reading state.
+ */
+void Reactor::acceptAll()
+{
+    while (true)
+    {
+        int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                LOG_WARN("[SERVER] accept() failed: " << strerror(errno));
+            return;
+        }
+        // Replies are often written in more than one piece (e.g. a deferred
+        // reply behind a cross-thread room hop); without this, Nagle holds the
+        // last piece until the client's next request carries the ACK.
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+        std::unique_ptr<Connection> conn;
+        if (m_idle.empty())
+        {
+            conn = std::make_unique<Connection>();
+        }
+        else
+        {
+            conn = std::move(m_idle.back());
+            m_idle.pop_back();
+        }
+        conn->reuse(fd, ++m_nextConnId, this);
+        conn->events = EPOLLIN;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (::epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            LOG_ERROR("[REACTOR] epoll_ctl(ADD) failed: " << strerror(errno));
+            ::close(fd);
+            continue;
+        }
+        if (static_cast<size_t>(fd) >= m_conns.size())
+            m_conns.resize(static_cast<size_t>(fd) + 1);
+        m_conns[static_cast<size_t>(fd)] = std::move(conn);
+        g_acceptedConnections.add();
+        g_activeConnections.add();
+    }
+}
+
+/*
+ * onReadable()
+ * ------------
+ * Pulls whatever the socket has into the connection's LineReader and
+ * hands complete lines to the command handler.
+ *
+ * End of input is not the end of the connection: a client may send its
+ * commands and shut down its write side while replies are still queued.
+ * The connection then stops reading and closes once every reply,
+ * deferred ones included, has been sent. Only a read error closes it at
+ * once.
+ */
+void Reactor::onReadable(Connection &conn)
+{
+    ssize_t n = conn.reader.fill();
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n < 0)
+    {
+        LOG_WARN("[SERVER] Failed to receive data from client: " << strerror(errno));
+        closeConnection(conn.fd);
+        return;
+    }
+    if (n == 0)
+    {
+        // Complete commands were run as they arrived; what is left is a
+        // command the peer never finished.
+        if (conn.reader.buffered() > 0)
+            LOG_WARN("[SERVER] Client closed in the middle of a command");
+        conn.state = Connection::State::Closing;
+        flush(conn); // drops EPOLLIN; closes once the output is gone
+        return;
+    }
+
+    g_bytesReceived.add(static_cast<uint64_t>(n));
+    processInput(conn);
+}
+
+/*
+ * processInput()
+ * --------------
+ * Runs every complete command in the input buffer, in order, as text
+ * lines or, after a successful "BINARY" negotiation, as frames.
+ */
+void Reactor::processInput(Connection &conn)
+{
+    if (conn.binary)
+        processFrames(conn);
+    else
+        processLines(conn);
+
+    if (conn.state != Connection::State::Closing && conn.outPending > 0)
+        conn.state = Connection::State::Writing;
+    flush(conn);
+}
+
+/*
+ * processLines()
+ * --------------
+ * Text protocol. A plain connection is answered once and then closed;
+ * after KEEPALIVE the connection stays open and pipelined commands are
+ * answered back-to-back. Over-long lines are rejected instead of buffered
+ * forever.
+ */
+void Reactor::processLines(Connection &conn)
+{
+    std::string_view line;
+    while (conn.state != Connection::State::Closing)
+    {
+        if (!conn.reader.popLine(line))
+        {
+            if (conn.reader.overflow())
+            {
+                conn.write("ERR line too long\n");
+                conn.state = Connection::State::Closing;
+            }
+            break;
+        }
+
+        if (conn.bodyLines > 0)
+        {
+            conn.body.append(line.data(), line.size());
+            conn.body.push_back('\n');
+            if (--conn.bodyLines > 0)
+                continue;
+            auto done = std::move(conn.onBody);
+            conn.onBody = nullptr;
+            done(conn, conn.body);
+            conn.body.clear();
+            if (!conn.keepAlive)
+                conn.state = Connection::State::Closing;
+            continue;
+        }
+
+        LOG_DEBUG("[SERVER] Received line: \"" << line << "\"");
+
+        if (line == "KEEPALIVE")
+        {
+            conn.keepAlive = true;
+            conn.write("OK keepalive\n");
+            continue;
+        }
+        if (line == "QUIT")
+        {
+            conn.write("OK bye\n");
+            conn.state = Connection::State::Closing;
+            break;
+        }
+        if (line == kBinaryHello)
+        {
+            if (!m_frameHandler)
+            {
+                conn.write("ERR binary unsupported\n");
+                continue;
+            }
+            // Everything after this line is frames; binary implies keep-alive.
+            conn.write(kBinaryAccept);
+            conn.write("\n");
+            conn.binary = conn.keepAlive = true;
+            processFrames(conn);
+            return;
+        }
+
+        m_handler(conn, line);
+        if (!conn.keepAlive && conn.bodyLines == 0)
+            conn.state = Connection::State::Closing;
+    }
+}
+
+/*
+ * processFrames()
+ * ---------------
+ * Binary protocol: a fixed-size header decode, then the whole payload is
+ * handed over as one view into the read buffer. Incomplete frames stay
+ * buffered until the rest arrives.
+ */
+void Reactor::processFrames(Connection &conn)
+{
+    std::string_view bytes;
+    while (conn.state != Connection::State::Closing && conn.reader.peek(kFrameHeaderSize, bytes))
+    {
+        FrameHeader header;
+        if (!DecodeFrameHeader(bytes.data(), header))
+        {
+            LOG_WARN("[SERVER] Bad frame header (version " << int(header.version) << ", " << header.length
+                                                          << " bytes)");
+            conn.write(MakeFrame(FrameOp::Err, 0, header.requestId, "bad frame"));
+            conn.state = Connection::State::Closing;
+            break;
+        }
+        if (!conn.reader.peek(kFrameHeaderSize + header.length, bytes))
+            break;
+
+        LOG_DEBUG("[SERVER] Received frame op=" << int(header.op) << " id=" << header.requestId << " "
+                                                << header.length << " bytes");
+        if (header.op == FrameOp::Quit)
+        {
+            conn.write(MakeFrame(FrameOp::Ok, 0, header.requestId, {}));
+            conn.state = Connection::State::Closing;
+        }
+        else
+        {
+            m_frameHandler(conn, header, bytes.substr(kFrameHeaderSize));
+        }
+        conn.reader.consume(kFrameHeaderSize + header.length);
+    }
+}
+
+/*
+ * flush()
+ * -------
+ * Sends as much of the pending output as the socket accepts: runs of
+ * memory chunks go out in one SendVecOnce() scatter-gather call, file ranges
+ * via sendfile(). Output stops at the first unfilled deferred reply.
+ * While output is pending the connection also waits for EPOLLOUT; a
+ * keep-alive connection keeps reading unless its backlog
+ * exceeds kMaxPendingOut, so a client that never reads its replies cannot
+ * grow our buffers unbounded. Once everything is sent, onDrained may
+ * queue more.
+ */
+void Reactor::flush(Connection &conn)
+{
+    bool blocked = false;
+    while (!conn.out.empty() && !blocked && !conn.out.front().ticket)
+    {
+        OutChunk &front = conn.out.front();
+        ssize_t n;
+        if (front.fileFd >= 0)
+        {
+            off_t off = static_cast<off_t>(front.fileOffset + front.sent);
+            n = ::sendfile(conn.fd, front.fileFd, &off, front.len - front.sent);
+            if (n == 0)
+            {
+                LOG_ERROR("[REACTOR] sendfile() hit end of file early");
+                closeConnection(conn.fd);
+                return;
+            }
+        }
+        else
+        {
+            iovec iov[kMaxIov];
+            int count = 0;
+            for (auto it = conn.out.begin();
+                 it != conn.out.end() && count < kMaxIov && it->fileFd < 0 && !it->ticket; ++it)
+            {
+                iov[count].iov_base = const_cast<char *>(it->bytes() + it->sent);
+                iov[count].iov_len = it->len - it->sent;
+                ++count;
+            }
+            n = SendVecOnce(conn.fd, iov, count);
+        }
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                blocked = true;
+                break;
+            }
+            LOG_WARN("[REACTOR] send failed: " << strerror(errno));
+            closeConnection(conn.fd);
+            return;
+        }
+
+        // Retire fully sent chunks.
+        size_t done = static_cast<size_t>(n);
+        g_bytesSent.add(done);
+        conn.outPending -= done;
+        while (done > 0)
+        {
+            OutChunk &chunk = conn.out.front();
+            size_t take = std::min(done, chunk.len - chunk.sent);
+            chunk.sent += take;
+            done -= take;
+            if (chunk.sent == chunk.len)
+                conn.out.pop_front();
+        }
+    }
+
+    if (conn.out.empty())
+    {
+        if (conn.state == Connection::State::Closing)
+        {
+            closeConnection(conn.fd);
+            return;
+        }
+        if (conn.onDrained)
+        {
+            conn.onDrained(conn);
+            if (!conn.out.empty())
+            {
+                flush(conn);
+                return;
+            }
+        }
+        conn.state = Connection::State::Reading;
+        setInterest(conn, EPOLLIN);
+        return;
+    }
+
+    // Waiting on a deferred reply needs no EPOLLOUT: completeDeferred()
+    // resumes the flush.
+    uint32_t events = 0;
+    if (!conn.out.front().ticket)
+        events |= EPOLLOUT;
+    if (conn.state != Connection::State::Closing && conn.outPending < kMaxPendingOut)
+        events |= EPOLLIN;
+    setInterest(conn, events);
+}
+
+void Reactor::setInterest(Connection &conn, uint32_t events)
+{
+    if (conn.events == events)
+        return;
+    conn.events = events;
+
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = conn.fd;
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+}
+
+void Reactor::closeConnection(int fd)
+{
+    ::epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    if (!lookup(fd))
+        return;
+    std::unique_ptr<Connection> conn = std::move(m_conns[static_cast<size_t>(fd)]);
+    g_activeConnections.sub();
+    // Release what the connection pins (cache blocks, files, callbacks)
+    // now; the buffers stay allocated for the next connection.
+    conn->reuse(-1, 0, this);
+    if (m_idle.size() < kMaxIdleConnections)
+        m_idle.push_back(std::move(conn));
+    LOG_DEBUG("[SERVER] Connection closed");
+}
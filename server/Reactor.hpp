@@ -0,0 +1,260 @@
+#pragma once
+#include "Frame.hpp"
+#include "LineReader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Reactor;
+
+/*
+ *  Reactor.hpp
+ *  -----------
+ *  Non-blocking, epoll based event loop for the chat server.
+ *
+ *  One Reactor owns one listening socket and every connection accepted
+ *  on it. Several reactors may run side by side (one per thread), each
+ *  with its own SO_REUSEPORT listener, so the kernel spreads incoming
+ *  connections across them and no state is shared between loops.
+ *
+ *  Work finishing on another thread (e.g. a group commit) is handed back
+ *  to the owning loop with post(); an eventfd wakes the loop up.
+ */
+
+/*
+ * OutChunk
+ * --------
+ * One piece of a queued response. Small protocol text is owned by the
+ * chunk; bulk data is either borrowed memory kept alive by `pin` (e.g. a
+ * cached log block) or a file range that is handed to sendfile(), so large
+ * replies reach the socket without being copied through user space.
+ */
+struct OutChunk
+{
+    std::string owned;               // owned bytes (when data == nullptr and fileFd < 0)
+    const char *data{ nullptr };     // borrowed bytes, valid while pin is held
+    std::shared_ptr<const void> pin; // owner of the borrowed bytes or the open file
+    int fileFd{ -1 };                // file to sendfile() from
+    uint64_t fileOffset{ 0 };        // start of the file range
+    size_t len{ 0 };                 // total bytes in this chunk
+    size_t sent{ 0 };                // bytes already written to the socket
+    uint64_t ticket{ 0 };            // non-zero: placeholder for a deferred reply
+
+    const char *bytes() const
+    {
+        return data ? data : owned.data();
+    }
+    // Back to an empty owned chunk; the string keeps its capacity.
+    void clear();
+};
+
+/*
+ * ChunkQueue
+ * ----------
+ * FIFO of OutChunks in one vector. Chunks that have been sent stay
+ * constructed behind the live range and are handed out again by
+ * emplace_back(), owned text capacity included, so a connection that
+ * keeps answering requests stops allocating once its queue has reached
+ * its working size.
+ */
+class ChunkQueue
+{
+  public:
+    using iterator = std::vector<OutChunk>::iterator;
+
+    bool empty() const
+    {
+        return m_head == m_tail;
+    }
+    size_t size() const
+    {
+        return m_tail - m_head;
+    }
+    OutChunk &front()
+    {
+        return m_slots[m_head];
+    }
+    OutChunk &back()
+    {
+        return m_slots[m_tail - 1];
+    }
+    iterator begin()
+    {
+        return m_slots.begin() + static_cast<std::ptrdiff_t>(m_head);
+    }
+    iterator end()
+    {
+        return m_slots.begin() + static_cast<std::ptrdiff_t>(m_tail);
+    }
+
+    // Appends a cleared chunk and returns it.
+    OutChunk &emplace_back();
+    void pop_front();
+    void clear();
+    // Replaces the chunk at pos with all of other's chunks, in order.
+    void replace(iterator pos, ChunkQueue &other);
+
+  private:
+    std::vector<OutChunk> m_slots; // [m_head, m_tail) live, the rest spare
+    size_t m_head{ 0 };
+    size_t m_tail{ 0 };
+};
+
+/*
+ * OutQueue
+ * --------
+ * Ordered response data. Every connection has one; a reply produced away
+ * from the connection (e.g. on the thread owning a room) is built in a
+ * standalone OutQueue and handed over with DeferredReply::complete().
+ */
+struct OutQueue
+{
+    ChunkQueue out;         // queued response data, in order
+    size_t outPending{ 0 }; // unsent bytes across all chunks
+
+    // Queue protocol text (copied).
+    void write(std::string_view text);
+    // Queue borrowed memory; `pin` keeps it alive until it has been sent.
+    void writeRef(const char *data, size_t len, std::shared_ptr<const void> pin);
+    // Queue a file range to be sent with sendfile(); `pin` keeps the
+    // descriptor open until it has been sent.
+    void writeFile(int fileFd, uint64_t offset, size_t len, std::shared_ptr<const void> pin = nullptr);
+};
+
+/*
+ * DeferredReply
+ * -------------
+ * Reserves a connection's next reply slot for an answer that is produced
+ * later, possibly on another thread. Replies queued after it are held back
+ * until complete() fills the slot, so pipelined replies stay in order.
+ */
+struct DeferredReply
+{
+    Reactor *reactor{ nullptr };
+    int fd{ -1 };
+    uint64_t connId{ 0 };
+    uint64_t ticket{ 0 };
+
+    // Thread-safe; a no-op if the connection has gone away meanwhile.
+    void complete(std::string text) const;
+    void complete(OutQueue reply) const;
+};
+
+/*
+ * Connection
+ * ----------
+ * Per-client state machine driven by the reactor:
+ *   Reading  → collecting bytes until a full command line is available
+ *   Writing  → flushing the queued response(s) to the socket
+ *   Closing  → last response queued, socket closes once it is flushed
+ *
+ * A connection that sent KEEPALIVE stays open after each response and may
+ * pipeline any number of commands; responses are queued in command order.
+ * A command can claim the lines that follow it as its body (readBody()),
+ * e.g. the records of a batched POST.
+ *
+ * Connections are pooled per reactor: a closed one is reset and handed to
+ * the next accepted socket with its read buffer, output queue and
+ * scratch/body strings still allocated.
+ */
+struct Connection : OutQueue
+{
+    enum class State
+    {
+        Reading,
+        Writing,
+        Closing
+    };
+
+    int fd{ -1 };
+    uint64_t id{ 0 };             // unique per reactor; guards against fd reuse
+    Reactor *reactor{ nullptr };  // owning event loop
+    State state{ State::Reading };
+    bool keepAlive{ false };  // persistent, pipelined connection
+    bool binary{ false };     // switched to length-prefixed frames (Frame.hpp)
+    uint32_t events{ 0 };     // epoll interest currently registered
+    LineReader reader;        // buffered input, split into command lines
+    uint64_t nextTicket{ 0 };
+    size_t bodyLines{ 0 }; // lines still owed to onBody
+    std::string body;      // body lines collected so far, each with '\n'
+    std::string scratch;   // per-command work buffer; reused, never shrunk
+    std::function<void(Connection &, std::string &body)> onBody;
+    // Runs whenever the output queue has been sent completely; a
+    // subscription uses it to queue the records it held back.
+    std::function<void(Connection &)> onDrained;
+
+    // Reset for reuse on a new socket; buffers keep their capacity.
+    void reuse(int newFd, uint64_t newId, Reactor *owner);
+    // Reserve the next reply slot; see DeferredReply.
+    DeferredReply deferReply();
+    // Route the next `lines` input lines to done() instead of the command
+    // handler, as one newline-terminated block.
+    void readBody(size_t lines, std::function<void(Connection &, std::string &body)> done);
+};
+
+// Invoked once per complete command line (without the trailing newline).
+// The view points into the connection's read buffer and is only valid for
+// the duration of the call. The handler queues its response with
+// conn.write*().
+using CommandHandler = std::function<void(Connection &conn, std::string_view line)>;
+
+// Invoked once per complete frame on a connection that negotiated binary
+// framing; payload is valid for the duration of the call, like line above.
+using FrameHandler = std::function<void(Connection &conn, const FrameHeader &header, std::string_view payload)>;
+
+class Reactor
+{
+  public:
+    // Without a frame handler, "BINARY" is refused and clients stay on text.
+    Reactor(int listenFd, CommandHandler handler, FrameHandler frameHandler = nullptr);
+    ~Reactor();
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    void run(); // Runs the event loop forever
+
+    // Runs task on the loop thread. Safe to call from any thread.
+    void post(std::function<void()> task);
+
+    // Loop thread only. The live connection with this fd and id, or null
+    // once it has been closed (the id guards against fd reuse).
+    Connection *connection(int fd, uint64_t connId);
+
+    // Loop thread only. Sends queued output for a connection written to
+    // outside a handler (e.g. from a posted task); may close it.
+    void flush(Connection &conn);
+
+  private:
+    friend struct DeferredReply;
+
+    void runPosted();
+    void completeDeferred(int fd, uint64_t connId, uint64_t ticket, OutQueue reply);
+    void acceptAll();
+    void onReadable(Connection &conn);
+    void processInput(Connection &conn);
+    void processLines(Connection &conn);
+    void processFrames(Connection &conn);
+    void setInterest(Connection &conn, uint32_t events);
+    void closeConnection(int fd);
+    Connection *lookup(int fd) const;
+
+    const int m_listenFd;
+    int m_epollFd{ -1 };
+    int m_wakeFd{ -1 }; // eventfd signalled by post()
+    uint64_t m_nextConnId{ 0 };
+    CommandHandler m_handler;
+    FrameHandler m_frameHandler;
+    std::vector<std::unique_ptr<Connection>> m_conns; // indexed by fd; null when closed
+    std::vector<std::unique_ptr<Connection>> m_idle;  // closed connections kept for reuse
+
+    std::mutex m_postMutex;
+    std::vector<std::function<void()>> m_posted;
+    std::vector<std::function<void()>> m_running; // loop thread: the batch being run
+};
@@ -0,0 +1,250 @@
+#include "Replica.hpp"
+#include "../common/Frame.hpp"
+#include "../common/LineReader.hpp"
+#include "../common/Logger.hpp"
+#include "../common/Metrics.hpp"
+#include "../common/NetUtils.hpp"
+
+#include <algorithm>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+constexpr std::chrono::milliseconds kProbeInterval{ 1000 };
+constexpr std::chrono::milliseconds kFirstBackoff{ 100 };
+constexpr std::chrono::milliseconds kMaxBackoff{ 5000 };
+
+// Request ids on the replication connection: the subscription, then one
+// per head probe.
+constexpr uint32_t kSubscribeId = 1;
+
+// The metrics read the process's replica (there is at most one).
+const Replica *g_replica = nullptr;
+
+double LagRecords()
+{
+    return g_replica ? static_cast<double>(g_replica->lagRecords()) : 0;
+}
+
+double LagSeconds()
+{
+    return g_replica ? g_replica->lagSeconds() : 0;
+}
+
+MetricGaugeFn g_lagRecords("chat_replica_lag_records", "Records the primary has that this replica has not applied",
+                           LagRecords);
+MetricGaugeFn g_lagSeconds("chat_replica_lag_seconds", "How long this replica has been behind its primary",
+                           LagSeconds);
+MetricCounter g_replicatedRecords("chat_replicated_records_total", "Records applied from the primary");
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// Sends one frame with a u64 payload; ViewMode in the flags for a View.
+bool SendU64Frame(int fd, FrameOp op, uint16_t flags, uint32_t requestId, uint64_t value)
+{
+    char frame[kFrameHeaderSize + 8];
+    EncodeFrameHeader(FrameHeader{ kFrameVersion, op, flags, requestId, 8 }, frame);
+    PutU64(frame + kFrameHeaderSize, value);
+    return SendAll(fd, frame, sizeof frame) == 0;
+}
+} // namespace
+
+Replica::Replica(std::string primaryAddr, Room &room) : m_primaryAddr(std::move(primaryAddr)), m_room(room)
+{
+}
+
+void Replica::start()
+{
+    g_replica = this;
+    m_applied = m_room.log.lastSeq();
+    m_primaryHead = m_applied.load();
+    markBehind(); // until the primary has told us its head
+    std::thread(&Replica::run, this).detach();
+}
+
+uint64_t Replica::lagRecords() const
+{
+    uint64_t head = m_primaryHead.load(std::memory_order_relaxed);
+    uint64_t applied = m_applied.load(std::memory_order_relaxed);
+    return head > applied ? head - applied : 0;
+}
+
+double Replica::lagSeconds() const
+{
+    int64_t since = m_behindSinceNs.load(std::memory_order_relaxed);
+    return since == 0 ? 0 : static_cast<double>(NowNs() - since) / 1e9;
+}
+
+// Starts the lag clock, unless it is already running.
+void Replica::markBehind()
+{
+    int64_t none = 0;
+    m_behindSinceNs.compare_exchange_strong(none, NowNs(), std::memory_order_relaxed);
+}
+
+// The primary has records up to seq.
+void Replica::noteHead(uint64_t seq)
+{
+    uint64_t head = m_primaryHead.load(std::memory_order_relaxed);
+    while (head < seq && !m_primaryHead.compare_exchange_weak(head, seq, std::memory_order_relaxed))
+    {
+    }
+    if (seq > m_applied.load(std::memory_order_relaxed))
+        markBehind();
+}
+
+void Replica::run()
+{
+    std::chrono::milliseconds backoff = kFirstBackoff;
+    while (true)
+    {
+        int fd = TcpConnectHostPort(m_primaryAddr);
+        if (fd >= 0)
+        {
+            LOG_INFO("[REPLICA] Following " << m_primaryAddr << " after #" << m_applied.load());
+            const auto connected = Clock::now();
+            if (!follow(fd))
+                LOG_WARN("[REPLICA] Lost primary " << m_primaryAddr << "; reconnecting");
+            ::close(fd);
+            // A link that stayed up for a while redials at once.
+            if (Clock::now() - connected > kMaxBackoff)
+                backoff = kFirstBackoff;
+        }
+        markBehind();
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, kMaxBackoff);
+    }
+}
+
+/*
+ * follow()
+ * --------
+ * One replication connection: switch to frames, subscribe after the
+ * newest local record and apply pushes until the connection or the local
+ * log fails. A probe thread asks for the primary's head meanwhile.
+ */
+bool Replica::follow(int fd)
+{
+    LineReader reader(fd);
+    std::string_view line;
+    if (SendLine(fd, kBinaryHello) != 0 || reader.next(line) != 1 || line != kBinaryAccept)
+    {
+        LOG_ERROR("[REPLICA] " << m_primaryAddr << " does not accept binary framing");
+        return false;
+    }
+    if (!SendU64Frame(fd, FrameOp::Subscribe, 0, kSubscribeId, m_applied.load()))
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lk(m_probeMutex);
+        m_probeStop = false;
+    }
+    std::thread prober(&Replica::probeLoop, this, fd);
+
+    bool ok = true;
+    std::string frame;
+    FrameHeader h;
+    while (ok)
+    {
+        frame.clear();
+        if (reader.read(kFrameHeaderSize, frame) < 0 || !DecodeFrameHeader(frame.data(), h))
+            break;
+        frame.clear();
+        if (reader.read(h.length, frame) < 0)
+            break;
+
+        if (h.op == FrameOp::Err)
+        {
+            LOG_ERROR("[REPLICA] Primary refused replication: " << frame);
+            ok = false;
+        }
+        else if (h.length < 16 || (h.op != FrameOp::Push && h.op != FrameOp::Ok))
+        {
+            LOG_ERROR("[REPLICA] Unexpected frame (op " << static_cast<int>(h.op) << ") from the primary");
+            ok = false;
+        }
+        else if (h.op == FrameOp::Push)
+        {
+            ok = apply(GetU64(frame.data()), GetU64(frame.data() + 8), std::string_view(frame).substr(16));
+        }
+        else if (h.requestId != kSubscribeId)
+        {
+            // Probe answer: an empty VIEW whose last-seq is the primary's head.
+            noteHead(GetU64(frame.data() + 8));
+        }
+    }
+
+    ::shutdown(fd, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> lk(m_probeMutex);
+        m_probeStop = true;
+    }
+    m_probeCv.notify_all();
+    prober.join();
+    return ok;
+}
+
+void Replica::probeLoop(int fd)
+{
+    uint32_t requestId = kSubscribeId;
+    std::unique_lock<std::mutex> lk(m_probeMutex);
+    while (!m_probeCv.wait_for(lk, kProbeInterval, [this] { return m_probeStop; }))
+    {
+        if (!SendU64Frame(fd, FrameOp::View, static_cast<uint16_t>(ViewMode::Last), ++requestId, 0))
+            return;
+    }
+}
+
+/*
+ * apply()
+ * -------
+ * Appends pushed records firstSeq..lastSeq to the local log under the
+ * same sequence numbers; records the log already holds are skipped. A
+ * gap means the primary no longer has the records in between (archived),
+ * and the replica cannot continue.
+ */
+bool Replica::apply(uint64_t firstSeq, uint64_t lastSeq, std::string_view records)
+{
+    const uint64_t applied = m_applied.load(std::memory_order_relaxed);
+    if (lastSeq <= applied)
+        return true;
+    if (firstSeq > applied + 1)
+    {
+        LOG_ERROR("[REPLICA] Primary no longer has records #" << applied + 1 << "..#" << firstSeq - 1
+                                                               << "; start this replica from a copy of its log");
+        return false;
+    }
+    for (uint64_t seq = firstSeq; seq <= applied; ++seq)
+        records.remove_prefix(records.find('\n') + 1);
+
+    Room &room = m_room;
+    const bool group = room.log.durability() == ChatLog::Durability::Group;
+    uint64_t seq = group ? room.log.appendBatch(records, [&room](uint64_t last, bool ok) {
+        if (ok)
+            room.subscribers.publish(last);
+    })
+                         : room.log.appendBatch(records);
+    if (seq != lastSeq)
+    {
+        LOG_ERROR("[REPLICA] Local log rejected records #" << applied + 1 << "..#" << lastSeq << " (got #" << seq
+                                                            << ")");
+        return false;
+    }
+    if (!group)
+        room.subscribers.publish(seq);
+
+    g_replicatedRecords.add(lastSeq - applied);
+    m_applied.store(lastSeq, std::memory_order_relaxed);
+    noteHead(lastSeq);
+    if (lastSeq >= m_primaryHead.load(std::memory_order_relaxed))
+        m_behindSinceNs.store(0, std::memory_order_relaxed);
+    LOG_DEBUG("[REPLICA] Applied #" << applied + 1 << "..#" << lastSeq);
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "Rooms.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/*
+ *  Replica.hpp
+ *  -----------
+ *  Read replica of another server's default room (--replica-of).
+ *
+ *  The replica subscribes to the primary like a live-tail client, over a
+ *  binary connection, starting after the newest record in its own log.
+ *  Every pushed batch is appended to the local log with the primary's
+ *  sequence numbers and published to local subscribers, so the replica
+ *  serves VIEW and SUBSCRIBE from its own files and cache. Replicas can
+ *  follow replicas. In group durability mode the primary pushes a record
+ *  only after it has been synced, so a replica never holds a record the
+ *  primary could lose in a crash.
+ *
+ *  Once a second the replica asks the primary for its newest sequence
+ *  number (a "VIEW LAST 0" frame on the same connection). Records not yet
+ *  applied, and for how long the replica has been behind, are exported as
+ *  chat_replica_lag_records and chat_replica_lag_seconds. A lost
+ *  connection is redialled with backoff and resumes where it stopped.
+ */
+class Replica
+{
+  public:
+    Replica(std::string primaryAddr, Room &room);
+
+    Replica(const Replica &) = delete;
+    Replica &operator=(const Replica &) = delete;
+
+    // Starts following on a background thread; the replica lives for the
+    // rest of the process.
+    void start();
+
+    const std::string &primary() const
+    {
+        return m_primaryAddr;
+    }
+    uint64_t lagRecords() const;
+    double lagSeconds() const;
+
+  private:
+    void run();
+    bool follow(int fd);
+    void probeLoop(int fd);
+    bool apply(uint64_t firstSeq, uint64_t lastSeq, std::string_view records);
+    void noteHead(uint64_t seq);
+    void markBehind();
+
+    const std::string m_primaryAddr;
+    Room &m_room;
+
+    std::atomic<uint64_t> m_applied{ 0 };     // newest record in the local log
+    std::atomic<uint64_t> m_primaryHead{ 0 }; // newest record the primary reported
+    std::atomic<int64_t> m_behindSinceNs{ 0 }; // steady clock; 0 while caught up
+
+    // Stops the probe thread of the current connection.
+    std::mutex m_probeMutex;
+    std::condition_variable m_probeCv;
+    bool m_probeStop{ false };
+};
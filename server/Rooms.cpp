@@ -0,0 +1,76 @@
+#include "Rooms.hpp"
+#include "../common/Logger.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+
+void RoomTable::addShard(Reactor *reactor)
+{
+    m_shards.push_back(std::make_unique<Shard>());
+    m_shards.back()->reactor = reactor;
+}
+
+bool RoomTable::validName(std::string_view name)
+{
+    if (name.empty() || name.size() > 64)
+        return false;
+    for (char c : name)
+    {
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-'))
+            return false;
+    }
+    return true;
+}
+
+void RoomTable::withRoom(std::string_view name, std::function<void(Room *room)> task)
+{
+    Shard &shard = *m_shards[std::hash<std::string_view>{}(name) % m_shards.size()];
+    shard.reactor->post([this, &shard, roomName = std::string(name), task = std::move(task)] {
+        task(open(shard, roomName));
+    });
+}
+
+/*
+ * open()
+ * ------
+ * Owner thread. Rooms stay open for the life of the server, so a Room
+ * pointer handed to another thread (e.g. to subscribe) never dangles.
+ */
+Room *RoomTable::open(Shard &shard, const std::string &name)
+{
+    auto it = shard.rooms.find(name);
+    if (it != shard.rooms.end())
+        return it->second.get();
+
+    if (::mkdir(m_settings.dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        LOG_ERROR("[ROOMS] Cannot create " << m_settings.dir << ": " << strerror(errno));
+        return nullptr;
+    }
+
+    // Reserve a slot first: shards open rooms concurrently.
+    if (m_openRooms.fetch_add(1) >= m_settings.maxRooms)
+    {
+        m_openRooms.fetch_sub(1);
+        if (!m_capLogged.exchange(true))
+            LOG_WARN("[ROOMS] " << m_settings.maxRooms << " rooms are open; refusing new rooms (--max-rooms)");
+        return nullptr;
+    }
+
+    auto room = std::make_unique<Room>(name);
+    room->log.setDurability(m_settings.durability, m_settings.groupWindow, m_settings.groupMax);
+    room->log.setSegments(m_settings.segmentBytes, m_settings.retainSegments);
+    if (!room->log.open(m_settings.dir + "/" + name + ".txt", m_settings.cacheBytes))
+    {
+        m_openRooms.fetch_sub(1);
+        LOG_ERROR("[ROOMS] Cannot open room " << name);
+        return nullptr;
+    }
+    room->subscribers.setQueueLimit(m_settings.subscriberQueue);
+    room->compressed.setCapacity(m_settings.compressedCacheBytes);
+    room->subscribers.publish(room->log.lastSeq());
+
+    LOG_INFO("[ROOMS] Opened room " << name << " (" << room->log.lastSeq() << " records)");
+    return shard.rooms.emplace(name, std::move(room)).first->second.get();
+}
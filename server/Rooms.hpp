@@ -0,0 +1,95 @@
+#pragma once
+#include "ChatLog.hpp"
+#include "CompressedHistory.hpp"
+#include "Reactor.hpp"
+#include "Subscribers.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  Rooms.hpp
+ *  ---------
+ *  Named chat rooms, each with its own log file, cache and subscribers.
+ *
+ *  Rooms are hash-sharded over the reactor threads: the room "ops" lives
+ *  on reactors[hash("ops") % N], is opened there on first use and is only
+ *  ever appended to by that thread. A command for a room is posted to its
+ *  shard and the result travels back through a DeferredReply, so posts to
+ *  rooms on different shards never touch the same lock, file or cache, and
+ *  throughput grows with the number of reactors (--threads).
+ *
+ *  Room logs are "<dir>/<name>.txt" (kept as segments, see ChatLog).
+ *  Names are 1–64 of [A-Za-z0-9_-]. The unnamed default room is the
+ *  server's --file and is served inline by whichever reactor received the
+ *  command.
+ *
+ *  Any client can name a new room, and an open room holds its files (and,
+ *  with group durability, a sync thread) until the server exits, so at
+ *  most Settings::maxRooms rooms are open at once; beyond that, commands
+ *  for new rooms fail.
+ */
+
+struct Room
+{
+    explicit Room(std::string roomName) : name(std::move(roomName)), subscribers(log)
+    {
+    }
+
+    const std::string name;
+    ChatLog log;
+    SubscriberHub subscribers;
+    CompressedHistory compressed; // VIEW ... COMPRESS blocks
+};
+
+class RoomTable
+{
+  public:
+    struct Settings
+    {
+        std::string dir{ "./rooms" };
+        size_t cacheBytes{ 4u << 20 };
+        size_t compressedCacheBytes{ 1u << 20 };
+        ChatLog::Durability durability{ ChatLog::Durability::None };
+        std::chrono::microseconds groupWindow{ 200 };
+        size_t groupMax{ 256 };
+        uint64_t segmentBytes{ 64u << 20 };
+        size_t retainSegments{ 0 };
+        size_t subscriberQueue{ 256 * 1024 };
+        size_t maxRooms{ 256 };
+    };
+
+    void configure(Settings settings)
+    {
+        m_settings = std::move(settings);
+    }
+
+    // Registers a shard; all shards must be added before any reactor runs.
+    void addShard(Reactor *reactor);
+
+    static bool validName(std::string_view name);
+
+    // Any thread. Runs task on the thread owning the room, with the room
+    // opened (and created if needed), or with null if it cannot be opened.
+    void withRoom(std::string_view name, std::function<void(Room *room)> task);
+
+  private:
+    struct Shard
+    {
+        Reactor *reactor;
+        std::unordered_map<std::string, std::unique_ptr<Room>> rooms; // owner thread only
+    };
+
+    Room *open(Shard &shard, const std::string &name);
+
+    Settings m_settings;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::atomic<size_t> m_openRooms{ 0 }; // over all shards
+    std::atomic<bool> m_capLogged{ false };
+};
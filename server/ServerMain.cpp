@@ -1,108 +1,850 @@
 #include "../common/NetUtils.hpp"
-#include "../debug.hpp"
+#include "../common/Logger.hpp"
+#include "../common/Lz4.hpp"
+#include "../common/Metrics.hpp"
+#include "AllocCounter.hpp"
+#include "ChatLog.hpp"
+#include "Reactor.hpp"
+#include "Replica.hpp"
+#include "Rooms.hpp"
+#include "Subscribers.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <fstream>
-#include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 static std::string g_file;
+static Room g_lobby(""); // the default room: --file, served inline
+static RoomTable g_rooms;
+static std::unique_ptr<Replica> g_replica; // set with --replica-of: the lobby is read-only
 
-static void HandleView(int clientFd)
+// Upper bound on records per POSTS batch; bounds what one command buffers.
+static constexpr uint64_t kMaxBatch = 1024;
+
+static MetricHistogram g_viewService("chat_view_service_seconds", "Time to build a VIEW reply (queued, not sent)");
+static MetricHistogram g_postService("chat_post_service_seconds", "Time to append a POST/POSTS batch to the log");
+static MetricCounter g_viewBytes("chat_view_bytes_total", "Record bytes served by VIEW");
+static MetricCounter g_viewCompressedBytes("chat_view_compressed_bytes_total",
+                                           "Bytes sent for VIEW COMPRESS (the records are in chat_view_bytes_total)");
+static MetricCounter g_postedRecords("chat_posted_records_total", "Records appended by POST and POSTS");
+static MetricCounter g_failedPosts("chat_post_failures_total", "POST/POSTS batches the log could not append");
+
+static bool StartsWith(std::string_view s, std::string_view prefix)
+{
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+// Splits the next space-separated word off the front of rest.
+static std::string_view NextWord(std::string_view &rest)
+{
+    size_t begin = rest.find_first_not_of(' ');
+    if (begin == std::string_view::npos)
+    {
+        rest = {};
+        return {};
+    }
+    size_t end = rest.find(' ', begin);
+    std::string_view word = rest.substr(begin, end == std::string_view::npos ? end : end - begin);
+    rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end);
+    if (rest.find_first_not_of(' ') == std::string_view::npos)
+        rest = {};
+    return word;
+}
+
+static bool ParseU64(std::string_view text, uint64_t &value)
+{
+    auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && res.ec == std::errc() && res.ptr == text.data() + text.size();
+}
+
+/*
+ * ReplyTo
+ * -------
+ * Replies go back in the framing their request arrived in; binary replies
+ * also echo the request id.
+ */
+struct ReplyTo
+{
+    bool binary{ false };
+    uint32_t requestId{ 0 };
+};
+
+static std::string ErrorReply(const ReplyTo &to, std::string_view message)
+{
+    if (to.binary)
+        return MakeFrame(FrameOp::Err, 0, to.requestId, message);
+    return "ERR " + std::string(message) + "\n";
+}
+
+// Small replies are formatted into a caller's stack buffer of this size:
+// a frame header and two u64s, or "OK" and up to three numbers.
+static constexpr size_t kReplyMax = 80;
+
+// " <n>": the separator and the number.
+static char *PutNumber(char *out, uint64_t n)
+{
+    *out++ = ' ';
+    return std::to_chars(out, out + 20, n).ptr;
+}
+
+// Text: "OK <seq>" for POST, "OK <first-seq> <last-seq>" for POSTS.
+// Binary: Ok frame with u64 first-seq, u64 last-seq.
+static std::string_view PostReply(char (&buf)[kReplyMax], const ReplyTo &to, uint64_t first, uint64_t last,
+                                  bool batch)
+{
+    char *p = buf;
+    if (to.binary)
+    {
+        EncodeFrameHeader(FrameHeader{ kFrameVersion, FrameOp::Ok, 0, to.requestId, 16 }, buf);
+        p = PutU64(PutU64(buf + kFrameHeaderSize, first), last);
+    }
+    else
+    {
+        *p++ = 'O';
+        *p++ = 'K';
+        if (batch)
+            p = PutNumber(p, first);
+        p = PutNumber(p, last);
+        *p++ = '\n';
+    }
+    return std::string_view(buf, static_cast<size_t>(p - buf));
+}
+
+static uint64_t FirstSeqFor(Room &room, ViewMode mode, uint64_t arg)
 {
-    std::ifstream file(g_file);
-    if (!file.is_open())
+    if (mode == ViewMode::Last)
     {
-        std::ofstream create(g_file);
-        create.close();
-        file.open(g_file);
+        uint64_t last = room.log.lastSeq();
+        return arg >= last ? 1 : last - arg + 1;
     }
+    if (mode == ViewMode::Since)
+        return arg + 1;
+    return 1;
+}
+
+// Records a binary VIEW COMPRESS reply may cover, so that the blocks and
+// their headers still fit one frame even if nothing compresses.
+static constexpr uint64_t kMaxCompressedView =
+    kMaxFramePayload - 16 - kCompressedBlockHeader * (kMaxFramePayload / CompressedHistory::kChunkSize + 2);
 
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    dprintf(clientFd, "OK %zu\n%s.\n", content.size(), content.c_str());
+/*
+ * ServeView()
+ * -----------
+ * Replies with records firstSeq..newest.
+ *   text:   "OK <bytes> <first-seq> <last-seq>\n<records>.\n"
+ *   binary: Ok frame: u64 first-seq, u64 last-seq, <records>
+ * Records always end with '\n', so the "." terminator is on its own line.
+ * A binary reply stops at the frame size limit; its last-seq tells the
+ * client where to continue with SINCE.
+ *
+ * With compress, <records> is replaced by compressed blocks (Lz4.hpp) and
+ * <bytes> counts the blocks; the text status line ends in " LZ4".
+ */
+static void ServeView(OutQueue &out, Room &room, const ReplyTo &to, uint64_t firstSeq, bool compress)
+{
+    const auto start = std::chrono::steady_clock::now();
+    // Zero-copy reply: the header is the only formatted text; history older
+    // than the cache goes out with sendfile() and the cached tail straight
+    // from the pinned cache blocks. The slice is reused by every VIEW on
+    // this thread, so its vectors are allocated once.
+    thread_local ChatLog::Slice slice;
+    thread_local std::vector<CompressedHistory::Block> blocks;
+    const uint64_t maxBytes = !to.binary ? UINT64_MAX : compress ? kMaxCompressedView : kMaxFramePayload - 16;
+    room.log.slice(firstSeq, slice, UINT64_MAX, maxBytes);
 
-    std::cout << Timestamp() << " [SERVER] VIEW request served. File size: " << content.size() << " bytes" << std::endl;
+    uint64_t size = slice.size();
+    if (compress)
+    {
+        if (!room.compressed.encode(slice, blocks))
+        {
+            slice.files.clear();
+            slice.blocks.clear();
+            out.write(ErrorReply(to, "read failed"));
+            return;
+        }
+        size = 0;
+        for (const auto &block : blocks)
+            size += block->size();
+    }
+
+    char head[kReplyMax];
+    char *p = head;
+    if (to.binary)
+    {
+        EncodeFrameHeader(FrameHeader{ kFrameVersion, FrameOp::Ok, 0, to.requestId, static_cast<uint32_t>(16 + size) },
+                          head);
+        p = PutU64(PutU64(head + kFrameHeaderSize, slice.firstSeq), slice.lastSeq);
+    }
+    else
+    {
+        *p++ = 'O';
+        *p++ = 'K';
+        p = PutNumber(PutNumber(PutNumber(p, size), slice.firstSeq), slice.lastSeq);
+        if (compress)
+            p = std::copy_n(" LZ4", 4, p);
+        *p++ = '\n';
+    }
+    out.write(std::string_view(head, static_cast<size_t>(p - head)));
+    if (compress)
+    {
+        for (const auto &block : blocks)
+            out.writeRef(block->data(), block->size(), block);
+        blocks.clear();
+        g_viewCompressedBytes.add(size);
+    }
+    else
+    {
+        QueueSlice(out, slice);
+    }
+    if (!to.binary)
+        out.write(".\n");
+    // The queued chunks hold their own pins.
+    slice.files.clear();
+    slice.blocks.clear();
+
+    g_viewBytes.add(slice.size());
+    g_viewService.observeSince(start);
+    LOG_DEBUG("[SERVER] VIEW request served. Records " << slice.firstSeq << ".." << slice.lastSeq
+              << ", " << slice.size() << " bytes" << (compress ? " (" + std::to_string(size) + " compressed)" : ""));
 }
 
-static void HandlePost(int clientFd, const std::string &line)
+/*
+ * ServePost()
+ * -----------
+ * Appends count newline-terminated records with one write and replies
+ * with the sequence numbers the log assigned to them; those numbers are
+ * the records' global positions, so clients need no lock of their own to
+ * agree on the order. With group commit the "OK" is deferred until the
+ * batch holding the records has been synced; later pipelined replies on
+ * the same connection wait behind it. Subscribers are sent the records
+ * once they are committed, i.e. synced in group mode.
+ *
+ * conn is set when the connection belongs to this thread (default room);
+ * otherwise the reply goes into the slot reserved by `deferred`.
+ */
+static void ServePost(Room &room, Connection *conn, DeferredReply deferred, const ReplyTo &to,
+                      std::string_view records, uint64_t count, bool batch)
 {
-    std::ofstream file(g_file, std::ios::app);
-    if (!file.is_open())
+    const auto start = std::chrono::steady_clock::now();
+    const bool group = room.log.durability() == ChatLog::Durability::Group;
+    if (conn && group)
+        deferred = conn->deferReply();
+    auto reply = [conn, &deferred](std::string_view text) {
+        if (deferred.reactor)
+            deferred.complete(std::string(text));
+        else
+            conn->write(text);
+    };
+
+    char buf[kReplyMax];
+    uint64_t last;
+    if (group)
+    {
+        last = room.log.appendBatch(records, [&room, deferred, to, count, batch](uint64_t seq, bool ok) {
+            char okBuf[kReplyMax];
+            deferred.complete(ok ? std::string(PostReply(okBuf, to, seq - count + 1, seq, batch))
+                                 : ErrorReply(to, "sync"));
+            if (ok)
+                room.subscribers.publish(seq);
+        });
+        if (last == 0)
+            reply(ErrorReply(to, "open"));
+    }
+    else
     {
-        dprintf(clientFd, "ERR open\n");
-        std::cerr << Timestamp() << " [SERVER] ERROR: Failed to open file for POST" << std::endl;
+        last = room.log.appendBatch(records);
+        if (last != 0)
+            reply(PostReply(buf, to, last - count + 1, last, batch));
+        else
+            reply(ErrorReply(to, "open"));
+        room.subscribers.publish(last);
+    }
+
+    g_postService.observeSince(start);
+    if (last == 0)
+    {
+        g_failedPosts.add();
+        LOG_ERROR("[SERVER] Failed to append POST to room '" << room.name << "'");
         return;
     }
+    g_postedRecords.add(count);
+    LOG_DEBUG("[SERVER] POST appended as #" << last - count + 1 << ".." << last);
+}
 
-    std::string message = line.substr(5);
-    file << message << "\n";
-    file.close();
+/*
+ * ServeSubscribe()
+ * ----------------
+ * Answers "OK <since-seq>" and starts pushing the room's records after
+ * since-seq (default: the newest committed one). Runs on conn's thread.
+ */
+static void ServeSubscribe(Room &room, Connection &conn, const ReplyTo &to, uint64_t since)
+{
+    char buf[kReplyMax];
+    conn.write(PostReply(buf, to, since, since, false));
+    room.subscribers.subscribe(conn, since, to.binary);
+}
 
-    dprintf(clientFd, "OK\n");
-    std::cout << Timestamp() << " [SERVER] POST appended: " << message << std::endl;
+/*
+ * ServeStats()
+ * ------------
+ * Replies with every metric in Prometheus text format (see Metrics.hpp).
+ *   text:   "OK <bytes>\n<dump>.\n"  (every dump line ends with '\n')
+ *   binary: Ok frame with the dump as payload
+ * A diagnostic, so its allocations are exempt from the request path.
+ */
+static void ServeStats(Connection &conn, const ReplyTo &to)
+{
+    AllocExemption diagnostic;
+    std::string dump = MetricsRegistry::instance().render();
+    if (to.binary)
+        conn.write(MakeFrame(FrameOp::Ok, 0, to.requestId, dump));
+    else
+        conn.write("OK " + std::to_string(dump.size()) + "\n" + dump + ".\n");
 }
 
-int main(int argc, char **argv)
+/*
+ * ViewIn() / PostIn() / SubscribeIn()
+ * -----------------------------------
+ * Route a command to its room. The default room (empty name) is served
+ * right here. A named room is served on the reactor that owns it: the
+ * connection reserves its reply slot, the owner fills it, and pipelined
+ * replies behind it stay in order.
+ *
+ * A replica only has the default room, and only the primary accepts posts.
+ */
+static bool RefusedByReplica(Connection &conn, std::string_view roomName, const ReplyTo &to, bool write)
 {
-    std::string bindAddr = "0.0.0.0:7000";
-    g_file = "./chat.txt";
+    if (!g_replica || (roomName.empty() && !write))
+        return false;
+    conn.write(ErrorReply(to, write ? "read-only replica" : "replica serves the default room only"));
+    return true;
+}
 
-    for (int i = 1; i < argc; ++i)
+static void ViewIn(Connection &conn, std::string_view roomName, const ReplyTo &to, ViewMode mode, uint64_t arg,
+                   bool compress)
+{
+    if (RefusedByReplica(conn, roomName, to, false))
+        return;
+    if (roomName.empty())
     {
-        if (!strcmp(argv[i], "--bind") && i + 1 < argc)
-            bindAddr = argv[++i];
-        else if (!strcmp(argv[i], "--file") && i + 1 < argc)
-            g_file = argv[++i];
+        ServeView(conn, g_lobby, to, FirstSeqFor(g_lobby, mode, arg), compress);
+        return;
     }
+    DeferredReply deferred = conn.deferReply();
+    g_rooms.withRoom(roomName, [deferred, to, mode, arg, compress](Room *room) {
+        if (!room)
+        {
+            deferred.complete(ErrorReply(to, "room unavailable"));
+            return;
+        }
+        OutQueue reply;
+        ServeView(reply, *room, to, FirstSeqFor(*room, mode, arg), compress);
+        deferred.complete(std::move(reply));
+    });
+}
 
-    std::cout << Timestamp() << " [SERVER] Starting on " << bindAddr << " using file: " << g_file << std::endl;
+// records is only read during the call; a named room takes a copy.
+static void PostIn(Connection &conn, std::string_view roomName, const ReplyTo &to, std::string_view records,
+                   uint64_t count, bool batch)
+{
+    if (RefusedByReplica(conn, roomName, to, true))
+        return;
+    if (roomName.empty())
+    {
+        ServePost(g_lobby, &conn, DeferredReply{}, to, records, count, batch);
+        return;
+    }
+    DeferredReply deferred = conn.deferReply();
+    g_rooms.withRoom(roomName, [deferred, to, records = std::string(records), count, batch](Room *room) {
+        if (!room)
+        {
+            deferred.complete(ErrorReply(to, "room unavailable"));
+            return;
+        }
+        ServePost(*room, nullptr, deferred, to, records, count, batch);
+    });
+}
 
-    int listenFd = TcpListen(bindAddr);
-    if (listenFd < 0)
+static void SubscribeIn(Connection &conn, std::string_view roomName, const ReplyTo &to, bool hasSince,
+                        uint64_t since)
+{
+    if (RefusedByReplica(conn, roomName, to, false))
+        return;
+    conn.keepAlive = true;
+    if (roomName.empty())
     {
-        std::cerr << Timestamp() << " [SERVER] ERROR: Failed to bind " << bindAddr << std::endl;
-        return 1;
+        ServeSubscribe(g_lobby, conn, to, hasSince ? since : g_lobby.subscribers.committed());
+        return;
+    }
+    DeferredReply deferred = conn.deferReply();
+    g_rooms.withRoom(roomName, [deferred, to, hasSince, since](Room *room) {
+        if (!room)
+        {
+            deferred.complete(ErrorReply(to, "room unavailable"));
+            return;
+        }
+        uint64_t from = hasSince ? since : room->subscribers.committed();
+        // Subscriptions live on the connection's own loop. Both tasks are
+        // posted there in order, so the "OK" precedes the first push.
+        char buf[kReplyMax];
+        deferred.complete(std::string(PostReply(buf, to, from, from, false)));
+        Reactor *reactor = deferred.reactor;
+        reactor->post([deferred, reactor, room, to, from] {
+            if (Connection *conn = reactor->connection(deferred.fd, deferred.connId))
+            {
+                room->subscribers.subscribe(*conn, from, to.binary);
+                reactor->flush(*conn);
+            }
+        });
+    });
+}
+
+// Takes a leading "#room" word off rest; false if the name is invalid.
+// A bare "#" names the default room, so a message that itself starts with
+// '#' can still be posted there.
+static bool TakeRoom(std::string_view &rest, std::string_view &room)
+{
+    std::string_view probe = rest;
+    std::string_view word = NextWord(probe);
+    room = {};
+    if (word.empty() || word[0] != '#')
+        return true;
+    room = word.substr(1);
+    rest = probe;
+    return room.empty() || RoomTable::validName(room);
+}
+
+/*
+ * HandleView()
+ * ------------
+ *   VIEW [#room]                → whole history
+ *   VIEW [#room] LAST n         → newest n records   (legacy alias: "view -n n")
+ *   VIEW [#room] SINCE seq      → records with sequence number > seq
+ * Any of them may end in COMPRESS (see ServeView()).
+ */
+static void HandleView(Connection &conn, std::string_view line)
+{
+    std::string_view rest = line;
+    NextWord(rest); // "VIEW"
+    std::string_view room;
+    if (!TakeRoom(rest, room))
+    {
+        conn.write("ERR bad room name\n");
+        return;
+    }
+    std::string_view mode = NextWord(rest);
+    bool compress = false;
+    if (mode == "COMPRESS")
+    {
+        compress = true;
+        mode = NextWord(rest);
+    }
+
+    ViewMode viewMode = ViewMode::All;
+    uint64_t arg = 0;
+    bool ok = true;
+    if (!mode.empty())
+    {
+        if (mode == "LAST" || mode == "-n")
+            viewMode = ViewMode::Last;
+        else if (mode == "SINCE")
+            viewMode = ViewMode::Since;
+        ok = viewMode != ViewMode::All && ParseU64(NextWord(rest), arg);
+    }
+    std::string_view tail = rest;
+    if (ok && !compress && NextWord(tail) == "COMPRESS" && tail.empty())
+    {
+        compress = true;
+        rest = tail;
+    }
+    if (!ok || !rest.empty())
+    {
+        conn.write("ERR usage: VIEW [#room] [LAST n | SINCE seq] [COMPRESS]\n");
+        return;
     }
+    ViewIn(conn, room, ReplyTo{}, viewMode, arg, compress);
+}
 
-    std::cout << Timestamp() << " [SERVER] Listening for connections..." << std::endl;
+// "POST [#room] <message>"; the message is kept byte for byte after the
+// single space that ends the verb or the room.
+static void HandlePost(Connection &conn, std::string_view line)
+{
+    std::string_view message = line.substr(5);
+    std::string_view room;
+    if (!message.empty() && message[0] == '#')
+    {
+        if (!TakeRoom(message, room))
+        {
+            conn.write("ERR bad room name\n");
+            return;
+        }
+        if (!message.empty())
+            message.remove_prefix(1);
+    }
+    std::string &record = conn.scratch;
+    record.assign(message.data(), message.size());
+    record.push_back('\n');
+    PostIn(conn, room, ReplyTo{}, record, 1, false);
+}
+
+/*
+ * HandlePostBatch()
+ * -----------------
+ * "POSTS [#room] <n>" followed by n record lines: all n records are
+ * appended with one write and acknowledged with one
+ * "OK <first-seq> <last-seq>".
+ */
+static void HandlePostBatch(Connection &conn, std::string_view line)
+{
+    std::string_view rest = line;
+    NextWord(rest); // "POSTS"
+    std::string_view room;
+    uint64_t count = 0;
+    bool roomOk = TakeRoom(rest, room);
+    if (!roomOk || !ParseU64(NextWord(rest), count) || count == 0 || count > kMaxBatch || !rest.empty())
+    {
+        conn.write("ERR usage: POSTS [#room] <1-" + std::to_string(kMaxBatch) + ">\n");
+        return;
+    }
+
+    conn.readBody(count, [count, roomName = std::string(room)](Connection &conn, std::string &records) {
+        PostIn(conn, roomName, ReplyTo{}, records, count, true);
+    });
+}
+
+/*
+ * HandleSubscribe()
+ * -----------------
+ * "SUBSCRIBE [#room] [since-seq]" → "OK <since-seq>", then every record
+ * after since-seq (default: the newest committed one) is pushed as it is
+ * committed; see SubscriberHub. The connection stays open and may keep
+ * sending commands.
+ */
+static void HandleSubscribe(Connection &conn, std::string_view line)
+{
+    std::string_view rest = line;
+    NextWord(rest); // "SUBSCRIBE"
+    std::string_view room;
+    bool roomOk = TakeRoom(rest, room);
+    std::string_view sinceText = NextWord(rest);
+    uint64_t since = 0;
+    if (!roomOk || (!sinceText.empty() && !ParseU64(sinceText, since)) || !rest.empty())
+    {
+        conn.write("ERR usage: SUBSCRIBE [#room] [since-seq]\n");
+        return;
+    }
+    SubscribeIn(conn, room, ReplyTo{}, !sinceText.empty(), since);
+}
 
-    while (true)
+/*
+ * HandleFrame()
+ * -------------
+ * Binary protocol entry point (see Frame.hpp for the payload layouts).
+ * With kFrameRoomFlag set the payload starts with the room name. The chat
+ * file stores one record per line, so records with an embedded newline
+ * are refused rather than split.
+ */
+static void HandleFrame(Connection &conn, const FrameHeader &header, std::string_view payload)
+{
+    const ReplyTo to{ true, header.requestId };
+    std::string_view room;
+    if (header.flags & kFrameRoomFlag)
     {
-        int clientFd = ::accept(listenFd, nullptr, nullptr);
-        if (clientFd < 0)
+        size_t len = payload.empty() ? 0 : static_cast<uint8_t>(payload[0]);
+        room = payload.substr(std::min<size_t>(1, payload.size()), len);
+        if (payload.size() < 1 + len || !RoomTable::validName(room))
         {
-            std::cerr << Timestamp() << " [SERVER] WARNING: accept() failed" << std::endl;
-            continue;
+            conn.write(ErrorReply(to, "bad room name"));
+            return;
         }
+        payload.remove_prefix(1 + len);
+    }
+    const uint16_t flags = header.flags & ~kFrameRoomFlag;
 
-        std::string line;
-        if (RecvLine(clientFd, line) <= 0)
+    switch (header.op)
+    {
+    case FrameOp::View: {
+        auto mode = static_cast<ViewMode>(flags & ~kViewCompressFlag);
+        if (mode != ViewMode::All && mode != ViewMode::Last && mode != ViewMode::Since)
+            break;
+        if (mode != ViewMode::All && payload.size() != 8)
+            break;
+        ViewIn(conn, room, to, mode, mode == ViewMode::All ? 0 : GetU64(payload.data()),
+               (flags & kViewCompressFlag) != 0);
+        return;
+    }
+    case FrameOp::Post: {
+        if (payload.find('\n') != std::string_view::npos)
         {
-            std::cerr << Timestamp() << " [SERVER] WARNING: Failed to receive data from client" << std::endl;
-            ::close(clientFd);
-            continue;
+            conn.write(ErrorReply(to, "newline in record"));
+            return;
         }
+        std::string &record = conn.scratch;
+        record.assign(payload.data(), payload.size());
+        record.push_back('\n');
+        PostIn(conn, room, to, record, 1, false);
+        return;
+    }
+    case FrameOp::PostBatch: {
+        std::string &records = conn.scratch;
+        records.clear();
+        uint64_t count = 0;
+        while (payload.size() >= 4)
+        {
+            uint32_t len = GetU32(payload.data());
+            if (len > payload.size() - 4)
+                break;
+            std::string_view record = payload.substr(4, len);
+            if (record.find('\n') != std::string_view::npos)
+            {
+                conn.write(ErrorReply(to, "newline in record"));
+                return;
+            }
+            records.append(record.data(), record.size());
+            records.push_back('\n');
+            payload.remove_prefix(4 + len);
+            ++count;
+        }
+        if (!payload.empty() || count == 0 || count > kMaxBatch)
+            break;
+        PostIn(conn, room, to, records, count, true);
+        return;
+    }
+    case FrameOp::Subscribe: {
+        if (!payload.empty() && payload.size() != 8)
+            break;
+        SubscribeIn(conn, room, to, !payload.empty(), payload.empty() ? 0 : GetU64(payload.data()));
+        return;
+    }
+    case FrameOp::Stats: {
+        if (!payload.empty() || !room.empty())
+            break;
+        ServeStats(conn, to);
+        return;
+    }
+    default:
+        break;
+    }
+
+    conn.write(ErrorReply(to, "bad request"));
+    LOG_WARN("[SERVER] Malformed or unknown frame (op " << int(header.op) << ")");
+}
 
-        std::cout << Timestamp() << " [SERVER] Received line: \"" << line << "\"" << std::endl;
+static bool ParseDurability(const char *name, ChatLog::Durability &mode)
+{
+    if (!strcmp(name, "none"))
+        mode = ChatLog::Durability::None;
+    else if (!strcmp(name, "group"))
+        mode = ChatLog::Durability::Group;
+    else if (!strcmp(name, "strict"))
+        mode = ChatLog::Durability::Strict;
+    else
+        return false;
+    return true;
+}
 
-        if (line.rfind("VIEW", 0) == 0)
+static void HandleCommand(Connection &conn, std::string_view line)
+{
+    if (line == "VIEW" || StartsWith(line, "VIEW ") || StartsWith(line, "view -n"))
+    {
+        HandleView(conn, line);
+    }
+    else if (line == "SUBSCRIBE" || StartsWith(line, "SUBSCRIBE "))
+    {
+        HandleSubscribe(conn, line);
+    }
+    else if (StartsWith(line, "POSTS "))
+    {
+        HandlePostBatch(conn, line);
+    }
+    else if (StartsWith(line, "POST "))
+    {
+        HandlePost(conn, line);
+    }
+    else if (line == "STATS")
+    {
+        ServeStats(conn, ReplyTo{});
+    }
+    else
+    {
+        conn.write("ERR unknown\n");
+        LOG_WARN("[SERVER] Unknown command received");
+    }
+}
+
+// Lift the soft descriptor limit to the hard limit so one process can hold
+// thousands of client connections.
+static void RaiseFdLimit()
+{
+    struct rlimit rl
+    {
+    };
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    std::string bindAddr = "0.0.0.0:7000";
+    g_file = "./chat.txt";
+    int threads = 1;
+    size_t cacheMb = 64;
+    size_t compressCacheMb = 16;
+    size_t segmentMb = 64;
+    size_t retainSegments = 0;
+    ChatLog::Durability durability = ChatLog::Durability::None;
+    long groupWindowUs = 200;
+    size_t groupMax = 256;
+    size_t subscriberQueueKb = 256;
+    RoomTable::Settings rooms;
+    std::string metricsListen;
+    std::string metricsFile;
+    int metricsIntervalS = 10;
+    std::string primaryAddr;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--bind") && i + 1 < argc)
+            bindAddr = argv[++i];
+        else if (!strcmp(argv[i], "--file") && i + 1 < argc)
+            g_file = argv[++i];
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--cache-mb") && i + 1 < argc)
+            cacheMb = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--compress-cache-mb") && i + 1 < argc)
+            compressCacheMb = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--segment-mb") && i + 1 < argc)
+            segmentMb = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--retain-segments") && i + 1 < argc)
+            retainSegments = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--rooms-dir") && i + 1 < argc)
+            rooms.dir = argv[++i];
+        else if (!strcmp(argv[i], "--room-cache-mb") && i + 1 < argc)
+            rooms.cacheBytes = std::strtoul(argv[++i], nullptr, 10) << 20;
+        else if (!strcmp(argv[i], "--max-rooms") && i + 1 < argc)
+            rooms.maxRooms = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--room-compress-cache-mb") && i + 1 < argc)
+            rooms.compressedCacheBytes = std::strtoul(argv[++i], nullptr, 10) << 20;
+        else if (!strcmp(argv[i], "--durability") && i + 1 < argc)
         {
-            HandleView(clientFd);
+            if (!ParseDurability(argv[++i], durability))
+            {
+                LOG_ERROR("[SERVER] --durability must be none, group or strict");
+                return 1;
+            }
         }
-        else if (line.rfind("POST", 0) == 0)
+        else if (!strcmp(argv[i], "--group-window-us") && i + 1 < argc)
+            groupWindowUs = std::atol(argv[++i]);
+        else if (!strcmp(argv[i], "--group-max") && i + 1 < argc)
+            groupMax = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--subscriber-queue-kb") && i + 1 < argc)
+            subscriberQueueKb = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--replica-of") && i + 1 < argc)
+            primaryAddr = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-listen") && i + 1 < argc)
+            metricsListen = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc)
+            metricsFile = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-interval") && i + 1 < argc)
+            metricsIntervalS = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-level") && i + 1 < argc)
         {
-            HandlePost(clientFd, line);
+            LogLevel level;
+            if (!Logger::parseLevel(argv[++i], level))
+            {
+                LOG_ERROR("[SERVER] --log-level must be trace, debug, info, warn, error or off");
+                return 1;
+            }
+            Logger::instance().setLevel(level);
         }
-        else
+        else if (!strcmp(argv[i], "--log-overflow") && i + 1 < argc)
         {
-            dprintf(clientFd, "ERR unknown\n");
-            std::cerr << Timestamp() << " [SERVER] ERROR: Unknown command received" << std::endl;
+            Logger::Overflow policy;
+            if (!Logger::parseOverflow(argv[++i], policy))
+            {
+                LOG_ERROR("[SERVER] --log-overflow must be drop or block");
+                return 1;
+            }
+            Logger::instance().setOverflow(policy);
         }
+    }
+
+    if (threads <= 0)
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    LOG_INFO("[SERVER] Starting on " << bindAddr << " using file: " << g_file << " (" << threads
+                                     << " reactor thread(s))");
+
+    RaiseFdLimit();
+    std::signal(SIGPIPE, SIG_IGN); // sendfile() has no MSG_NOSIGNAL
+    if (!StartMetricsExporter(metricsListen, metricsFile, metricsIntervalS))
+        return 1;
+
+    g_lobby.log.setDurability(durability, std::chrono::microseconds(groupWindowUs), groupMax);
+    g_lobby.log.setSegments(static_cast<uint64_t>(segmentMb) << 20, retainSegments);
+    if (!g_lobby.log.open(g_file, cacheMb << 20))
+    {
+        LOG_ERROR("[SERVER] Cannot open chat file " << g_file);
+        return 1;
+    }
+    g_lobby.compressed.setCapacity(compressCacheMb << 20);
+    g_lobby.subscribers.setQueueLimit(subscriberQueueKb << 10);
+    g_lobby.subscribers.publish(g_lobby.log.lastSeq());
+    if (!primaryAddr.empty())
+    {
+        g_replica = std::make_unique<Replica>(primaryAddr, g_lobby);
+        g_replica->start();
+    }
+
+    rooms.durability = durability;
+    rooms.groupWindow = std::chrono::microseconds(groupWindowUs);
+    rooms.groupMax = groupMax;
+    rooms.segmentBytes = static_cast<uint64_t>(segmentMb) << 20;
+    rooms.retainSegments = retainSegments;
+    rooms.subscriberQueue = subscriberQueueKb << 10;
+    g_rooms.configure(rooms);
 
-        ::close(clientFd);
-        std::cout << Timestamp() << " [SERVER] Connection closed" << std::endl;
+    // Every reactor opens its own listener; TcpListen() sets SO_REUSEPORT so
+    // the kernel load-balances new connections between them. All reactors
+    // exist before any runs, since each one also owns a shard of the rooms.
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    for (int i = 0; i < threads; ++i)
+    {
+        int listenFd = TcpListen(bindAddr);
+        if (listenFd < 0)
+        {
+            LOG_ERROR("[SERVER] Failed to bind " << bindAddr);
+            return 1;
+        }
+        reactors.push_back(std::make_unique<Reactor>(listenFd, HandleCommand, HandleFrame));
+        g_rooms.addShard(reactors.back().get());
     }
 
+    LOG_INFO("[SERVER] Listening for connections...");
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i)
+        workers.emplace_back(&Reactor::run, reactors[static_cast<size_t>(i)].get());
+
+    reactors[0]->run();
+
+    for (auto &t : workers)
+        t.join();
     return 0;
 }
@@ -0,0 +1,165 @@
+#include "Subscribers.hpp"
+#include "../common/Logger.hpp"
+
+#include <algorithm>
+
+void QueueSlice(OutQueue &out, const ChatLog::Slice &slice)
+{
+    for (const auto &file : slice.files)
+        out.writeFile(file.fd, file.offset, file.len, file.pin);
+    for (const auto &block : slice.blocks)
+    {
+        uint64_t from = std::max(slice.cached, block->offset);
+        uint64_t until = std::min(slice.end, block->offset + LogCache::kBlockSize);
+        out.writeRef(block->data + (from - block->offset), static_cast<size_t>(until - from), block);
+    }
+}
+
+SubscriberHub::SubscriberHub(ChatLog &log) : m_log(log)
+{
+}
+
+SubscriberHub::Local &SubscriberHub::localFor(Reactor *reactor)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    for (auto &local : m_locals)
+    {
+        if (local->reactor == reactor)
+            return *local;
+    }
+    m_locals.push_back(std::make_unique<Local>());
+    m_locals.back()->reactor = reactor;
+    return *m_locals.back();
+}
+
+void SubscriberHub::subscribe(Connection &conn, uint64_t sinceSeq, bool binary)
+{
+    Local &local = localFor(conn.reactor);
+    auto sub = std::make_shared<Subscriber>(Subscriber{ conn.fd, conn.id, sinceSeq + 1, binary });
+
+    auto &subs = local.subs;
+    subs.erase(std::remove_if(subs.begin(), subs.end(),
+                              [&](const auto &s) { return s->fd == conn.fd && s->connId == conn.id; }),
+               subs.end());
+    subs.push_back(sub);
+    local.active.store(true, std::memory_order_release);
+
+    // The subscription owns its connection's flow control: whenever the
+    // queue has drained, the records held back meanwhile are sent.
+    conn.onDrained = [this, sub](Connection &c) { deliver(c, *sub); };
+    deliver(conn, *sub);
+    LOG_DEBUG("[SERVER] SUBSCRIBE since #" << sinceSeq << " (" << subs.size() << " subscriber(s) on this loop)");
+}
+
+/*
+ * publish()
+ * ---------
+ * Lock-free on the reactor side: each loop is posted at most one pump()
+ * until it has run, however many records are published meanwhile.
+ */
+void SubscriberHub::publish(uint64_t seq)
+{
+    uint64_t prev = m_committed.load(std::memory_order_relaxed);
+    while (prev < seq && !m_committed.compare_exchange_weak(prev, seq, std::memory_order_acq_rel))
+    {
+    }
+    if (prev >= seq)
+        return;
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    for (auto &ptr : m_locals)
+    {
+        Local &local = *ptr;
+        if (!local.active.load(std::memory_order_acquire) || local.scheduled.exchange(true))
+            continue;
+        local.reactor->post([this, &local] { pump(local); });
+    }
+}
+
+/*
+ * pump()
+ * ------
+ * Loop thread. Pushes everything committed so far to each subscriber of
+ * this loop and forgets subscribers whose connection has closed.
+ */
+void SubscriberHub::pump(Local &local)
+{
+    // Clear first: a publish() racing with this pump schedules another.
+    local.scheduled.store(false, std::memory_order_release);
+
+    Push shared[2]; // text and binary push for subscribers at the same position
+    auto &subs = local.subs;
+    for (size_t i = 0; i < subs.size();)
+    {
+        Connection *conn = local.reactor->connection(subs[i]->fd, subs[i]->connId);
+        if (!conn || conn->state == Connection::State::Closing)
+        {
+            subs[i] = std::move(subs.back());
+            subs.pop_back();
+            continue;
+        }
+        Subscriber &sub = *subs[i++];
+        deliver(*conn, sub, &shared[sub.binary]);
+        local.reactor->flush(*conn);
+    }
+    if (subs.empty())
+        local.active.store(false, std::memory_order_release);
+}
+
+/*
+ * preparePush()
+ * -------------
+ * Locates records firstSeq..lastSeq and formats the push header:
+ *   text:   "PUSH <bytes> <first-seq> <last-seq>\n<records>"
+ *   binary: Push frame (request id 0): u64 first-seq, u64 last-seq, <records>
+ * A frame has a size limit; whatever does not fit goes in the next push.
+ */
+void SubscriberHub::preparePush(uint64_t firstSeq, uint64_t lastSeq, bool binary, Push &push) const
+{
+    m_log.slice(firstSeq, push.slice, lastSeq, binary ? kMaxFramePayload - 16 : UINT64_MAX);
+
+    std::string head;
+    if (binary)
+    {
+        head.assign(kFrameHeaderSize, '\0');
+        EncodeFrameHeader(FrameHeader{ kFrameVersion, FrameOp::Push, 0, 0,
+                                       static_cast<uint32_t>(16 + push.slice.size()) },
+                          &head[0]);
+        PutU64(head, push.slice.firstSeq);
+        PutU64(head, push.slice.lastSeq);
+    }
+    else
+    {
+        head = "PUSH " + std::to_string(push.slice.size()) + " " + std::to_string(push.slice.firstSeq) + " " +
+               std::to_string(push.slice.lastSeq) + "\n";
+    }
+    push.head = std::make_shared<const std::string>(std::move(head));
+}
+
+/*
+ * deliver()
+ * ---------
+ * Queues records nextSeq..committed as one push, unless the subscriber
+ * already has more than the queue limit waiting. `shared` is reused when
+ * it starts at the subscriber's position and filled in when still empty;
+ * a subscriber elsewhere in the log gets a push of its own.
+ */
+void SubscriberHub::deliver(Connection &conn, Subscriber &sub, Push *shared)
+{
+    const uint64_t committed = m_committed.load(std::memory_order_acquire);
+    if (sub.nextSeq > committed || conn.outPending >= m_queueLimit)
+        return;
+
+    Push own;
+    Push *push = shared;
+    if (!push || (push->head && push->slice.firstSeq != sub.nextSeq))
+        push = &own;
+    if (!push->head)
+        preparePush(sub.nextSeq, committed, sub.binary, *push);
+    if (push->slice.size() == 0)
+        return;
+
+    conn.writeRef(push->head->data(), push->head->size(), push->head);
+    QueueSlice(conn, push->slice);
+    sub.nextSeq = push->slice.lastSeq + 1;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "ChatLog.hpp"
+#include "Reactor.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ *  Subscribers.hpp
+ *  ---------------
+ *  Push delivery of new records to connections that sent SUBSCRIBE.
+ *
+ *  Subscriptions live on the reactor that owns their connection and are
+ *  only touched by that loop. publish() (any thread) raises the committed
+ *  sequence number and wakes each reactor that has subscribers, at most
+ *  once per pending wake-up, so a burst of posts costs one wake-up per
+ *  loop rather than one per post and subscriber. The woken loop then
+ *  queues every subscriber's missing records straight from the ChatLog
+ *  slice (cached blocks by reference, older history via sendfile()).
+ *  Subscribers that are up to date share one slice and one header, so
+ *  fan-out costs one queue entry and one send per subscriber and a record
+ *  is never copied.
+ *
+ *  Each subscriber's send queue is bounded: once more than the queue
+ *  limit is waiting for a slow reader, new records are held back in the
+ *  log instead of being queued. When the backlog drains, the subscriber
+ *  catches up with one push covering everything it missed. A slow
+ *  consumer therefore costs no memory and cannot delay anyone else.
+ */
+
+// Queues the bytes of a slice (no copy; see ChatLog::Slice).
+void QueueSlice(OutQueue &out, const ChatLog::Slice &slice);
+
+class SubscriberHub
+{
+  public:
+    explicit SubscriberHub(ChatLog &log);
+
+    // Bytes a subscriber may have queued before pushes are held back.
+    void setQueueLimit(size_t bytes)
+    {
+        m_queueLimit = bytes;
+    }
+
+    // Loop thread of conn. Starts pushing records after sinceSeq to conn,
+    // as text or as Push frames; replaces an earlier subscription of the
+    // same connection.
+    void subscribe(Connection &conn, uint64_t sinceSeq, bool binary);
+
+    // Any thread. Records up to seq are committed and may be pushed.
+    void publish(uint64_t seq);
+
+    uint64_t committed() const
+    {
+        return m_committed.load(std::memory_order_acquire);
+    }
+
+  private:
+    struct Subscriber
+    {
+        int fd;
+        uint64_t connId;
+        uint64_t nextSeq;
+        bool binary;
+    };
+
+    // One push, formatted once and queued by reference to every subscriber
+    // at the same position.
+    struct Push
+    {
+        ChatLog::Slice slice;
+        std::shared_ptr<const std::string> head; // null until prepared
+    };
+
+    // Subscribers of one reactor; owned by that reactor's loop thread.
+    struct Local
+    {
+        Reactor *reactor;
+        std::vector<std::shared_ptr<Subscriber>> subs;
+        std::atomic<bool> scheduled{ false }; // pump() posted, not yet run
+        std::atomic<bool> active{ false };    // has (or had) subscribers
+    };
+
+    Local &localFor(Reactor *reactor);
+    void pump(Local &local);
+    void deliver(Connection &conn, Subscriber &sub, Push *shared = nullptr);
+    void preparePush(uint64_t firstSeq, uint64_t lastSeq, bool binary, Push &push) const;
+
+    ChatLog &m_log;
+    size_t m_queueLimit{ 256 * 1024 };
+    std::atomic<uint64_t> m_committed{ 0 };
+
+    std::mutex m_mutex; // guards m_locals (the list, not the subscribers)
+    std::vector<std::unique_ptr<Local>> m_locals;
+};